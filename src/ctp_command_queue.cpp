@@ -0,0 +1,131 @@
+#include "ctp_command_queue.h"
+#include <map>
+#include <set>
+
+CTPCommandQueue::CTPCommandQueue()
+    : running_(false)
+    , executed_requests_(0)
+    , merged_commands_(0)
+{
+}
+
+CTPCommandQueue::~CTPCommandQueue()
+{
+    stop();
+}
+
+void CTPCommandQueue::start(Executor executor, ResultHandler on_result)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+
+    executor_ = std::move(executor);
+    on_result_ = std::move(on_result);
+    running_ = true;
+    thread_ = std::make_unique<std::thread>(&CTPCommandQueue::run, this);
+}
+
+void CTPCommandQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+    thread_.reset();
+}
+
+void CTPCommandQueue::push(CTPCommand command)
+{
+    if (command.instrument_ids.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(command));
+    }
+    cv_.notify_one();
+}
+
+void CTPCommandQueue::push(CTPCommand::Type type, const std::string& connection_id,
+                           std::vector<std::string> instrument_ids)
+{
+    push(CTPCommand{type, connection_id, std::move(instrument_ids)});
+}
+
+size_t CTPCommandQueue::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+std::vector<CTPCommand> CTPCommandQueue::coalesce(std::deque<CTPCommand>& batch, uint64_t& merged)
+{
+    // connection_id -> 该连接按顺序排列的命令，只合并相邻的同类命令，订阅/退订的先后关系不变
+    std::vector<std::string> connection_order;
+    std::map<std::string, std::vector<CTPCommand>> by_connection;
+    std::map<std::string, std::set<std::string>> last_run_instruments;
+
+    for (auto& command : batch) {
+        auto& commands = by_connection[command.connection_id];
+        auto& seen = last_run_instruments[command.connection_id];
+        if (commands.empty()) {
+            connection_order.push_back(command.connection_id);
+        }
+
+        if (commands.empty() || commands.back().type != command.type) {
+            seen.clear();
+            seen.insert(command.instrument_ids.begin(), command.instrument_ids.end());
+            commands.push_back(std::move(command));
+            continue;
+        }
+
+        ++merged;
+        for (auto& instrument_id : command.instrument_ids) {
+            if (seen.insert(instrument_id).second) {
+                commands.back().instrument_ids.push_back(std::move(instrument_id));
+            }
+        }
+    }
+
+    std::vector<CTPCommand> result;
+    for (const auto& connection_id : connection_order) {
+        for (auto& command : by_connection[connection_id]) {
+            result.push_back(std::move(command));
+        }
+    }
+    return result;
+}
+
+void CTPCommandQueue::run()
+{
+    while (true) {
+        std::deque<CTPCommand> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;  // 已停止且没有剩余命令
+            }
+            batch.swap(queue_);
+        }
+
+        uint64_t merged = 0;
+        std::vector<CTPCommand> commands = coalesce(batch, merged);
+        merged_commands_.fetch_add(merged, std::memory_order_relaxed);
+
+        for (const auto& command : commands) {
+            std::vector<std::string> accepted = executor_(command);
+            executed_requests_.fetch_add(1, std::memory_order_relaxed);
+            if (on_result_) {
+                on_result_(command, accepted);
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 下发到CTP的订阅/退订命令
+struct CTPCommand {
+    enum class Type {
+        SUBSCRIBE = 0,
+        UNSUBSCRIBE = 1
+    };
+
+    Type type;
+    std::string connection_id;
+    std::vector<std::string> instrument_ids;
+};
+
+// CTP命令异步队列
+// 订阅状态在锁内更新后只把命令入队，由单独的工作线程调用CTP API，调用方不会因CTP请求阻塞或持锁等待。
+// 工作线程每次取走队列中的全部命令，按连接分组、保持同一连接内的先后顺序，
+// 并把相邻的同类命令合并为一次批量请求（开盘时大量客户端的零散订阅合并下发）。
+class CTPCommandQueue {
+public:
+    // 执行命令，返回被CTP接受的合约
+    using Executor = std::function<std::vector<std::string>(const CTPCommand& command)>;
+    // 命令执行结果（在工作线程中回调）
+    using ResultHandler = std::function<void(const CTPCommand& command, const std::vector<std::string>& accepted)>;
+
+    CTPCommandQueue();
+    ~CTPCommandQueue();
+
+    void start(Executor executor, ResultHandler on_result);
+    // 停止前执行完已入队的命令
+    void stop();
+
+    void push(CTPCommand command);
+    void push(CTPCommand::Type type, const std::string& connection_id, std::vector<std::string> instrument_ids);
+
+    size_t pending() const;
+    uint64_t executed_requests() const { return executed_requests_.load(std::memory_order_relaxed); }
+    uint64_t merged_commands() const { return merged_commands_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    static std::vector<CTPCommand> coalesce(std::deque<CTPCommand>& batch, uint64_t& merged);
+
+    Executor executor_;
+    ResultHandler on_result_;
+
+    std::deque<CTPCommand> queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    std::unique_ptr<std::thread> thread_;
+    bool running_;                           // 受 mutex_ 保护
+
+    std::atomic<uint64_t> executed_requests_;
+    std::atomic<uint64_t> merged_commands_;
+};
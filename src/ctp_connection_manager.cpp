@@ -1,7 +1,9 @@
 #include "ctp_connection_manager.h"
 #include "subscription_dispatcher.h"
 #include "market_data_server.h"
+#include "fast_log.h"
 #include <boost/filesystem.hpp>
+#include <boost/asio/post.hpp>
 #include <algorithm>
 #include <cstring>
 #include <thread>
@@ -10,17 +12,30 @@
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
 
+namespace {
+
+// 单次 SubscribeMarketData / UnSubscribeMarketData 请求携带的最大合约数
+constexpr size_t kMaxInstrumentsPerRequest = 500;
+
+// 并发执行连接启动/重启的最大线程数
+constexpr size_t kMaxLifecycleThreads = 8;
+
+} // namespace
+
 // CTPConnection 实现
 CTPConnection::CTPConnection(const CTPConnectionConfig& config, 
                             MarketDataServer* server,
-                            SubscriptionDispatcher* dispatcher)
+                            SubscriptionDispatcher* dispatcher,
+                            CTPConnectionManager* manager)
     : config_(config)
     , server_(server)
     , dispatcher_(dispatcher)
+    , manager_(manager)
     , ctp_api_(nullptr)
     , status_(CTPConnectionStatus::DISCONNECTED)
     , error_count_(0)
     , request_id_(0)
+    , callback_busy_ns_(0)
 {
 }
 
@@ -93,9 +108,9 @@ void CTPConnection::stop()
 
 bool CTPConnection::restart()
 {
+    // 重启间隔由 CTPConnectionManager 的退避排期控制，这里不再等待
     server_->log_info("Restarting CTP connection: " + config_.connection_id);
     stop();
-    std::this_thread::sleep_for(std::chrono::seconds(2));
 
     if (!server_->is_running()) {
         server_->log_info("Server is stopping, cancelling restart of " + config_.connection_id);
@@ -105,6 +120,45 @@ bool CTPConnection::restart()
     return start();
 }
 
+void CTPConnection::mark_stale()
+{
+    CTPConnectionStatus expected = CTPConnectionStatus::LOGGED_IN;
+    if (status_.compare_exchange_strong(expected, CTPConnectionStatus::ERROR)) {
+        error_count_++;
+        server_->log_warning("CTP connection " + config_.connection_id + " marked as stale");
+        request_restart("stale feed");
+    }
+}
+
+void CTPConnection::switch_front(const std::string& front_addr)
+{
+    std::string old_front;
+    {
+        std::lock_guard<std::mutex> lock(api_mutex_);
+        old_front = config_.front_addr;
+        config_.front_addr = front_addr;
+    }
+    server_->log_info("CTP connection " + config_.connection_id + " switching front " +
+                      old_front + " -> " + front_addr);
+    
+    CTPConnectionStatus expected = CTPConnectionStatus::LOGGED_IN;
+    status_.compare_exchange_strong(expected, CTPConnectionStatus::ERROR);
+    request_restart("front switch");
+}
+
+std::string CTPConnection::get_front_addr() const
+{
+    std::lock_guard<std::mutex> lock(api_mutex_);
+    return config_.front_addr;
+}
+
+void CTPConnection::request_restart(const std::string& reason)
+{
+    if (manager_) {
+        manager_->schedule_restart(config_.connection_id, reason);
+    }
+}
+
 bool CTPConnection::subscribe_instrument(const std::string& instrument_id)
 {
     std::lock_guard<std::mutex> api_lock(api_mutex_);
@@ -116,7 +170,7 @@ bool CTPConnection::subscribe_instrument(const std::string& instrument_id)
     }
     
     if (subscribed_instruments_.find(instrument_id) != subscribed_instruments_.end()) {
-        server_->log_warning("Instrument " + instrument_id + " already subscribed on connection " + config_.connection_id);
+        FLOG_WARNING("Instrument {} already subscribed on connection {}", instrument_id, config_.connection_id);
         return true;
     }
     
@@ -130,7 +184,7 @@ bool CTPConnection::subscribe_instrument(const std::string& instrument_id)
     
     if (ret == 0) {
         subscribed_instruments_.insert(instrument_id);
-        server_->log_info("Subscribed to " + instrument_id + " on connection " + config_.connection_id);
+        FLOG_INFO("Subscribed to {} on connection {}", instrument_id, config_.connection_id);
         return true;
     } else {
         server_->log_error("Failed to subscribe to " + instrument_id + " on connection " + 
@@ -159,7 +213,7 @@ bool CTPConnection::unsubscribe_instrument(const std::string& instrument_id)
     
     if (ret == 0) {
         subscribed_instruments_.erase(it);
-        server_->log_info("Unsubscribed from " + instrument_id + " on connection " + config_.connection_id);
+        FLOG_INFO("Unsubscribed from {} on connection {}", instrument_id, config_.connection_id);
         return true;
     } else {
         server_->log_error("Failed to unsubscribe from " + instrument_id + " on connection " + 
@@ -169,6 +223,103 @@ bool CTPConnection::unsubscribe_instrument(const std::string& instrument_id)
     }
 }
 
+std::vector<std::string> CTPConnection::subscribe_instruments(const std::vector<std::string>& instrument_ids)
+{
+    std::lock_guard<std::mutex> api_lock(api_mutex_);
+    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
+    
+    std::vector<std::string> accepted;
+    if (status_ != CTPConnectionStatus::LOGGED_IN) {
+        server_->log_warning("CTP connection " + config_.connection_id + " not ready for subscription");
+        return accepted;
+    }
+    
+    std::vector<const std::string*> pending;
+    pending.reserve(instrument_ids.size());
+    for (const auto& instrument_id : instrument_ids) {
+        if (subscribed_instruments_.find(instrument_id) != subscribed_instruments_.end()) {
+            accepted.push_back(instrument_id);
+            continue;
+        }
+        if (subscribed_instruments_.size() + pending.size() >= static_cast<size_t>(config_.max_subscriptions)) {
+            server_->log_warning("Connection " + config_.connection_id + " has reached max subscriptions limit, " +
+                                 std::to_string(instrument_ids.size() - accepted.size() - pending.size()) +
+                                 " instruments rejected");
+            break;
+        }
+        pending.push_back(&instrument_id);
+    }
+    
+    for (size_t offset = 0; offset < pending.size(); offset += kMaxInstrumentsPerRequest) {
+        const size_t count = std::min(kMaxInstrumentsPerRequest, pending.size() - offset);
+        std::vector<char*> batch(count);
+        for (size_t i = 0; i < count; ++i) {
+            batch[i] = const_cast<char*>(pending[offset + i]->c_str());
+        }
+        
+        int ret = ctp_api_->SubscribeMarketData(batch.data(), static_cast<int>(count));
+        if (ret == 0) {
+            for (size_t i = 0; i < count; ++i) {
+                subscribed_instruments_.insert(*pending[offset + i]);
+                accepted.push_back(*pending[offset + i]);
+            }
+        } else {
+            server_->log_error("Failed to subscribe " + std::to_string(count) + " instruments on connection " +
+                              config_.connection_id + ", return code: " + std::to_string(ret));
+            error_count_++;
+        }
+    }
+    
+    FLOG_INFO("Subscribed to {} of {} instruments on connection {}", accepted.size(), instrument_ids.size(),
+              config_.connection_id);
+    return accepted;
+}
+
+std::vector<std::string> CTPConnection::unsubscribe_instruments(const std::vector<std::string>& instrument_ids)
+{
+    std::lock_guard<std::mutex> api_lock(api_mutex_);
+    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
+    
+    std::vector<std::string> removed;
+    if (status_ != CTPConnectionStatus::LOGGED_IN) {
+        return removed;
+    }
+    
+    std::vector<const std::string*> pending;
+    pending.reserve(instrument_ids.size());
+    for (const auto& instrument_id : instrument_ids) {
+        if (subscribed_instruments_.find(instrument_id) == subscribed_instruments_.end()) {
+            removed.push_back(instrument_id);  // 已经没有订阅了
+        } else {
+            pending.push_back(&instrument_id);
+        }
+    }
+    
+    for (size_t offset = 0; offset < pending.size(); offset += kMaxInstrumentsPerRequest) {
+        const size_t count = std::min(kMaxInstrumentsPerRequest, pending.size() - offset);
+        std::vector<char*> batch(count);
+        for (size_t i = 0; i < count; ++i) {
+            batch[i] = const_cast<char*>(pending[offset + i]->c_str());
+        }
+        
+        int ret = ctp_api_->UnSubscribeMarketData(batch.data(), static_cast<int>(count));
+        if (ret == 0) {
+            for (size_t i = 0; i < count; ++i) {
+                subscribed_instruments_.erase(*pending[offset + i]);
+                removed.push_back(*pending[offset + i]);
+            }
+        } else {
+            server_->log_error("Failed to unsubscribe " + std::to_string(count) + " instruments on connection " +
+                              config_.connection_id + ", return code: " + std::to_string(ret));
+            error_count_++;
+        }
+    }
+    
+    FLOG_INFO("Unsubscribed from {} of {} instruments on connection {}", removed.size(), instrument_ids.size(),
+              config_.connection_id);
+    return removed;
+}
+
 size_t CTPConnection::get_subscription_count() const
 {
     std::lock_guard<std::mutex> lock(subscriptions_mutex_);
@@ -212,6 +363,7 @@ void CTPConnection::OnRspUserLogin(CThostFtdcRspUserLoginField *pRspUserLogin,
         server_->log_error("CTP login failed on connection " + config_.connection_id + ": " + std::string(pRspInfo->ErrorMsg));
         status_ = CTPConnectionStatus::ERROR;
         error_count_++;
+        request_restart("login failed");
         return;
     }
     
@@ -222,6 +374,11 @@ void CTPConnection::OnRspUserLogin(CThostFtdcRspUserLoginField *pRspUserLogin,
     if (dispatcher_) {
         dispatcher_->handle_connection_recovery(config_.connection_id);
     }
+    
+    // 更新启动就绪状态并清零重启退避
+    if (manager_) {
+        manager_->on_connection_logged_in(config_.connection_id);
+    }
 }
 
 void CTPConnection::OnRspSubMarketData(CThostFtdcSpecificInstrumentField *pSpecificInstrument,
@@ -241,7 +398,7 @@ void CTPConnection::OnRspSubMarketData(CThostFtdcSpecificInstrumentField *pSpeci
     
     if (pSpecificInstrument && dispatcher_) {
         std::string instrument_id = pSpecificInstrument->InstrumentID;
-        server_->log_info("Successfully subscribed to " + instrument_id + " on connection " + config_.connection_id);
+        FLOG_INFO("Successfully subscribed to {} on connection {}", instrument_id, config_.connection_id);
         dispatcher_->on_subscription_success(config_.connection_id, instrument_id);
     }
 }
@@ -259,7 +416,7 @@ void CTPConnection::OnRspUnSubMarketData(CThostFtdcSpecificInstrumentField *pSpe
     
     if (pSpecificInstrument && dispatcher_) {
         std::string instrument_id = pSpecificInstrument->InstrumentID;
-        server_->log_info("Successfully unsubscribed from " + instrument_id + " on connection " + config_.connection_id);
+        FLOG_INFO("Successfully unsubscribed from {} on connection {}", instrument_id, config_.connection_id);
         dispatcher_->on_unsubscription_success(config_.connection_id, instrument_id);
     }
 }
@@ -279,18 +436,31 @@ void CTPConnection::OnRtnDepthMarketData(CThostFtdcDepthMarketDataField *pDepthM
     
     std::string instrument_id = pDepthMarketData->InstrumentID;
     
+    // 冗余订阅：同一笔行情已由其它连接先送达时直接丢弃
+    if (!dispatcher_->arbitrate_tick(config_.connection_id, instrument_id,
+                                     pDepthMarketData->UpdateTime, pDepthMarketData->UpdateMillisec,
+                                     pDepthMarketData->Volume, static_cast<uint64_t>(cur_time))) {
+        callback_busy_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count(),
+                                    std::memory_order_relaxed);
+        return;
+    }
+    
     // 通过映射表查找带前缀的格式
     auto map_it = server_->noheadtohead_instruments_map_.find(instrument_id);
     std::string display_instrument = (map_it != server_->noheadtohead_instruments_map_.end()) 
         ? map_it->second : instrument_id;
     
     MarketDataStruct market_data = MarketDataServer::build_market_data_struct(pDepthMarketData, display_instrument, cur_time);
-    server_->cache_market_data(instrument_id, market_data, display_instrument);
-    dispatcher_->on_market_data(config_.connection_id, instrument_id, market_data, display_instrument);
+    if (server_->cache_market_data(instrument_id, market_data, display_instrument)) {
+        dispatcher_->on_market_data(config_.connection_id, instrument_id, market_data, display_instrument);
+    } else {
+        dispatcher_->on_duplicate_tick(config_.connection_id, instrument_id);
+    }
 
 
     const auto end = clock::now();
     const auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    callback_busy_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
 
     static std::atomic<uint64_t> total_ns{0};
     static std::atomic<uint64_t> call_count{0};
@@ -300,7 +470,7 @@ void CTPConnection::OnRtnDepthMarketData(CThostFtdcDepthMarketDataField *pDepthM
 
     if ((count % 50000) == 0) {                 // 任意输出周期
         const auto avg_ns = total_ns.load(std::memory_order_relaxed) / count;
-        server_->log_info("OnRtnDepthMarketData avg cost: " + std::to_string(avg_ns) + " ns (" + std::to_string(count) + " calls)");
+        FLOG_INFO("OnRtnDepthMarketData avg cost: {} ns ({} calls)", avg_ns, count);
     }
 }
 
@@ -329,6 +499,7 @@ void CTPConnection::login()
                           ", return code: " + std::to_string(ret));
         status_ = CTPConnectionStatus::ERROR;
         error_count_++;
+        request_restart("login request failed");
     } else {
         server_->log_info("Login request sent on connection " + config_.connection_id);
     }
@@ -339,6 +510,7 @@ void CTPConnection::handle_connection_error()
     if (error_count_ > 10) {
         server_->log_error("Too many errors on connection " + config_.connection_id + ", marking as failed");
         status_ = CTPConnectionStatus::ERROR;
+        request_restart("too many errors");
     }
 }
 
@@ -349,6 +521,17 @@ CTPConnectionManager::CTPConnectionManager(MarketDataServer* server,
     , dispatcher_(dispatcher)
     , health_check_running_(false)
     , health_check_interval_(30) // 30秒健康检查间隔
+    , lifecycle_running_(false)
+    , backoff_rng_(std::random_device{}())
+    , restart_backoff_initial_(1000)
+    , restart_backoff_max_(60000)
+    , startup_quorum_(1)
+    , ready_(false)
+    , start_time_(std::chrono::steady_clock::now())
+    , front_probe_running_(false)
+    , front_probe_interval_(300)
+    , front_auto_switch_(false)
+    , front_switch_min_gain_ms_(2.0)
 {
 }
 
@@ -358,6 +541,22 @@ CTPConnectionManager::~CTPConnectionManager()
     stop_all_connections();
 }
 
+void CTPConnectionManager::configure(const MultiCTPConfig& config)
+{
+    health_check_interval_ = std::chrono::seconds(config.health_check_interval);
+    restart_backoff_initial_ = std::chrono::milliseconds(config.restart_backoff_initial_ms);
+    restart_backoff_max_ = std::chrono::milliseconds(config.restart_backoff_max_ms);
+    startup_quorum_ = static_cast<size_t>(std::max(1, config.startup_quorum));
+    
+    if (config.front_probe_enabled) {
+        front_prober_ = std::make_unique<FrontProber>(std::chrono::milliseconds(config.front_probe_timeout_ms));
+        front_probe_interval_ = std::chrono::seconds(config.front_probe_interval);
+        broker_data_file_ = config.broker_data_file;
+        front_auto_switch_ = config.front_auto_switch;
+        front_switch_min_gain_ms_ = config.front_switch_min_gain_ms;
+    }
+}
+
 bool CTPConnectionManager::add_connection(const CTPConnectionConfig& config)
 {
     std::lock_guard<std::mutex> lock(connections_mutex_);
@@ -367,7 +566,7 @@ bool CTPConnectionManager::add_connection(const CTPConnectionConfig& config)
         return false;
     }
     
-    auto connection = std::make_shared<CTPConnection>(config, server_, dispatcher_);
+    auto connection = std::make_shared<CTPConnection>(config, server_, dispatcher_, this);
     connections_[config.connection_id] = connection;
     
     server_->log_info("Added CTP connection: " + config.connection_id + " -> " + config.front_addr);
@@ -392,28 +591,48 @@ bool CTPConnectionManager::remove_connection(const std::string& connection_id)
 
 bool CTPConnectionManager::start_all_connections()
 {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    
-    bool all_started = true;
-    for (auto& pair : connections_) {
-        if (pair.second->get_status() == CTPConnectionStatus::DISCONNECTED) {
-            if (!pair.second->start()) {
-                server_->log_error("Failed to start connection: " + pair.first);
-                all_started = false;
+    std::vector<std::shared_ptr<CTPConnection>> to_start;
+    size_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        total = connections_.size();
+        for (auto& pair : connections_) {
+            if (pair.second->get_status() == CTPConnectionStatus::DISCONNECTED) {
+                to_start.push_back(pair.second);
             }
         }
     }
     
-    // 启动健康检查
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        start_time_ = std::chrono::steady_clock::now();
+        if (startup_quorum_ > total && total > 0) {
+            server_->log_warning("startup_quorum " + std::to_string(startup_quorum_) + " exceeds " +
+                                 std::to_string(total) + " configured connections, using " + std::to_string(total));
+            startup_quorum_ = total;
+        }
+    }
+    
+    // 各前置并发启动，单个前置慢或失败不影响其它前置
+    start_lifecycle_workers(std::min<size_t>(std::max<size_t>(to_start.size(), 1), kMaxLifecycleThreads));
+    for (const auto& connection : to_start) {
+        start_connection_async(connection);
+    }
+    
+    // 启动健康检查与前置探测
     start_health_monitor();
+    start_front_prober();
     
-    server_->log_info("Started " + std::to_string(connections_.size()) + " CTP connections");
-    return all_started;
+    server_->log_info("Starting " + std::to_string(to_start.size()) + " CTP connections concurrently, ready when " +
+                      std::to_string(startup_quorum_) + " are logged in");
+    return true;
 }
 
 void CTPConnectionManager::stop_all_connections()
 {
+    stop_front_prober();
     stop_health_monitor();
+    stop_lifecycle_workers();
     
     std::lock_guard<std::mutex> lock(connections_mutex_);
     
@@ -424,6 +643,179 @@ void CTPConnectionManager::stop_all_connections()
     server_->log_info("Stopped all CTP connections");
 }
 
+void CTPConnectionManager::start_lifecycle_workers(size_t thread_count)
+{
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (lifecycle_running_) {
+        return;
+    }
+    
+    lifecycle_ioc_.restart();
+    lifecycle_work_ = std::make_unique<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
+        lifecycle_ioc_.get_executor());
+    for (size_t i = 0; i < thread_count; ++i) {
+        lifecycle_threads_.emplace_back([this]() { lifecycle_ioc_.run(); });
+    }
+    lifecycle_running_ = true;
+}
+
+void CTPConnectionManager::stop_lifecycle_workers()
+{
+    {
+        std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+        if (!lifecycle_running_) {
+            return;
+        }
+        lifecycle_running_ = false;
+        
+        for (auto& pair : lifecycle_states_) {
+            if (pair.second.timer) {
+                pair.second.timer->cancel();
+            }
+            pair.second.restart_pending = false;
+        }
+        lifecycle_work_.reset();
+        lifecycle_ioc_.stop();
+    }
+    
+    for (auto& thread : lifecycle_threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    lifecycle_threads_.clear();
+    
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    lifecycle_states_.clear();
+}
+
+void CTPConnectionManager::start_connection_async(const std::shared_ptr<CTPConnection>& connection)
+{
+    boost::asio::post(lifecycle_ioc_, [this, connection]() {
+        if (!connection->start()) {
+            server_->log_error("Failed to start connection: " + connection->get_connection_id());
+            schedule_restart(connection->get_connection_id(), "start failed");
+        }
+    });
+}
+
+void CTPConnectionManager::schedule_restart(const std::string& connection_id, const std::string& reason)
+{
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (!lifecycle_running_) {
+        return;
+    }
+    
+    ConnectionLifecycle& state = lifecycle_states_[connection_id];
+    if (state.restart_pending) {
+        return;  // 已有待执行的重启
+    }
+    
+    const std::chrono::milliseconds delay = next_backoff_delay(state.attempts);
+    state.attempts++;
+    state.restart_pending = true;
+    if (!state.timer) {
+        state.timer = std::make_unique<boost::asio::steady_timer>(lifecycle_ioc_);
+    }
+    
+    state.timer->expires_after(delay);
+    state.timer->async_wait([this, connection_id](const boost::system::error_code& ec) {
+        if (!ec) {
+            run_restart(connection_id);
+        }
+    });
+    
+    server_->log_warning("Scheduled restart of " + connection_id + " in " + std::to_string(delay.count()) +
+                         "ms (attempt " + std::to_string(state.attempts) + "): " + reason);
+}
+
+void CTPConnectionManager::run_restart(const std::string& connection_id)
+{
+    {
+        std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+        auto it = lifecycle_states_.find(connection_id);
+        if (it != lifecycle_states_.end()) {
+            it->second.restart_pending = false;
+        }
+    }
+    
+    auto connection = get_connection(connection_id);
+    if (!connection || !server_->is_running()) {
+        return;
+    }
+    
+    // 在生命周期工作线程上执行，不阻塞健康检查与其它前置
+    if (!connection->restart()) {
+        schedule_restart(connection_id, "restart failed");
+    }
+}
+
+std::chrono::milliseconds CTPConnectionManager::next_backoff_delay(int attempts)
+{
+    // 指数退避 + 抖动：在 [base/2, base] 内均匀取值，避免多个前置同时重连
+    const int shift = std::min(attempts, 16);
+    const int64_t base = std::min<int64_t>(restart_backoff_initial_.count() << shift, restart_backoff_max_.count());
+    std::uniform_int_distribution<int64_t> jitter(base / 2, base);
+    return std::chrono::milliseconds(jitter(backoff_rng_));
+}
+
+void CTPConnectionManager::on_connection_logged_in(const std::string& connection_id)
+{
+    {
+        std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+        auto it = lifecycle_states_.find(connection_id);
+        if (it != lifecycle_states_.end()) {
+            it->second.attempts = 0;
+        }
+    }
+    
+    const size_t logged_in = get_active_connections();
+    std::function<void(size_t)> callback;
+    std::chrono::steady_clock::duration elapsed;
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        if (ready_ || logged_in < startup_quorum_) {
+            return;
+        }
+        ready_ = true;
+        callback = ready_callback_;
+        elapsed = std::chrono::steady_clock::now() - start_time_;
+    }
+    ready_cv_.notify_all();
+    
+    server_->log_info("Startup quorum reached: " + std::to_string(logged_in) + "/" +
+                      std::to_string(get_total_connections()) + " connections logged in after " +
+                      std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()) + "ms");
+    if (callback) {
+        callback(logged_in);
+    }
+}
+
+bool CTPConnectionManager::is_ready() const
+{
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    return ready_;
+}
+
+bool CTPConnectionManager::wait_until_ready(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(ready_mutex_);
+    return ready_cv_.wait_for(lock, timeout, [this]() { return ready_; });
+}
+
+void CTPConnectionManager::set_ready_callback(std::function<void(size_t logged_in)> callback)
+{
+    bool already_ready = false;
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        ready_callback_ = callback;
+        already_ready = ready_;
+    }
+    if (already_ready && callback) {
+        callback(get_active_connections());
+    }
+}
+
 std::shared_ptr<CTPConnection> CTPConnectionManager::get_connection(const std::string& connection_id)
 {
     std::lock_guard<std::mutex> lock(connections_mutex_);
@@ -530,27 +922,8 @@ void CTPConnectionManager::health_check_loop()
                 // 检查连接状态
                 if (status == CTPConnectionStatus::ERROR || 
                     (status == CTPConnectionStatus::DISCONNECTED && conn->get_error_count() > 5)) {
-                    const std::string conn_id = conn->get_connection_id();
-                    bool should_restart = false;
-                    
-                    // 检查是否允许重启（去重+退避）
-                    {
-                        std::lock_guard<std::mutex> lock(restart_mutex_);
-                        const auto now = std::chrono::steady_clock::now();
-                        const auto it = next_restart_allowed_.find(conn_id);
-                        
-                        if (it == next_restart_allowed_.end() || now >= it->second) {
-                            // 允许重启：首次或已过退避期
-                            next_restart_allowed_[conn_id] = now + std::chrono::seconds(10);
-                            should_restart = true;
-                        }
-                    }
-                    
-                    if (should_restart) {
-                        server_->log_warning("Connection " + conn_id + " is unhealthy, attempting restart");
-                        // 直接在健康检查线程内重启，不创建新线程
-                        conn->restart();
-                    }
+                    // 交由生命周期状态机按退避排期重启，健康检查线程不阻塞
+                    schedule_restart(conn->get_connection_id(), "unhealthy");
                 }
             }
             
@@ -564,3 +937,209 @@ void CTPConnectionManager::health_check_loop()
         }
     }
 }
+
+void CTPConnectionManager::start_front_prober()
+{
+    if (!front_prober_ || front_probe_running_) {
+        return;
+    }
+    
+    front_probe_running_ = true;
+    front_probe_thread_ = std::make_unique<std::thread>(&CTPConnectionManager::front_probe_loop, this);
+    
+    server_->log_info("Started front prober (" + broker_data_file_ + ", every " +
+                      std::to_string(front_probe_interval_.count()) + "s, auto switch " +
+                      (front_auto_switch_ ? "on" : "off") + ")");
+}
+
+void CTPConnectionManager::stop_front_prober()
+{
+    front_probe_running_ = false;
+    
+    if (front_probe_thread_ && front_probe_thread_->joinable()) {
+        front_probe_thread_->join();
+    }
+    
+    front_probe_thread_.reset();
+    
+    // 未完成的切换放弃，连接恢复接收新订阅
+    if (dispatcher_) {
+        for (const auto& pair : pending_front_switches_) {
+            dispatcher_->end_connection_drain(pair.first);
+        }
+    }
+    pending_front_switches_.clear();
+}
+
+std::string CTPConnectionManager::get_front_report() const
+{
+    return front_prober_ ? front_prober_->report() : std::string();
+}
+
+void CTPConnectionManager::front_probe_loop()
+{
+    while (front_probe_running_ && server_->is_running()) {
+        try {
+            refresh_front_ranking();
+            if (front_auto_switch_) {
+                switch_slow_fronts();
+            }
+        } catch (const std::exception& e) {
+            server_->log_error("Front probe error: " + std::string(e.what()));
+        }
+        
+        for (int i = 0; i < front_probe_interval_.count() && front_probe_running_; ++i) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (!pending_front_switches_.empty()) {
+                complete_front_switches();
+            }
+        }
+    }
+}
+
+void CTPConnectionManager::refresh_front_ranking()
+{
+    // 只探测已配置连接所属经纪商的前置；每轮重新加载，便于在线更新 broker_data.json
+    std::set<std::string> broker_ids;
+    std::map<std::string, std::string> connection_fronts;
+    for (const auto& connection : get_all_connections()) {
+        broker_ids.insert(connection->get_broker_id());
+        connection_fronts[connection->get_connection_id()] = connection->get_front_addr();
+    }
+    
+    if (!front_prober_->load_broker_data(broker_data_file_, broker_ids)) {
+        server_->log_warning("Failed to load broker data file: " + broker_data_file_);
+        return;
+    }
+    
+    front_prober_->probe_all();
+    
+    // 已登录连接的实测行情延迟归到其当前前置
+    std::map<std::string, double> tick_lags;
+    if (dispatcher_) {
+        for (const auto& snapshot : dispatcher_->get_connection_load_snapshot()) {
+            auto it = connection_fronts.find(snapshot.connection_id);
+            if (it != connection_fronts.end() && snapshot.latency_ms >= 0) {
+                tick_lags[it->second] = snapshot.latency_ms;
+            }
+        }
+    }
+    front_prober_->set_tick_lags(tick_lags);
+    
+    size_t reachable = 0;
+    const auto ranked = front_prober_->ranked();
+    for (const auto& candidate : ranked) {
+        if (candidate.reachable) {
+            ++reachable;
+        }
+    }
+    server_->log_info("Front probe: " + std::to_string(reachable) + "/" + std::to_string(ranked.size()) +
+                      " fronts reachable for " + std::to_string(broker_ids.size()) + " brokers");
+}
+
+void CTPConnectionManager::switch_slow_fronts()
+{
+    auto connections = get_all_connections();
+    
+    std::set<std::string> in_use;
+    for (const auto& connection : connections) {
+        in_use.insert(FrontProber::strip_scheme(connection->get_front_addr()));
+    }
+    for (const auto& pair : pending_front_switches_) {
+        in_use.insert(FrontProber::strip_scheme(pair.second.front_addr));
+    }
+    
+    for (const auto& connection : connections) {
+        if (pending_front_switches_.count(connection->get_connection_id()) > 0) {
+            continue;  // 正在迁出订阅，等待切换
+        }
+        const CTPConnectionStatus status = connection->get_status();
+        if (status == CTPConnectionStatus::CONNECTING || status == CTPConnectionStatus::CONNECTED) {
+            continue;  // 正在建连，等待结果
+        }
+        
+        // 同经纪商中评分最好、且未被其它连接使用的可达前置
+        const FrontCandidate* best = nullptr;
+        const auto ranked = front_prober_->ranked_for_broker(connection->get_broker_id());
+        for (const auto& candidate : ranked) {
+            if (candidate.score < 0) {
+                break;
+            }
+            if (in_use.count(candidate.address) == 0) {
+                best = &candidate;
+                break;
+            }
+        }
+        if (!best) {
+            continue;
+        }
+        
+        const std::string current_front = connection->get_front_addr();
+        const double current_score = front_prober_->score_of(connection->get_broker_id(), current_front);
+        if (current_score < 0) {
+            // 当前前置不可达或不在候选列表中：仅在连接本身不可用时切换
+            if (status == CTPConnectionStatus::LOGGED_IN) {
+                continue;
+            }
+        } else if (current_score - best->score < front_switch_min_gain_ms_) {
+            continue;
+        }
+        
+        server_->log_info("Front switch for " + connection->get_connection_id() + ": " + current_front +
+                          " (score " + std::to_string(current_score) + " ms) -> " + best->front_addr() +
+                          " (score " + std::to_string(best->score) + " ms)");
+        
+        in_use.erase(FrontProber::strip_scheme(current_front));
+        in_use.insert(best->address);
+        
+        if (status == CTPConnectionStatus::LOGGED_IN && dispatcher_) {
+            // 先把订阅先订后退迁到其它连接，迁完后再重连新前置，切换期间行情不中断
+            const size_t migrating = dispatcher_->drain_connection(connection->get_connection_id());
+            server_->log_info("Front switch for " + connection->get_connection_id() + " waits for " +
+                              std::to_string(migrating) + " subscriptions to migrate");
+            pending_front_switches_[connection->get_connection_id()] =
+                PendingFrontSwitch{best->front_addr(), std::chrono::steady_clock::now() + std::chrono::seconds(60)};
+            continue;
+        }
+        connection->switch_front(best->front_addr());
+    }
+    
+    complete_front_switches();
+}
+
+void CTPConnectionManager::complete_front_switches()
+{
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = pending_front_switches_.begin(); it != pending_front_switches_.end(); ) {
+        const std::string& connection_id = it->first;
+        auto connection = get_connection(connection_id);
+        if (!connection) {
+            if (dispatcher_) {
+                dispatcher_->end_connection_drain(connection_id);
+            }
+            it = pending_front_switches_.erase(it);
+            continue;
+        }
+        
+        // 连接已断开（由故障转移接管）、订阅已迁完或超时时切换
+        const bool logged_in = connection->get_status() == CTPConnectionStatus::LOGGED_IN;
+        const bool drained = !dispatcher_ || dispatcher_->connection_drained(connection_id);
+        if (logged_in && !drained && now < it->second.deadline) {
+            ++it;
+            continue;
+        }
+        if (logged_in && !drained) {
+            server_->log_warning("Front switch for " + connection_id +
+                                 " timed out waiting for migration, failing over remaining subscriptions");
+        }
+        
+        connection->switch_front(it->second.front_addr);
+        if (dispatcher_) {
+            if (logged_in && !drained) {
+                dispatcher_->handle_connection_failure(connection_id);
+            }
+            dispatcher_->end_connection_drain(connection_id);
+        }
+        it = pending_front_switches_.erase(it);
+    }
+}
@@ -2,6 +2,13 @@
 
 #include "../libs/ThostFtdcMdApi.h"
 #include "multi_ctp_config.h"
+#include "front_prober.h"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <condition_variable>
+#include <functional>
+#include <random>
 #include <memory>
 #include <vector>
 #include <map>
@@ -14,6 +21,7 @@
 
 class MarketDataServer;
 class SubscriptionDispatcher;
+class CTPConnectionManager;
 
 // CTP连接状态
 enum class CTPConnectionStatus {
@@ -30,24 +38,38 @@ class CTPConnection : public CThostFtdcMdSpi
 public:
     explicit CTPConnection(const CTPConnectionConfig& config, 
                           MarketDataServer* server,
-                          SubscriptionDispatcher* dispatcher);
+                          SubscriptionDispatcher* dispatcher,
+                          CTPConnectionManager* manager = nullptr);
     virtual ~CTPConnection();
     
     // 连接管理
     bool start();
     void stop();
     bool restart();
+    void mark_stale();
+    
+    // 切换到新的行情前置（下次启动生效，已登录的连接立即触发重启）
+    void switch_front(const std::string& front_addr);
     
     // 订阅管理
     bool subscribe_instrument(const std::string& instrument_id);
     bool unsubscribe_instrument(const std::string& instrument_id);
     
+    // 批量订阅管理（使用CTP数组接口，一次加锁），返回已生效的合约
+    std::vector<std::string> subscribe_instruments(const std::vector<std::string>& instrument_ids);
+    std::vector<std::string> unsubscribe_instruments(const std::vector<std::string>& instrument_ids);
+    
     // 状态查询
     CTPConnectionStatus get_status() const { return status_; }
     const std::string& get_connection_id() const { return config_.connection_id; }
+    const std::string& get_broker_id() const { return config_.broker_id; }
+    int get_max_subscriptions() const { return config_.max_subscriptions; }
+    std::string get_front_addr() const;
     size_t get_subscription_count() const;
     bool can_accept_more_subscriptions() const;
     int get_error_count() const { return error_count_; }
+    // 行情回调累计耗时（纳秒），维护线程据此计算回调线程占用率
+    uint64_t get_callback_busy_ns() const { return callback_busy_ns_.load(std::memory_order_relaxed); }
     
     // CTP SPI回调实现
     virtual void OnFrontConnected() override;
@@ -67,10 +89,12 @@ public:
 private:
     void login();
     void handle_connection_error();
+    void request_restart(const std::string& reason);
     
     CTPConnectionConfig config_;
     MarketDataServer* server_;
     SubscriptionDispatcher* dispatcher_;
+    CTPConnectionManager* manager_;
     
     CThostFtdcMdApi* ctp_api_;
     std::atomic<CTPConnectionStatus> status_;
@@ -78,10 +102,11 @@ private:
     
     std::atomic<int> error_count_;
     std::atomic<int> request_id_;
+    std::atomic<uint64_t> callback_busy_ns_;
     
     // 线程安全
     mutable std::mutex subscriptions_mutex_;
-    std::mutex api_mutex_;
+    mutable std::mutex api_mutex_;
 };
 
 // 多CTP连接管理器
@@ -112,8 +137,42 @@ public:
     void start_health_monitor();
     void stop_health_monitor();
     
+    // 生命周期参数（健康检查间隔、重启退避、启动就绪法定数）
+    void configure(const MultiCTPConfig& config);
+    
+    // 异步重启：按连接指数退避+随机抖动排期，同一连接同时只有一个待执行的重启
+    void schedule_restart(const std::string& connection_id, const std::string& reason);
+    
+    // 启动就绪信号：已登录连接数达到 startup_quorum 时触发一次
+    void on_connection_logged_in(const std::string& connection_id);
+    bool is_ready() const;
+    bool wait_until_ready(std::chrono::milliseconds timeout);
+    void set_ready_callback(std::function<void(size_t logged_in)> callback);
+    
+    // 前置探测：定期按 broker_data.json 为各连接的经纪商排名前置，可选自动切换到更快的前置
+    void start_front_prober();
+    void stop_front_prober();
+    std::string get_front_report() const;
+    
 private:
     void health_check_loop();
+    void front_probe_loop();
+    void refresh_front_ranking();
+    void switch_slow_fronts();
+    void complete_front_switches();
+    
+    // 生命周期工作线程（并发执行连接启动/重启，不阻塞健康检查与CTP回调线程）
+    struct ConnectionLifecycle {
+        std::unique_ptr<boost::asio::steady_timer> timer;
+        int attempts = 0;                 // 连续重启次数（登录成功后清零）
+        bool restart_pending = false;
+    };
+    
+    void start_lifecycle_workers(size_t thread_count);
+    void stop_lifecycle_workers();
+    void start_connection_async(const std::shared_ptr<CTPConnection>& connection);
+    void run_restart(const std::string& connection_id);
+    std::chrono::milliseconds next_backoff_delay(int attempts);
     
     MarketDataServer* server_;
     SubscriptionDispatcher* dispatcher_;
@@ -126,7 +185,38 @@ private:
     std::atomic<bool> health_check_running_;
     std::chrono::seconds health_check_interval_;
     
-    // 重启去重与退避控制
-    std::mutex restart_mutex_;
-    std::map<std::string, std::chrono::steady_clock::time_point> next_restart_allowed_;
+    // 生命周期状态机
+    boost::asio::io_context lifecycle_ioc_;
+    std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> lifecycle_work_;
+    std::vector<std::thread> lifecycle_threads_;
+    std::map<std::string, ConnectionLifecycle> lifecycle_states_;
+    std::mutex lifecycle_mutex_;
+    bool lifecycle_running_;
+    std::mt19937 backoff_rng_;
+    std::chrono::milliseconds restart_backoff_initial_;
+    std::chrono::milliseconds restart_backoff_max_;
+    
+    // 启动就绪
+    size_t startup_quorum_;
+    bool ready_;
+    std::function<void(size_t)> ready_callback_;
+    std::chrono::steady_clock::time_point start_time_;
+    mutable std::mutex ready_mutex_;
+    std::condition_variable ready_cv_;
+    
+    // 前置探测
+    std::unique_ptr<FrontProber> front_prober_;
+    std::unique_ptr<std::thread> front_probe_thread_;
+    std::atomic<bool> front_probe_running_;
+    std::chrono::seconds front_probe_interval_;
+    std::string broker_data_file_;
+    bool front_auto_switch_;
+    double front_switch_min_gain_ms_;
+    
+    // 已登录连接的前置切换为先迁后切：订阅先订后退迁出，连接上不再有订阅后再切换前置（仅探测线程访问）
+    struct PendingFrontSwitch {
+        std::string front_addr;
+        std::chrono::steady_clock::time_point deadline;   // 超时仍未迁完则直接切换，剩余订阅按故障转移处理
+    };
+    std::map<std::string, PendingFrontSwitch> pending_front_switches_;
 };
\ No newline at end of file
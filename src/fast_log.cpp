@@ -0,0 +1,255 @@
+#include "fast_log.h"
+#include "logging.h"
+
+#include <boost/log/trivial.hpp>
+#include <boost/log/sources/severity_logger.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/log/attributes/mutable_constant.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fastlog {
+
+std::atomic<int> g_runtime_level{FAST_LOG_MIN_LEVEL};
+
+namespace {
+
+constexpr uint64_t kQueueCapacity = 1024;   // 每线程 256KB
+constexpr uint64_t kQueueMask = kQueueCapacity - 1;
+static_assert((kQueueCapacity & kQueueMask) == 0, "queue capacity must be a power of two");
+
+// 单生产者单消费者环形队列：生产者为业务线程，消费者为后台线程
+struct ThreadQueue {
+    alignas(64) std::atomic<uint64_t> head{0};      // 消费者位置
+    alignas(64) std::atomic<uint64_t> tail{0};      // 生产者位置
+    alignas(64) std::atomic<bool> thread_exited{false};
+    Record slots[kQueueCapacity];
+};
+
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadQueue>> g_queues;
+std::atomic<uint64_t> g_dropped{0};
+
+std::mutex g_backend_mutex;
+std::unique_ptr<std::thread> g_backend_thread;
+std::atomic<bool> g_backend_running{false};
+
+// 线程退出时只打标记，队列由后台线程排空后回收
+struct QueueHolder {
+    std::shared_ptr<ThreadQueue> queue;
+    ~QueueHolder() {
+        if (queue) {
+            queue->thread_exited.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local QueueHolder t_queue_holder;
+
+ThreadQueue* local_queue()
+{
+    if (!t_queue_holder.queue) {
+        auto queue = std::make_shared<ThreadQueue>();
+        {
+            std::lock_guard<std::mutex> lock(g_registry_mutex);
+            g_queues.push_back(queue);
+        }
+        t_queue_holder.queue = std::move(queue);
+    }
+    return t_queue_holder.queue.get();
+}
+
+boost::log::trivial::severity_level to_severity(Level level)
+{
+    switch (level) {
+        case Level::debug:   return boost::log::trivial::debug;
+        case Level::info:    return boost::log::trivial::info;
+        case Level::warning: return boost::log::trivial::warning;
+        case Level::error:   return boost::log::trivial::error;
+    }
+    return boost::log::trivial::info;
+}
+
+void append_arg(const Record& r, size_t i, std::string& out)
+{
+    char num[32];
+    switch (r.types[i]) {
+        case ArgType::I64:
+            out.append(num, snprintf(num, sizeof(num), "%lld", static_cast<long long>(r.args[i])));
+            break;
+        case ArgType::U64:
+            out.append(num, snprintf(num, sizeof(num), "%llu", static_cast<unsigned long long>(r.args[i])));
+            break;
+        case ArgType::F64: {
+            double d;
+            memcpy(&d, &r.args[i], sizeof(d));
+            out.append(num, snprintf(num, sizeof(num), "%.10g", d));
+            break;
+        }
+        case ArgType::BOOL:
+            out += r.args[i] ? "true" : "false";
+            break;
+        case ArgType::STR:
+            out.append(r.inline_bytes + (r.args[i] >> 16), r.args[i] & 0xFFFF);
+            break;
+    }
+}
+
+void format_record(const Record& r, std::string& out)
+{
+    out.clear();
+    size_t arg = 0;
+    for (const char* p = r.fmt; *p; ) {
+        if (p[0] == '{' && p[1] == '}') {
+            if (arg < r.arg_count) {
+                append_arg(r, arg++, out);
+            } else {
+                out += "{}";
+            }
+            p += 2;
+        } else {
+            out.push_back(*p++);
+        }
+    }
+    if (r.suppressed > 0) {
+        out += " [suppressed " + std::to_string(r.suppressed) + " similar messages]";
+    }
+}
+
+boost::posix_time::ptime to_local_ptime(uint64_t wall_ns)
+{
+    using boost::posix_time::ptime;
+    const ptime utc = boost::posix_time::from_time_t(static_cast<time_t>(wall_ns / 1000000000ULL)) +
+                      boost::posix_time::microseconds((wall_ns % 1000000000ULL) / 1000);
+    return boost::date_time::c_local_adjustor<ptime>::utc_to_local(utc);
+}
+
+void backend_loop()
+{
+    // 覆盖全局 TimeStamp 属性，使日志时间为事件发生时间而非格式化时间
+    boost::log::sources::severity_logger_mt<boost::log::trivial::severity_level> logger;
+    boost::log::attributes::mutable_constant<boost::posix_time::ptime> timestamp(
+        boost::posix_time::microsec_clock::local_time());
+    logger.add_attribute("TimeStamp", timestamp);
+
+    std::string text;
+    text.reserve(512);
+    auto last_flush = std::chrono::steady_clock::now();
+    bool dirty = false;
+    uint64_t reported_dropped = 0;
+
+    while (true) {
+        const bool running = g_backend_running.load(std::memory_order_acquire);
+
+        std::vector<std::shared_ptr<ThreadQueue>> queues;
+        {
+            std::lock_guard<std::mutex> lock(g_registry_mutex);
+            queues = g_queues;
+        }
+
+        size_t drained = 0;
+        for (const auto& queue : queues) {
+            uint64_t head = queue->head.load(std::memory_order_relaxed);
+            const uint64_t tail = queue->tail.load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                const Record& r = queue->slots[head & kQueueMask];
+                format_record(r, text);
+                timestamp.set(to_local_ptime(r.wall_ns));
+                BOOST_LOG_SEV(logger, to_severity(r.level)) << text;
+                ++drained;
+            }
+            queue->head.store(head, std::memory_order_release);
+        }
+
+        // 回收已退出且已排空的线程队列
+        {
+            std::lock_guard<std::mutex> lock(g_registry_mutex);
+            g_queues.erase(std::remove_if(g_queues.begin(), g_queues.end(),
+                [](const std::shared_ptr<ThreadQueue>& q) {
+                    return q->thread_exited.load(std::memory_order_acquire) &&
+                           q->head.load(std::memory_order_relaxed) == q->tail.load(std::memory_order_acquire);
+                }), g_queues.end());
+        }
+
+        const uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+        if (dropped != reported_dropped) {
+            timestamp.set(boost::posix_time::microsec_clock::local_time());
+            BOOST_LOG_SEV(logger, boost::log::trivial::warning)
+                << "fastlog queue overflow, dropped " << (dropped - reported_dropped) << " records";
+            reported_dropped = dropped;
+            ++drained;
+        }
+
+        if (drained > 0) {
+            dirty = true;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        // 突发结束后立即刷盘；持续写入时每 200ms 刷一次；空闲时每 500ms 兜底刷一次其它路径的日志
+        if ((dirty && (drained == 0 || now - last_flush > std::chrono::milliseconds(200))) ||
+            now - last_flush > std::chrono::milliseconds(500)) {
+            flush_logging();
+            dirty = false;
+            last_flush = now;
+        }
+
+        if (!running && drained == 0) {
+            break;
+        }
+        if (drained == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    flush_logging();
+}
+
+} // namespace
+
+void start_backend()
+{
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+    if (g_backend_thread) {
+        return;
+    }
+    g_backend_running.store(true, std::memory_order_release);
+    g_backend_thread = std::make_unique<std::thread>(backend_loop);
+}
+
+void stop_backend()
+{
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+    if (!g_backend_thread) {
+        return;
+    }
+    g_backend_running.store(false, std::memory_order_release);
+    if (g_backend_thread->joinable()) {
+        g_backend_thread->join();
+    }
+    g_backend_thread.reset();
+}
+
+uint64_t dropped_records()
+{
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+void submit(const Record& record)
+{
+    ThreadQueue* queue = local_queue();
+    const uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head.load(std::memory_order_acquire) >= kQueueCapacity) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queue->slots[tail & kQueueMask] = record;
+    queue->tail.store(tail + 1, std::memory_order_release);
+}
+
+} // namespace fastlog
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// 热路径结构化日志
+// 调用线程只把定长记录（静态格式串指针 + 类型化参数）写入本线程的无锁环形队列，
+// 字符串格式化、写文件和刷盘全部由后台线程完成。
+//
+// 用法：
+//   FLOG_INFO("Subscribed to {} on connection {}", instrument_id, connection_id);
+//   FLOG_INFO_RL(10, "peek_message processing time: {} ns", elapsed_ns);  // 每秒最多10条
+//
+// 格式串必须是字符串字面量（记录中只保存指针），占位符为 {}。
+
+// 编译期日志级别过滤：0=debug 1=info 2=warning 3=error，低于该级别的调用在编译期剔除
+#ifndef FAST_LOG_MIN_LEVEL
+#ifdef DEBUG
+#define FAST_LOG_MIN_LEVEL 0
+#else
+#define FAST_LOG_MIN_LEVEL 1
+#endif
+#endif
+
+namespace fastlog {
+
+enum class Level : uint8_t {
+    debug = 0,
+    info = 1,
+    warning = 2,
+    error = 3
+};
+
+enum class ArgType : uint8_t {
+    I64 = 0,
+    U64 = 1,
+    F64 = 2,
+    BOOL = 3,
+    STR = 4
+};
+
+constexpr size_t kMaxArgs = 8;
+constexpr size_t kInlineBytes = 160;
+
+// 定长日志记录（256字节，整条拷入环形队列）
+struct Record {
+    const char* fmt;                // 静态格式串
+    uint64_t wall_ns;               // 事件发生的墙钟时间
+    uint32_t suppressed;            // 该调用点上一窗口被限流丢弃的条数
+    Level level;
+    uint8_t arg_count;
+    uint16_t inline_used;
+    ArgType types[kMaxArgs];
+    uint64_t args[kMaxArgs];        // 数值参数；字符串参数为 (offset << 16 | length)
+    char inline_bytes[kInlineBytes];
+};
+
+static_assert(sizeof(Record) == 256, "fastlog::Record should stay one fixed 256-byte slot");
+
+// 调用点级限流器（每个调用点一个静态实例）
+class RateLimiter {
+public:
+    explicit RateLimiter(uint32_t max_per_second) : max_per_second_(max_per_second) {}
+
+    // 返回 true 表示允许输出；suppressed 返回上一窗口被丢弃的条数
+    bool allow(uint64_t wall_ns, uint32_t& suppressed) {
+        const uint64_t second = wall_ns / 1000000000ULL;
+        uint64_t window = window_.load(std::memory_order_relaxed);
+        if (second != window &&
+            window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+            suppressed = dropped_.exchange(0, std::memory_order_relaxed);
+        } else {
+            suppressed = 0;
+        }
+
+        if (count_.fetch_add(1, std::memory_order_relaxed) < max_per_second_) {
+            return true;
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    const uint32_t max_per_second_;
+    std::atomic<uint64_t> window_{0};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> dropped_{0};
+};
+
+// 运行期级别（只能在编译期级别之上进一步收紧）
+extern std::atomic<int> g_runtime_level;
+
+// 后台线程管理（由 init_logging / shutdown_logging 调用）
+void start_backend();
+void stop_backend();
+
+// 入队失败（队列满）累计丢弃的条数
+uint64_t dropped_records();
+
+// 将记录写入当前线程的队列（无锁，队列满时丢弃）
+void submit(const Record& record);
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+namespace detail {
+
+inline void put_string(Record& r, const char* s, size_t len) {
+    const size_t room = kInlineBytes - r.inline_used;
+    if (len > room) {
+        len = room;
+    }
+    memcpy(r.inline_bytes + r.inline_used, s, len);
+    r.types[r.arg_count] = ArgType::STR;
+    r.args[r.arg_count] = (static_cast<uint64_t>(r.inline_used) << 16) | len;
+    r.inline_used = static_cast<uint16_t>(r.inline_used + len);
+}
+
+inline void put_arg(Record& r, const std::string& v) { put_string(r, v.data(), v.size()); }
+inline void put_arg(Record& r, const char* v) { put_string(r, v ? v : "(null)", v ? strlen(v) : 6); }
+inline void put_arg(Record& r, char* v) { put_arg(r, static_cast<const char*>(v)); }
+
+inline void put_arg(Record& r, bool v) {
+    r.types[r.arg_count] = ArgType::BOOL;
+    r.args[r.arg_count] = v ? 1 : 0;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+put_arg(Record& r, T v) {
+    r.types[r.arg_count] = ArgType::I64;
+    r.args[r.arg_count] = static_cast<uint64_t>(static_cast<int64_t>(v));
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                               !std::is_same<T, bool>::value>::type
+put_arg(Record& r, T v) {
+    r.types[r.arg_count] = ArgType::U64;
+    r.args[r.arg_count] = static_cast<uint64_t>(v);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+put_arg(Record& r, T v) {
+    const double d = static_cast<double>(v);
+    r.types[r.arg_count] = ArgType::F64;
+    memcpy(&r.args[r.arg_count], &d, sizeof(d));
+}
+
+inline void encode(Record&) {}
+
+template<typename T, typename... Rest>
+inline void encode(Record& r, const T& first, const Rest&... rest) {
+    if (r.arg_count < kMaxArgs) {
+        put_arg(r, first);
+        ++r.arg_count;
+    }
+    encode(r, rest...);
+}
+
+} // namespace detail
+
+template<typename... Args>
+inline void log(Level level, uint64_t wall_ns, uint32_t suppressed, const char* fmt, const Args&... args) {
+    static_assert(sizeof...(Args) <= kMaxArgs, "too many fastlog arguments");
+    Record r;
+    r.fmt = fmt;
+    r.wall_ns = wall_ns;
+    r.suppressed = suppressed;
+    r.level = level;
+    r.arg_count = 0;
+    r.inline_used = 0;
+    detail::encode(r, args...);
+    submit(r);
+}
+
+} // namespace fastlog
+
+#define FAST_LOG_IMPL(level, ...)                                                         \
+    do {                                                                                  \
+        if (static_cast<int>(level) >= fastlog::g_runtime_level.load(std::memory_order_relaxed)) { \
+            fastlog::log(level, fastlog::now_ns(), 0, __VA_ARGS__);                        \
+        }                                                                                 \
+    } while (0)
+
+#define FAST_LOG_RL_IMPL(level, per_second, ...)                                          \
+    do {                                                                                  \
+        if (static_cast<int>(level) >= fastlog::g_runtime_level.load(std::memory_order_relaxed)) { \
+            static fastlog::RateLimiter fastlog_site_limiter_(per_second);               \
+            const uint64_t fastlog_ts_ = fastlog::now_ns();                               \
+            uint32_t fastlog_suppressed_ = 0;                                             \
+            if (fastlog_site_limiter_.allow(fastlog_ts_, fastlog_suppressed_)) {          \
+                fastlog::log(level, fastlog_ts_, fastlog_suppressed_, __VA_ARGS__);      \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define FAST_LOG_DISABLED(...) do {} while (0)
+
+#if FAST_LOG_MIN_LEVEL <= 0
+#define FLOG_DEBUG(...) FAST_LOG_IMPL(fastlog::Level::debug, __VA_ARGS__)
+#define FLOG_DEBUG_RL(n, ...) FAST_LOG_RL_IMPL(fastlog::Level::debug, n, __VA_ARGS__)
+#else
+#define FLOG_DEBUG(...) FAST_LOG_DISABLED(__VA_ARGS__)
+#define FLOG_DEBUG_RL(n, ...) FAST_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if FAST_LOG_MIN_LEVEL <= 1
+#define FLOG_INFO(...) FAST_LOG_IMPL(fastlog::Level::info, __VA_ARGS__)
+#define FLOG_INFO_RL(n, ...) FAST_LOG_RL_IMPL(fastlog::Level::info, n, __VA_ARGS__)
+#else
+#define FLOG_INFO(...) FAST_LOG_DISABLED(__VA_ARGS__)
+#define FLOG_INFO_RL(n, ...) FAST_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if FAST_LOG_MIN_LEVEL <= 2
+#define FLOG_WARNING(...) FAST_LOG_IMPL(fastlog::Level::warning, __VA_ARGS__)
+#define FLOG_WARNING_RL(n, ...) FAST_LOG_RL_IMPL(fastlog::Level::warning, n, __VA_ARGS__)
+#else
+#define FLOG_WARNING(...) FAST_LOG_DISABLED(__VA_ARGS__)
+#define FLOG_WARNING_RL(n, ...) FAST_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#define FLOG_ERROR(...) FAST_LOG_IMPL(fastlog::Level::error, __VA_ARGS__)
+#define FLOG_ERROR_RL(n, ...) FAST_LOG_RL_IMPL(fastlog::Level::error, n, __VA_ARGS__)
@@ -0,0 +1,374 @@
+#include "feed_watchdog.h"
+#include <algorithm>
+
+namespace {
+
+constexpr size_t kWheelSlots = 512;
+constexpr uint32_t kMinLearnSamples = 20;          // 学习到足够样本前不做判定
+constexpr int64_t kSessionGapMs = 5LL * 60 * 1000;  // 超过该间隔视为休市，不计入到达间隔
+
+} // namespace
+
+FeedWatchdog::FeedWatchdog(const FeedWatchdogConfig& config)
+    : config_(config)
+    , wheel_(kWheelSlots)
+    , current_tick_(0)
+    , running_(false)
+{
+    config_.tick_ms = std::max(1, config_.tick_ms);
+}
+
+FeedWatchdog::~FeedWatchdog()
+{
+    stop();
+}
+
+void FeedWatchdog::start(ConnectionStaleHandler on_connection_stale, InstrumentsStaleHandler on_instruments_stale)
+{
+    if (running_) {
+        return;
+    }
+
+    on_connection_stale_ = std::move(on_connection_stale);
+    on_instruments_stale_ = std::move(on_instruments_stale);
+    {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        current_tick_ = current_time_ms() / config_.tick_ms;
+    }
+
+    running_ = true;
+    thread_ = std::make_unique<std::thread>(&FeedWatchdog::run, this);
+}
+
+void FeedWatchdog::stop()
+{
+    running_ = false;
+
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+    thread_.reset();
+}
+
+void FeedWatchdog::on_tick(const std::string& connection_id, const std::string& instrument_id, int64_t now_ms)
+{
+    ConnectionFeeds* feeds = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(connections_mutex_);
+        auto it = connections_.find(connection_id);
+        if (it != connections_.end()) {
+            feeds = it->second.get();
+        }
+    }
+    if (!feeds) {
+        feeds = get_or_create_connection(connection_id, now_ms);
+    }
+
+    record_arrival(*feeds->connection, now_ms);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(feeds->mutex);
+        auto it = feeds->instruments.find(instrument_id);
+        if (it != feeds->instruments.end()) {
+            record_arrival(*it->second, now_ms);
+            it->second->instrument->last_tick_ms.store(now_ms, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    std::shared_ptr<FeedState> feed = create_instrument_feed(*feeds, connection_id, instrument_id, now_ms);
+    record_arrival(*feed, now_ms);
+    feed->instrument->last_tick_ms.store(now_ms, std::memory_order_relaxed);
+}
+
+void FeedWatchdog::remove_feed(const std::string& connection_id, const std::string& instrument_id)
+{
+    std::shared_lock<std::shared_mutex> lock(connections_mutex_);
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+
+    // 时间轮中的定时器在到期时发现 active=false 后自行丢弃
+    std::unique_lock<std::shared_mutex> feeds_lock(it->second->mutex);
+    auto feed_it = it->second->instruments.find(instrument_id);
+    if (feed_it != it->second->instruments.end()) {
+        release_instrument_feed(*feed_it->second);
+        it->second->instruments.erase(feed_it);
+    }
+}
+
+void FeedWatchdog::remove_connection(const std::string& connection_id)
+{
+    std::shared_lock<std::shared_mutex> lock(connections_mutex_);
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+
+    // 连接级状态保留（回调线程可能仍持有指针），只清空合约级跟踪
+    std::unique_lock<std::shared_mutex> feeds_lock(it->second->mutex);
+    for (auto& pair : it->second->instruments) {
+        release_instrument_feed(*pair.second);
+    }
+    it->second->instruments.clear();
+}
+
+FeedWatchdog::ConnectionFeeds* FeedWatchdog::get_or_create_connection(const std::string& connection_id, int64_t now_ms)
+{
+    ConnectionFeeds* feeds = nullptr;
+    std::shared_ptr<FeedState> created;
+    {
+        std::unique_lock<std::shared_mutex> lock(connections_mutex_);
+        auto& slot = connections_[connection_id];
+        if (!slot) {
+            slot = std::make_unique<ConnectionFeeds>();
+            slot->connection = std::make_shared<FeedState>();
+            slot->connection->connection_id = connection_id;
+            created = slot->connection;
+        }
+        feeds = slot.get();
+    }
+
+    if (created) {
+        schedule(created, now_ms + config_.min_silence_ms);
+    }
+    return feeds;
+}
+
+std::shared_ptr<FeedState> FeedWatchdog::create_instrument_feed(ConnectionFeeds& feeds,
+                                                                const std::string& connection_id,
+                                                                const std::string& instrument_id,
+                                                                int64_t now_ms)
+{
+    InstrumentTicks* instrument = get_or_create_instrument(instrument_id);
+
+    std::shared_ptr<FeedState> feed;
+    bool created = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(feeds.mutex);
+        auto& slot = feeds.instruments[instrument_id];
+        if (!slot) {
+            slot = std::make_shared<FeedState>();
+            slot->connection_id = connection_id;
+            slot->instrument_id = instrument_id;
+            slot->connection_feed = feeds.connection.get();
+            slot->instrument = instrument;
+            instrument->connections.fetch_add(1, std::memory_order_relaxed);
+            created = true;
+        }
+        feed = slot;
+    }
+
+    if (created) {
+        schedule(feed, now_ms + config_.min_silence_ms);
+    }
+    return feed;
+}
+
+InstrumentTicks* FeedWatchdog::get_or_create_instrument(const std::string& instrument_id)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(instruments_mutex_);
+        auto it = instrument_ticks_.find(instrument_id);
+        if (it != instrument_ticks_.end()) {
+            return it->second.get();
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(instruments_mutex_);
+    auto& slot = instrument_ticks_[instrument_id];
+    if (!slot) {
+        slot = std::make_unique<InstrumentTicks>();
+    }
+    return slot.get();
+}
+
+void FeedWatchdog::release_instrument_feed(FeedState& feed)
+{
+    // 调用方持有所属连接的写锁；时间轮中的定时器在到期时发现 active=false 后自行丢弃
+    if (feed.active.exchange(false, std::memory_order_relaxed)) {
+        feed.instrument->connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void FeedWatchdog::record_arrival(FeedState& feed, int64_t now_ms)
+{
+    // 每路行情只有一个CTP回调线程写入，relaxed 读改写即可
+    const int64_t previous = feed.last_tick_ms.load(std::memory_order_relaxed);
+    if (previous > 0) {
+        const int64_t interval = now_ms - previous;
+        if (interval >= 0 && interval < kSessionGapMs) {
+            const int64_t ewma = feed.interval_ewma_ms.load(std::memory_order_relaxed);
+            feed.interval_ewma_ms.store(ewma < 0 ? interval : ewma + (interval - ewma) / 16,
+                                        std::memory_order_relaxed);
+            feed.samples.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    feed.last_tick_ms.store(now_ms, std::memory_order_relaxed);
+}
+
+int64_t FeedWatchdog::silence_threshold_ms(const FeedState& feed) const
+{
+    if (feed.samples.load(std::memory_order_relaxed) < kMinLearnSamples) {
+        return -1;
+    }
+
+    const int64_t ewma = feed.interval_ewma_ms.load(std::memory_order_relaxed);
+    const int64_t threshold = static_cast<int64_t>(std::max<int64_t>(ewma, 1) * config_.silence_multiplier);
+    return std::min<int64_t>(std::max<int64_t>(threshold, config_.min_silence_ms), config_.max_silence_ms);
+}
+
+bool FeedWatchdog::ticked_elsewhere(const FeedState& feed, int64_t after_ms, int64_t now_ms, int64_t window_ms)
+{
+    const int64_t instrument_last = feed.instrument->last_tick_ms.load(std::memory_order_relaxed);
+    return instrument_last > after_ms && now_ms - instrument_last < window_ms;
+}
+
+bool FeedWatchdog::connection_peers_alive(const FeedState& connection, int64_t window_ms, int64_t now_ms) const
+{
+    // 其它连接仍有行情不能说明本连接断流（各连接的品种交易时段不同）：
+    // 只看本连接上同时被其它连接跟踪的合约，其中至少一半在本连接最后一笔之后仍在其它连接上到达才判定
+    std::shared_lock<std::shared_mutex> lock(connections_mutex_);
+    auto it = connections_.find(connection.connection_id);
+    if (it == connections_.end()) {
+        return false;
+    }
+
+    const int64_t last_tick = connection.last_tick_ms.load(std::memory_order_relaxed);
+    size_t covered = 0;
+    size_t evidence = 0;
+    std::shared_lock<std::shared_mutex> feeds_lock(it->second->mutex);
+    for (const auto& pair : it->second->instruments) {
+        const FeedState& feed = *pair.second;
+        if (feed.instrument->connections.load(std::memory_order_relaxed) < 2) {
+            continue;  // 只有本连接跟踪，没有可比的证据
+        }
+        ++covered;
+        const int64_t threshold = silence_threshold_ms(feed);
+        if (ticked_elsewhere(feed, last_tick, now_ms, threshold > 0 ? threshold : window_ms)) {
+            ++evidence;
+        }
+    }
+    return evidence > 0 && evidence * 2 >= covered;
+}
+
+bool FeedWatchdog::instrument_peers_alive(const FeedState& feed, int64_t now_ms) const
+{
+    // 本连接整体也静默时交由连接级检测处理
+    const FeedState& connection = *feed.connection_feed;
+    const int64_t connection_threshold = silence_threshold_ms(connection);
+    const int64_t connection_window = connection_threshold > 0 ? connection_threshold : config_.min_silence_ms;
+    if (now_ms - connection.last_tick_ms.load(std::memory_order_relaxed) >= connection_window) {
+        return false;
+    }
+
+    // 同一合约在其它连接或备用连接上于本连接最后一笔之后仍有行情，说明是本连接漏推而非合约无成交；
+    // 只有本连接订阅该合约时没有可比的证据，不判定
+    return ticked_elsewhere(feed, feed.last_tick_ms.load(std::memory_order_relaxed), now_ms,
+                            silence_threshold_ms(feed));
+}
+
+void FeedWatchdog::schedule(const std::shared_ptr<FeedState>& feed, int64_t deadline_ms)
+{
+    std::lock_guard<std::mutex> lock(wheel_mutex_);
+    const int64_t tick = std::max((deadline_ms + config_.tick_ms - 1) / config_.tick_ms, current_tick_ + 1);
+    wheel_[tick % kWheelSlots].push_back(Timer{tick, feed});
+}
+
+void FeedWatchdog::run()
+{
+    std::vector<std::shared_ptr<FeedState>> expired;
+    std::vector<std::string> stale_connections;
+    std::unordered_map<std::string, std::vector<std::string>> stale_instruments;
+
+    while (running_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(config_.tick_ms));
+
+        const int64_t now_ms = current_time_ms();
+        expired.clear();
+        collect_expired(expired, now_ms);
+
+        stale_connections.clear();
+        stale_instruments.clear();
+
+        // 到期只代表"可能断流"：行情在此期间到达过则按最新到达时间重新排期（惰性重排，回调线程不碰时间轮）
+        for (const auto& feed : expired) {
+            if (!feed->active.load(std::memory_order_relaxed)) {
+                continue;
+            }
+
+            const int64_t last_tick = feed->last_tick_ms.load(std::memory_order_relaxed);
+            if (feed->stale_reported && last_tick != feed->reported_tick_ms) {
+                feed->stale_reported = false;   // 行情已恢复
+            }
+
+            const int64_t threshold = silence_threshold_ms(*feed);
+            if (threshold < 0) {
+                schedule(feed, now_ms + config_.min_silence_ms);
+                continue;
+            }
+
+            const int64_t deadline = last_tick + threshold;
+            if (now_ms < deadline) {
+                schedule(feed, deadline);
+                continue;
+            }
+
+            if (!feed->stale_reported) {
+                const bool is_connection = feed->instrument_id.empty();
+                const bool peers_alive = is_connection
+                    ? connection_peers_alive(*feed, threshold, now_ms)
+                    : instrument_peers_alive(*feed, now_ms);
+                if (peers_alive) {
+                    feed->stale_reported = true;
+                    feed->reported_tick_ms = last_tick;
+                    if (is_connection) {
+                        stale_connections.push_back(feed->connection_id);
+                    } else {
+                        stale_instruments[feed->connection_id].push_back(feed->instrument_id);
+                    }
+                }
+            }
+            schedule(feed, now_ms + threshold);
+        }
+
+        // 回调在时间轮锁外执行
+        for (const auto& connection_id : stale_connections) {
+            if (on_connection_stale_) {
+                on_connection_stale_(connection_id);
+            }
+        }
+        for (const auto& pair : stale_instruments) {
+            if (on_instruments_stale_) {
+                on_instruments_stale_(pair.first, pair.second);
+            }
+        }
+    }
+}
+
+void FeedWatchdog::collect_expired(std::vector<std::shared_ptr<FeedState>>& expired, int64_t now_ms)
+{
+    std::lock_guard<std::mutex> lock(wheel_mutex_);
+    const int64_t target_tick = now_ms / config_.tick_ms;
+
+    while (current_tick_ < target_tick) {
+        ++current_tick_;
+        auto& slot = wheel_[current_tick_ % kWheelSlots];
+        for (size_t i = 0; i < slot.size(); ) {
+            if (slot[i].tick <= current_tick_) {
+                expired.push_back(std::move(slot[i].feed));
+                slot[i] = std::move(slot.back());
+                slot.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+int64_t FeedWatchdog::current_time_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 行情断流检测参数
+struct FeedWatchdogConfig {
+    double silence_multiplier = 10.0;   // 静默超过 平均到达间隔 × 倍数 判定为断流
+    int min_silence_ms = 2000;          // 判定阈值下限
+    int max_silence_ms = 120000;        // 判定阈值上限
+    int tick_ms = 50;                   // 时间轮精度
+};
+
+// 同一合约在所有连接（含备用连接）上的到达状态
+struct InstrumentTicks {
+    std::atomic<int64_t> last_tick_ms{0};   // 任意连接上的最近到达时间
+    std::atomic<int> connections{0};        // 跟踪该合约的连接数，不少于2时才有跨连接的证据
+};
+
+// 单路行情（连接级或连接上的单个合约）的到达状态
+// 回调线程只写 last_tick_ms / interval_ewma_ms / samples，其余字段仅检测线程访问
+struct FeedState {
+    std::string connection_id;
+    std::string instrument_id;                   // 为空表示连接级
+    const FeedState* connection_feed = nullptr;  // 所属连接的连接级状态（合约级有效）
+    InstrumentTicks* instrument = nullptr;       // 同一合约的跨连接状态（合约级有效）
+    std::atomic<int64_t> last_tick_ms{0};
+    std::atomic<int64_t> interval_ewma_ms{-1};   // 交易时段内到达间隔的EWMA
+    std::atomic<uint32_t> samples{0};
+    std::atomic<bool> active{true};
+    bool stale_reported = false;
+    int64_t reported_tick_ms = 0;                // 上报断流时的 last_tick_ms
+};
+
+// 行情断流检测
+// 跟踪每个连接以及连接上每个合约的最近到达时间，从交易时段内的正常到达间隔学习静默阈值，
+// 用时间轮在毫秒级发现"已登录但不再推送行情"的连接或合约。
+// 为避免把休市、无成交误判为断流，只有存在同一合约的证据时才上报（同品种其它月份、其它连接上
+// 其它品种的行情都不算：各连接的品种交易时段不同，远月、期权可能长时间无成交）：
+//   - 合约级：本连接仍在收到其它行情，且同一合约在其它连接上于本连接最后一笔之后仍有行情
+//   - 连接级：本连接上也被其它连接跟踪的合约中，至少一半在其它连接上于本连接最后一笔之后仍有行情
+class FeedWatchdog {
+public:
+    using ConnectionStaleHandler = std::function<void(const std::string& connection_id)>;
+    using InstrumentsStaleHandler = std::function<void(const std::string& connection_id,
+                                                       const std::vector<std::string>& instruments)>;
+
+    explicit FeedWatchdog(const FeedWatchdogConfig& config);
+    ~FeedWatchdog();
+
+    void start(ConnectionStaleHandler on_connection_stale, InstrumentsStaleHandler on_instruments_stale);
+    void stop();
+
+    // 行情到达（CTP回调线程调用，首次到达时自动登记；now_ms 为本地接收的墙钟毫秒）
+    void on_tick(const std::string& connection_id, const std::string& instrument_id, int64_t now_ms);
+
+    // 合约离开连接（退订、迁移）或连接失效时移除跟踪
+    void remove_feed(const std::string& connection_id, const std::string& instrument_id);
+    void remove_connection(const std::string& connection_id);
+
+private:
+    struct ConnectionFeeds {
+        std::shared_ptr<FeedState> connection;
+        std::unordered_map<std::string, std::shared_ptr<FeedState>> instruments;
+        mutable std::shared_mutex mutex;
+    };
+
+    struct Timer {
+        int64_t tick;
+        std::shared_ptr<FeedState> feed;
+    };
+
+    ConnectionFeeds* get_or_create_connection(const std::string& connection_id, int64_t now_ms);
+    std::shared_ptr<FeedState> create_instrument_feed(ConnectionFeeds& feeds,
+                                                      const std::string& connection_id,
+                                                      const std::string& instrument_id,
+                                                      int64_t now_ms);
+    InstrumentTicks* get_or_create_instrument(const std::string& instrument_id);
+    static void release_instrument_feed(FeedState& feed);
+    void record_arrival(FeedState& feed, int64_t now_ms);
+
+    int64_t silence_threshold_ms(const FeedState& feed) const;
+    // 同一合约在其它连接上于 after_ms 之后、window_ms 之内有过行情
+    static bool ticked_elsewhere(const FeedState& feed, int64_t after_ms, int64_t now_ms, int64_t window_ms);
+    bool connection_peers_alive(const FeedState& connection, int64_t window_ms, int64_t now_ms) const;
+    bool instrument_peers_alive(const FeedState& feed, int64_t now_ms) const;
+
+    // 时间轮
+    void schedule(const std::shared_ptr<FeedState>& feed, int64_t deadline_ms);
+    void run();
+    void collect_expired(std::vector<std::shared_ptr<FeedState>>& expired, int64_t now_ms);
+
+    static int64_t current_time_ms();
+
+    FeedWatchdogConfig config_;
+
+    std::unordered_map<std::string, std::unique_ptr<ConnectionFeeds>> connections_;
+    mutable std::shared_mutex connections_mutex_;
+
+    std::unordered_map<std::string, std::unique_ptr<InstrumentTicks>> instrument_ticks_;
+    mutable std::shared_mutex instruments_mutex_;
+
+    std::vector<std::vector<Timer>> wheel_;
+    int64_t current_tick_;
+    std::mutex wheel_mutex_;
+
+    ConnectionStaleHandler on_connection_stale_;
+    InstrumentsStaleHandler on_instruments_stale_;
+
+    std::unique_ptr<std::thread> thread_;
+    std::atomic<bool> running_;
+};
@@ -0,0 +1,394 @@
+#include "field_diff.h"
+#include "market_data_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIELD_DIFF_X86 1
+#endif
+
+namespace {
+
+using ComputeFn = uint64_t (*)(const MarketDataStruct&, const MarketDataStruct&);
+
+constexpr uint64_t kLevelBits = (1ULL << 10) - 1;
+
+// 盘口数组和字符串字段由向量实现比较，其余字段按字段描述表逐个比较（各实现共用，无分支）
+struct NotVectorized {
+    static constexpr bool select(const md_schema::Field& field)
+    {
+        return field.type != md_schema::FieldType::STRING &&
+               (field.bit < FIELD_ASK_PRICE || field.bit >= FIELD_BID_VOLUME + 10);
+    }
+};
+
+inline uint64_t scalar_fields_mask(const MarketDataStruct& o, const MarketDataStruct& n)
+{
+    return md_schema::change_mask<NotVectorized>(o, n, md_schema::FieldIndices{});
+}
+
+// 逐字段比较（也是非x86平台的唯一实现）
+uint64_t compute_scalar(const MarketDataStruct& o, const MarketDataStruct& n)
+{
+    return md_schema::change_mask<md_schema::AllFields>(o, n, md_schema::FieldIndices{});
+}
+
+#ifdef FIELD_DIFF_X86
+
+// 字符串字段按整个32字节缓冲区比较：build_market_data_struct 先清零再写入，结尾填充一致，结果与strcmp相同
+
+// SSE2：_mm_cmpneq_pd 与标量 != 一样把NaN视为变化
+inline uint64_t sse2_double10(const double* a, const double* b)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 10; i += 2) {
+        __m128d ne = _mm_cmpneq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        bits |= static_cast<uint64_t>(_mm_movemask_pd(ne)) << i;
+    }
+    return bits;
+}
+
+inline uint64_t sse2_int10(const int* a, const int* b)
+{
+    const __m128i* va = reinterpret_cast<const __m128i*>(a);
+    const __m128i* vb = reinterpret_cast<const __m128i*>(b);
+    __m128i eq0 = _mm_cmpeq_epi32(_mm_loadu_si128(va), _mm_loadu_si128(vb));
+    __m128i eq1 = _mm_cmpeq_epi32(_mm_loadu_si128(va + 1), _mm_loadu_si128(vb + 1));
+    __m128i eq2 = _mm_cmpeq_epi32(_mm_loadl_epi64(va + 2), _mm_loadl_epi64(vb + 2));  // 第9、10档
+
+    uint64_t equal = static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(eq0)))
+                   | static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(eq1))) << 4
+                   | static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(eq2))) << 8;
+    return ~equal & kLevelBits;
+}
+
+inline bool sse2_bytes32_differ(const char* a, const char* b)
+{
+    const __m128i* va = reinterpret_cast<const __m128i*>(a);
+    const __m128i* vb = reinterpret_cast<const __m128i*>(b);
+    __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(va), _mm_loadu_si128(vb)),
+                               _mm_cmpeq_epi8(_mm_loadu_si128(va + 1), _mm_loadu_si128(vb + 1)));
+    return _mm_movemask_epi8(eq) != 0xFFFF;
+}
+
+uint64_t compute_sse2(const MarketDataStruct& o, const MarketDataStruct& n)
+{
+    uint64_t mask = scalar_fields_mask(o, n);
+    mask |= static_cast<uint64_t>(sse2_bytes32_differ(o.instrument_id, n.instrument_id)) << FIELD_INSTRUMENT_ID;
+    mask |= static_cast<uint64_t>(sse2_bytes32_differ(o.datetime, n.datetime)) << FIELD_DATETIME;
+    mask |= sse2_double10(o.ask_price, n.ask_price) << FIELD_ASK_PRICE;
+    mask |= sse2_int10(o.ask_volume, n.ask_volume) << FIELD_ASK_VOLUME;
+    mask |= sse2_double10(o.bid_price, n.bid_price) << FIELD_BID_PRICE;
+    mask |= sse2_int10(o.bid_volume, n.bid_volume) << FIELD_BID_VOLUME;
+    return mask;
+}
+
+// AVX2：10档价格 = 4+4+2，10档数量 = 8+2
+__attribute__((target("avx2")))
+inline uint64_t avx2_double10(const double* a, const double* b)
+{
+    __m256d ne0 = _mm256_cmp_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b), _CMP_NEQ_UQ);
+    __m256d ne1 = _mm256_cmp_pd(_mm256_loadu_pd(a + 4), _mm256_loadu_pd(b + 4), _CMP_NEQ_UQ);
+    __m128d ne2 = _mm_cmp_pd(_mm_loadu_pd(a + 8), _mm_loadu_pd(b + 8), _CMP_NEQ_UQ);
+
+    return static_cast<uint64_t>(_mm256_movemask_pd(ne0))
+         | static_cast<uint64_t>(_mm256_movemask_pd(ne1)) << 4
+         | static_cast<uint64_t>(_mm_movemask_pd(ne2)) << 8;
+}
+
+__attribute__((target("avx2")))
+inline uint64_t avx2_int10(const int* a, const int* b)
+{
+    __m256i eq0 = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    __m128i eq1 = _mm_cmpeq_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + 8)),
+                                  _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + 8)));
+
+    uint64_t equal = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq0)))
+                   | static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(eq1))) << 8;
+    return ~equal & kLevelBits;
+}
+
+__attribute__((target("avx2")))
+inline bool avx2_bytes32_differ(const char* a, const char* b)
+{
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                   _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    return _mm256_movemask_epi8(eq) != -1;
+}
+
+__attribute__((target("avx2")))
+uint64_t compute_avx2(const MarketDataStruct& o, const MarketDataStruct& n)
+{
+    uint64_t mask = scalar_fields_mask(o, n);
+    mask |= static_cast<uint64_t>(avx2_bytes32_differ(o.instrument_id, n.instrument_id)) << FIELD_INSTRUMENT_ID;
+    mask |= static_cast<uint64_t>(avx2_bytes32_differ(o.datetime, n.datetime)) << FIELD_DATETIME;
+    mask |= avx2_double10(o.ask_price, n.ask_price) << FIELD_ASK_PRICE;
+    mask |= avx2_int10(o.ask_volume, n.ask_volume) << FIELD_ASK_VOLUME;
+    mask |= avx2_double10(o.bid_price, n.bid_price) << FIELD_BID_PRICE;
+    mask |= avx2_int10(o.bid_volume, n.bid_volume) << FIELD_BID_VOLUME;
+    return mask;
+}
+
+#endif  // FIELD_DIFF_X86
+
+ComputeFn kernel_fn(FieldDiff::Kernel kernel)
+{
+#ifdef FIELD_DIFF_X86
+    switch (kernel) {
+        case FieldDiff::Kernel::AVX2: return compute_avx2;
+        case FieldDiff::Kernel::SSE2: return compute_sse2;
+        default: break;
+    }
+#else
+    (void)kernel;
+#endif
+    return compute_scalar;
+}
+
+FieldDiff::Kernel select_kernel()
+{
+    if (FieldDiff::is_supported(FieldDiff::Kernel::AVX2)) {
+        return FieldDiff::Kernel::AVX2;
+    }
+    if (FieldDiff::is_supported(FieldDiff::Kernel::SSE2)) {
+        return FieldDiff::Kernel::SSE2;
+    }
+    return FieldDiff::Kernel::SCALAR;
+}
+
+// 静态初始化时选定，行情回调开始前已就绪
+const FieldDiff::Kernel g_active_kernel = select_kernel();
+const ComputeFn g_compute = kernel_fn(g_active_kernel);
+
+// ---- 基准测试用的模拟行情 ----
+
+void format_datetime(char* out, size_t size, uint64_t ms_of_day)
+{
+    const uint64_t seconds = ms_of_day / 1000;
+    snprintf(out, size, "2024-01-15 %02u:%02u:%02u.%03u",
+             static_cast<unsigned>(seconds / 3600), static_cast<unsigned>(seconds / 60 % 60),
+             static_cast<unsigned>(seconds % 60), static_cast<unsigned>(ms_of_day % 1000));
+}
+
+// 螺纹钢主力合约风格的逐笔快照：每500ms一笔，成交量/成交额几乎每笔变化，
+// 一档量经常变化、其余档位偶尔变化，最新价约半数变化，偶尔整个盘口平移一个价位
+std::vector<MarketDataStruct> make_tick_sequence(size_t count)
+{
+    std::mt19937 rng(20240115);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int> small_volume(1, 50);
+    std::uniform_int_distribution<int> level_volume(1, 800);
+    std::uniform_int_distribution<int> oi_delta(-30, 30);
+
+    MarketDataStruct tick;
+    memset(&tick, 0, sizeof(tick));
+    strncpy(tick.instrument_id, "SHFE.rb2501", sizeof(tick.instrument_id) - 1);
+    uint64_t ms_of_day = 9 * 3600 * 1000;
+    format_datetime(tick.datetime, sizeof(tick.datetime), ms_of_day);
+    tick.timestamp = 1705280400000ULL;
+    for (int i = 0; i < 5; ++i) {
+        tick.ask_price[i] = 3851.0 + i;
+        tick.bid_price[i] = 3850.0 - i;
+        tick.ask_volume[i] = level_volume(rng);
+        tick.bid_volume[i] = level_volume(rng);
+    }
+    tick.last_price = 3850.0;
+    tick.highest = 3862.0;
+    tick.lowest = 3841.0;
+    tick.open = 3845.0;
+    tick.close = 1.7976931348623157e308;
+    tick.settlement = 1.7976931348623157e308;
+    tick.upper_limit = 4120.0;
+    tick.lower_limit = 3580.0;
+    tick.pre_settlement = 3850.0;
+    tick.pre_close = 3848.0;
+    tick.volume = 120000;
+    tick.amount = 120000 * 3850.0 * 10;
+    tick.open_interest = 1800000;
+    tick.pre_open_interest = 1790000;
+
+    std::vector<MarketDataStruct> ticks;
+    ticks.reserve(count);
+    ticks.push_back(tick);
+    while (ticks.size() < count) {
+        ms_of_day += 500;
+        format_datetime(tick.datetime, sizeof(tick.datetime), ms_of_day);
+        tick.timestamp += 500;
+
+        if (chance(rng) < 0.1) {
+            const double shift = chance(rng) < 0.5 ? 1.0 : -1.0;
+            for (int i = 0; i < 5; ++i) {
+                tick.ask_price[i] += shift;
+                tick.bid_price[i] += shift;
+                tick.ask_volume[i] = level_volume(rng);
+                tick.bid_volume[i] = level_volume(rng);
+            }
+        } else {
+            for (int i = 0; i < 5; ++i) {
+                const double p = i == 0 ? 0.7 : 0.25;
+                if (chance(rng) < p) tick.ask_volume[i] = level_volume(rng);
+                if (chance(rng) < p) tick.bid_volume[i] = level_volume(rng);
+            }
+        }
+
+        if (chance(rng) < 0.5) {
+            tick.last_price = chance(rng) < 0.5 ? tick.bid_price[0] : tick.ask_price[0];
+            tick.highest = std::max(tick.highest, tick.last_price);
+            tick.lowest = std::min(tick.lowest, tick.last_price);
+        }
+        if (chance(rng) < 0.9) {
+            const int traded = small_volume(rng);
+            tick.volume += traded;
+            tick.amount += traded * tick.last_price * 10;
+        }
+        if (chance(rng) < 0.6) {
+            tick.open_interest += oi_delta(rng);
+        }
+        ticks.push_back(tick);
+    }
+    return ticks;
+}
+
+template<typename Fn>
+double measure_ns_per_op(size_t iterations, Fn&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+}  // namespace
+
+uint64_t FieldDiff::compute(const MarketDataStruct& old_data, const MarketDataStruct& new_data)
+{
+    return g_compute(old_data, new_data);
+}
+
+uint64_t FieldDiff::compute(Kernel kernel, const MarketDataStruct& old_data, const MarketDataStruct& new_data)
+{
+    return kernel_fn(kernel)(old_data, new_data);
+}
+
+std::vector<MarketDataStruct> FieldDiff::simulated_ticks(size_t count)
+{
+    return make_tick_sequence(count);
+}
+
+FieldDiff::Kernel FieldDiff::active_kernel()
+{
+    return g_active_kernel;
+}
+
+bool FieldDiff::is_supported(Kernel kernel)
+{
+    switch (kernel) {
+        case Kernel::SCALAR:
+            return true;
+#ifdef FIELD_DIFF_X86
+        case Kernel::SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case Kernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* FieldDiff::kernel_name(Kernel kernel)
+{
+    switch (kernel) {
+        case Kernel::SCALAR: return "scalar";
+        case Kernel::SSE2: return "sse2";
+        case Kernel::AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+bool FieldDiff::run_benchmark(size_t iterations, std::ostream& out)
+{
+    constexpr size_t kTickCount = 4096;  // 2的幂，循环内按位与取下标
+    const std::vector<MarketDataStruct> ticks = make_tick_sequence(kTickCount + 1);
+    const Kernel kernels[] = { Kernel::SCALAR, Kernel::SSE2, Kernel::AVX2 };
+
+    // 以逐字段比较为基准校验各实现
+    std::vector<uint64_t> masks(kTickCount);
+    uint64_t changed_fields = 0;
+    for (size_t i = 0; i < kTickCount; ++i) {
+        masks[i] = compute(Kernel::SCALAR, ticks[i], ticks[i + 1]);
+        changed_fields += static_cast<uint64_t>(__builtin_popcountll(masks[i]));
+    }
+
+    bool all_match = true;
+    for (Kernel kernel : kernels) {
+        if (!is_supported(kernel)) {
+            continue;
+        }
+        for (size_t i = 0; i < kTickCount; ++i) {
+            uint64_t mask = compute(kernel, ticks[i], ticks[i + 1]);
+            if (mask != masks[i]) {
+                char line[160];
+                snprintf(line, sizeof(line), "MISMATCH: %s kernel at tick %zu: 0x%016llx, expected 0x%016llx\n",
+                         kernel_name(kernel), i, static_cast<unsigned long long>(mask),
+                         static_cast<unsigned long long>(masks[i]));
+                out << line;
+                all_match = false;
+                break;
+            }
+        }
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "Field diff benchmark: %zu iterations over %zu tick deltas, %.1f changed fields/tick\n",
+             iterations, kTickCount, static_cast<double>(changed_fields) / kTickCount);
+    out << line;
+
+    volatile uint64_t sink = 0;
+    for (Kernel kernel : kernels) {
+        if (!is_supported(kernel)) {
+            snprintf(line, sizeof(line), "  %-8s  not supported on this CPU\n", kernel_name(kernel));
+            out << line;
+            continue;
+        }
+        const ComputeFn fn = kernel_fn(kernel);
+        uint64_t acc = 0;
+        double ns = measure_ns_per_op(iterations, [&](size_t i) {
+            const size_t k = i & (kTickCount - 1);
+            acc ^= fn(ticks[k], ticks[k + 1]);
+        });
+        sink = sink ^ acc;
+        snprintf(line, sizeof(line), "  %-8s  %7.2f ns/op%s\n", kernel_name(kernel), ns,
+                 kernel == active_kernel() ? "  (active)" : "");
+        out << line;
+    }
+
+    // 增量序列化：只遍历掩码中的置位
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    size_t bytes = 0;
+    double serialize_ns = measure_ns_per_op(iterations, [&](size_t i) {
+        const size_t k = i & (kTickCount - 1);
+        buffer.Clear();
+        writer.Reset(buffer);
+        MarketDataServer::write_changed_fields(ticks[k + 1], masks[k], writer);
+        bytes += buffer.GetSize();
+    });
+    sink = sink ^ bytes;
+    snprintf(line, sizeof(line), "  %-8s  %7.2f ns/op, %.1f bytes/tick\n", "serialize", serialize_ns,
+             static_cast<double>(bytes) / static_cast<double>(iterations));
+    out << line;
+
+    out << (all_match ? "All kernels agree on every tick delta\n" : "Kernel results differ, see mismatches above\n");
+    return all_match;
+}
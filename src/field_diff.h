@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+struct MarketDataStruct;
+
+// MarketDataStruct 字段级比较内核，返回 MarketDataField 位的变化掩码
+// 盘口数组和字符串字段按向量比较（AVX2 一次4个double/8个int，SSE2 一次2个double/4个int），
+// 由比较结果的符号位直接拼出掩码，不需要逐字段分支；进程启动时按CPU能力选定一次实现。
+class FieldDiff {
+public:
+    enum class Kernel {
+        SCALAR = 0,
+        SSE2 = 1,
+        AVX2 = 2
+    };
+
+    // 使用启动时选定的实现
+    static uint64_t compute(const MarketDataStruct& old_data, const MarketDataStruct& new_data);
+    // 使用指定实现（基准测试和结果校验）
+    static uint64_t compute(Kernel kernel, const MarketDataStruct& old_data, const MarketDataStruct& new_data);
+
+    static Kernel active_kernel();
+    static bool is_supported(Kernel kernel);
+    static const char* kernel_name(Kernel kernel);
+
+    // 在模拟的逐笔行情序列上校验各实现结果一致，并输出每次比较和增量序列化的耗时
+    // 任一实现结果不一致时返回false
+    static bool run_benchmark(size_t iterations, std::ostream& out);
+
+    // 基准测试用的模拟逐笔行情序列（螺纹钢主力合约风格，固定随机种子）
+    static std::vector<MarketDataStruct> simulated_ticks(size_t count);
+};
@@ -0,0 +1,113 @@
+#include "frame_buffer.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+struct FrameBufferPoolState {
+    std::mutex mutex;
+    std::vector<FrameBuffer*> free_buffers;
+    bool alive = true;  // 所属线程退出后不再接收归还的缓冲
+};
+
+namespace {
+
+std::atomic<uint64_t> g_allocated{0};
+std::atomic<uint64_t> g_reused{0};
+
+// 线程退出时释放空闲缓冲；仍在使用中的缓冲通过 owner_ 持有池状态，归还时直接删除
+struct ThreadPool {
+    std::shared_ptr<FrameBufferPoolState> state = std::make_shared<FrameBufferPoolState>();
+
+    ~ThreadPool()
+    {
+        std::vector<FrameBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->alive = false;
+            buffers.swap(state->free_buffers);
+        }
+        for (FrameBuffer* buffer : buffers) {
+            delete buffer;
+        }
+    }
+};
+
+thread_local ThreadPool t_pool;
+
+}  // namespace
+
+FrameBuffer::FrameBuffer(std::shared_ptr<FrameBufferPoolState> owner)
+    : owner_(std::move(owner))
+{
+}
+
+void intrusive_ptr_add_ref(FrameBuffer* buffer)
+{
+    buffer->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void intrusive_ptr_release(FrameBuffer* buffer)
+{
+    if (buffer->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        FrameBufferPool::recycle(buffer);
+    }
+}
+
+FrameBufferPtr FrameBufferPool::acquire(size_t reserve)
+{
+    FrameBufferPoolState& state = *t_pool.state;
+    FrameBuffer* buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.free_buffers.empty()) {
+            buffer = state.free_buffers.back();
+            state.free_buffers.pop_back();
+        }
+    }
+
+    if (buffer) {
+        g_reused.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        buffer = new FrameBuffer(t_pool.state);
+        g_allocated.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (reserve > 0) {
+        buffer->data_.Reserve(reserve);
+    }
+    return FrameBufferPtr(buffer);
+}
+
+FrameBufferPtr FrameBufferPool::copy_of(const std::string& message)
+{
+    FrameBufferPtr buffer = acquire(message.size());
+    rapidjson::StringBuffer& data = buffer->data();
+    memcpy(data.Push(message.size()), message.data(), message.size());
+    buffer->seal();
+    return buffer;
+}
+
+void FrameBufferPool::recycle(FrameBuffer* buffer)
+{
+    FrameBufferPoolState& state = *buffer->owner_;
+    if (buffer->data_.GetSize() <= kMaxPooledSize) {
+        buffer->data_.Clear();
+        buffer->bytes_ = nullptr;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.alive && state.free_buffers.size() < kMaxPooledBuffers) {
+            state.free_buffers.push_back(buffer);
+            return;
+        }
+    }
+    delete buffer;
+}
+
+uint64_t FrameBufferPool::allocated()
+{
+    return g_allocated.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameBufferPool::reused()
+{
+    return g_reused.load(std::memory_order_relaxed);
+}
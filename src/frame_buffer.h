@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <boost/asio/buffer.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <rapidjson/stringbuffer.h>
+
+struct FrameBufferPoolState;
+
+// 引用计数的输出缓冲：序列化器直接写入，入队、发送、多个session共享都只传引用，不拷贝字节。
+// 最后一个引用释放时归还给创建它的线程的缓冲池，保留已分配的容量供下一帧使用。
+class FrameBuffer {
+public:
+    rapidjson::StringBuffer& data() { return data_; }
+
+    // 写完后、入队或共享给其它session之前调用一次，此后内容只读
+    void seal() { bytes_ = data_.GetString(); }
+    const char* bytes() const { return bytes_; }
+    size_t size() const { return data_.GetSize(); }
+    boost::asio::const_buffer buffer() const { return boost::asio::const_buffer(bytes_, size()); }
+
+private:
+    friend class FrameBufferPool;
+    friend void intrusive_ptr_add_ref(FrameBuffer* buffer);
+    friend void intrusive_ptr_release(FrameBuffer* buffer);
+
+    explicit FrameBuffer(std::shared_ptr<FrameBufferPoolState> owner);
+
+    rapidjson::StringBuffer data_;
+    const char* bytes_ = nullptr;
+    std::atomic<uint32_t> refs_{0};
+    std::shared_ptr<FrameBufferPoolState> owner_;
+};
+
+using FrameBufferPtr = boost::intrusive_ptr<FrameBuffer>;
+
+void intrusive_ptr_add_ref(FrameBuffer* buffer);
+void intrusive_ptr_release(FrameBuffer* buffer);
+
+// 每线程的输出缓冲池。其它线程释放的缓冲放回所属线程的池（池锁只在获取和归还时短暂持有，几乎无竞争）
+class FrameBufferPool {
+public:
+    static constexpr size_t kMaxPooledBuffers = 256;            // 每线程最多缓存的空闲缓冲
+    static constexpr size_t kMaxPooledSize = 4 * 1024 * 1024;   // 超过该大小的帧用完即释放，不长期占用内存
+
+    // 取一个已清空的缓冲，并预留 reserve 字节
+    static FrameBufferPtr acquire(size_t reserve = 0);
+    // 拷贝一段已有的字节（冷路径的响应、错误消息），返回的缓冲已seal
+    static FrameBufferPtr copy_of(const std::string& message);
+
+    static uint64_t allocated();    // 新分配的缓冲数
+    static uint64_t reused();       // 从池中复用的次数
+
+private:
+    friend void intrusive_ptr_release(FrameBuffer* buffer);
+    static void recycle(FrameBuffer* buffer);
+};
+
+// 一条待发送的WebSocket消息：按顺序拼接的若干片段（一次分散-聚集写出），片段可被多个session共享
+using OutboundFrame = boost::container::small_vector<FrameBufferPtr, 4>;
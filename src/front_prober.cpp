@@ -0,0 +1,378 @@
+#include "front_prober.h"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <rapidjson/document.h>
+
+namespace {
+
+// 同时进行的建连探测数上限
+constexpr size_t kMaxConcurrentProbes = 64;
+
+// RTT EWMA 平滑系数
+constexpr double kRttAlpha = 0.3;
+
+// 单个地址的一次探测：解析 -> 建连，整体受超时定时器约束
+struct Probe {
+    explicit Probe(boost::asio::io_context& ioc)
+        : resolver(ioc), socket(ioc), timer(ioc) {}
+
+    std::string address;
+    boost::asio::ip::tcp::resolver resolver;
+    boost::asio::ip::tcp::socket socket;
+    boost::asio::steady_timer timer;
+    std::chrono::steady_clock::time_point connect_start;
+    double rtt_ms = -1.0;
+};
+
+void start_probe(Probe* probe, std::chrono::milliseconds timeout)
+{
+    const auto colon = probe->address.rfind(':');
+    if (colon == std::string::npos) {
+        return;
+    }
+    const std::string host = probe->address.substr(0, colon);
+    const std::string port = probe->address.substr(colon + 1);
+
+    probe->timer.expires_after(timeout);
+    probe->timer.async_wait([probe](const boost::system::error_code& ec) {
+        if (!ec) {
+            boost::system::error_code ignored;
+            probe->resolver.cancel();
+            probe->socket.close(ignored);
+        }
+    });
+
+    probe->resolver.async_resolve(host, port,
+        [probe](const boost::system::error_code& ec,
+                boost::asio::ip::tcp::resolver::results_type results) {
+            if (ec || results.empty()) {
+                probe->timer.cancel();
+                return;
+            }
+            // 只测建连耗时，域名解析不计入RTT
+            probe->connect_start = std::chrono::steady_clock::now();
+            probe->socket.async_connect(results.begin()->endpoint(),
+                [probe](const boost::system::error_code& connect_ec) {
+                    probe->timer.cancel();
+                    if (!connect_ec) {
+                        probe->rtt_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - probe->connect_start).count();
+                    }
+                    boost::system::error_code ignored;
+                    probe->socket.close(ignored);
+                });
+        });
+}
+
+std::string format_ms(double ms)
+{
+    if (ms < 0) {
+        return "-";
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << ms;
+    return out.str();
+}
+
+} // namespace
+
+FrontProber::FrontProber(std::chrono::milliseconds connect_timeout)
+    : connect_timeout_(connect_timeout)
+{
+}
+
+std::string FrontProber::strip_scheme(const std::string& front_addr)
+{
+    const auto pos = front_addr.find("://");
+    return pos == std::string::npos ? front_addr : front_addr.substr(pos + 3);
+}
+
+bool FrontProber::load_broker_data(const std::string& file_path, const std::set<std::string>& broker_ids)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string json_content((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+
+    rapidjson::Document doc;
+    doc.Parse(json_content.c_str());
+    if (doc.HasParseError() || !doc.IsArray()) {
+        return false;
+    }
+
+    std::vector<FrontCandidate> candidates;
+    for (const auto& broker : doc.GetArray()) {
+        if (!broker.IsObject() || !broker.HasMember("brokerid") || !broker["brokerid"].IsString() ||
+            !broker.HasMember("servers") || !broker["servers"].IsArray()) {
+            continue;
+        }
+        const std::string broker_id = broker["brokerid"].GetString();
+        if (!broker_ids.empty() && broker_ids.count(broker_id) == 0) {
+            continue;
+        }
+        const std::string broker_name = broker.HasMember("broker_name") && broker["broker_name"].IsString()
+            ? broker["broker_name"].GetString() : broker_id;
+
+        for (const auto& server : broker["servers"].GetArray()) {
+            if (!server.IsObject() || !server.HasMember("market_data") || !server["market_data"].IsArray()) {
+                continue;
+            }
+            const std::string server_name = server.HasMember("name") && server["name"].IsString()
+                ? server["name"].GetString() : "";
+            for (const auto& address : server["market_data"].GetArray()) {
+                if (!address.IsString()) {
+                    continue;
+                }
+                FrontCandidate candidate;
+                candidate.broker_id = broker_id;
+                candidate.broker_name = broker_name;
+                candidate.server_name = server_name;
+                candidate.address = strip_scheme(address.GetString());
+                candidates.push_back(std::move(candidate));
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 重新加载时保留已有的探测结果
+    for (auto& candidate : candidates) {
+        for (const auto& existing : candidates_) {
+            if (existing.broker_id == candidate.broker_id && existing.address == candidate.address) {
+                candidate = existing;
+                break;
+            }
+        }
+    }
+    candidates_ = std::move(candidates);
+    return true;
+}
+
+void FrontProber::probe_all()
+{
+    std::vector<std::string> addresses;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::set<std::string> unique;
+        for (const auto& candidate : candidates_) {
+            if (unique.insert(candidate.address).second) {
+                addresses.push_back(candidate.address);
+            }
+        }
+    }
+
+    std::map<std::string, double> results;
+    for (size_t begin = 0; begin < addresses.size(); begin += kMaxConcurrentProbes) {
+        const size_t end = std::min(addresses.size(), begin + kMaxConcurrentProbes);
+
+        boost::asio::io_context ioc;
+        std::vector<std::unique_ptr<Probe>> probes;
+        probes.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            probes.push_back(std::make_unique<Probe>(ioc));
+            probes.back()->address = addresses[i];
+            start_probe(probes.back().get(), connect_timeout_);
+        }
+        ioc.run();
+
+        for (const auto& probe : probes) {
+            results[probe->address] = probe->rtt_ms;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& candidate : candidates_) {
+        auto it = results.find(candidate.address);
+        if (it == results.end()) {
+            continue;
+        }
+        ++candidate.probe_count;
+        if (it->second >= 0) {
+            candidate.rtt_ms = candidate.rtt_ms < 0
+                ? it->second
+                : candidate.rtt_ms * (1.0 - kRttAlpha) + it->second * kRttAlpha;
+            candidate.reachable = true;
+            candidate.consecutive_failures = 0;
+        } else {
+            candidate.reachable = false;
+            ++candidate.consecutive_failures;
+        }
+    }
+}
+
+void FrontProber::set_tick_lags(const std::map<std::string, double>& lags)
+{
+    std::map<std::string, double> by_address;
+    for (const auto& pair : lags) {
+        by_address[strip_scheme(pair.first)] = pair.second;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& candidate : candidates_) {
+        auto it = by_address.find(candidate.address);
+        candidate.tick_lag_ms = it == by_address.end() ? -1.0 : it->second;
+    }
+}
+
+std::map<std::string, FrontProber::LagRange> FrontProber::broker_lag_ranges() const
+{
+    std::map<std::string, LagRange> ranges;
+    for (const auto& candidate : candidates_) {
+        if (candidate.tick_lag_ms < 0) {
+            continue;
+        }
+        LagRange& range = ranges[candidate.broker_id];
+        if (range.min < 0 || candidate.tick_lag_ms < range.min) {
+            range.min = candidate.tick_lag_ms;
+        }
+        range.max = std::max(range.max, candidate.tick_lag_ms);
+    }
+    return ranges;
+}
+
+double FrontProber::score(const FrontCandidate& candidate, const LagRange& broker_lags)
+{
+    if (!candidate.reachable || candidate.rtt_ms < 0) {
+        return -1.0;
+    }
+    // 行情延迟包含交易所到前置的传播时间，只有同经纪商前置之间的差值有意义。
+    // 没有样本的前置按最大超出部分计：在用前置的延迟不会让它输给一个未实测的前置
+    double excess_lag = 0.0;
+    if (broker_lags.min >= 0) {
+        excess_lag = (candidate.tick_lag_ms >= 0 ? candidate.tick_lag_ms : broker_lags.max) - broker_lags.min;
+    }
+    return candidate.rtt_ms + excess_lag;
+}
+
+std::vector<FrontCandidate> FrontProber::ranked_locked() const
+{
+    const auto lag_ranges = broker_lag_ranges();
+    auto lags_of = [&lag_ranges](const std::string& broker_id) {
+        auto it = lag_ranges.find(broker_id);
+        return it == lag_ranges.end() ? LagRange() : it->second;
+    };
+
+    std::vector<std::pair<double, size_t>> order;
+    order.reserve(candidates_.size());
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+        double s = score(candidates_[i], lags_of(candidates_[i].broker_id));
+        order.emplace_back(s < 0 ? std::numeric_limits<double>::max() : s, i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [this](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+            const auto& broker_a = candidates_[a.second].broker_id;
+            const auto& broker_b = candidates_[b.second].broker_id;
+            if (broker_a != broker_b) {
+                return broker_a < broker_b;
+            }
+            return a.first < b.first;
+        });
+
+    std::vector<FrontCandidate> result;
+    result.reserve(order.size());
+    for (const auto& entry : order) {
+        result.push_back(candidates_[entry.second]);
+        if (entry.first != std::numeric_limits<double>::max()) {
+            result.back().score = entry.first;
+        }
+    }
+    return result;
+}
+
+std::vector<FrontCandidate> FrontProber::ranked() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ranked_locked();
+}
+
+std::vector<FrontCandidate> FrontProber::ranked_for_broker(const std::string& broker_id) const
+{
+    std::vector<FrontCandidate> result;
+    for (auto& candidate : ranked()) {
+        if (candidate.broker_id == broker_id) {
+            result.push_back(std::move(candidate));
+        }
+    }
+    return result;
+}
+
+double FrontProber::score_of(const std::string& broker_id, const std::string& front_addr) const
+{
+    const std::string address = strip_scheme(front_addr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto lag_ranges = broker_lag_ranges();
+    auto lag_it = lag_ranges.find(broker_id);
+    for (const auto& candidate : candidates_) {
+        if (candidate.broker_id == broker_id && candidate.address == address) {
+            return score(candidate, lag_it == lag_ranges.end() ? LagRange() : lag_it->second);
+        }
+    }
+    return -1.0;
+}
+
+std::vector<CTPConnectionConfig> FrontProber::suggest_connections(size_t fronts_per_broker,
+                                                                  int max_subscriptions) const
+{
+    std::vector<CTPConnectionConfig> connections;
+    std::map<std::string, size_t> taken;
+    for (const auto& candidate : ranked()) {
+        if (!candidate.reachable || taken[candidate.broker_id] >= fronts_per_broker) {
+            continue;
+        }
+        const size_t rank = ++taken[candidate.broker_id];
+
+        CTPConnectionConfig config;
+        config.connection_id = candidate.broker_id + "_" + std::to_string(rank);
+        config.front_addr = candidate.front_addr();
+        config.broker_id = candidate.broker_id;
+        config.max_subscriptions = max_subscriptions;
+        config.priority = static_cast<int>(std::min<size_t>(rank, 10));
+        config.enabled = true;
+        connections.push_back(std::move(config));
+    }
+    return connections;
+}
+
+std::string FrontProber::report() const
+{
+    std::ostringstream out;
+    std::string current_broker;
+    size_t rank = 0;
+    size_t reachable = 0;
+    const auto candidates = ranked();
+    for (const auto& candidate : candidates) {
+        if (candidate.broker_id != current_broker) {
+            current_broker = candidate.broker_id;
+            rank = 0;
+            out << "[" << candidate.broker_id << "] " << candidate.broker_name << "\n";
+        }
+        ++rank;
+        if (candidate.reachable) {
+            ++reachable;
+        }
+        out << "  " << std::setw(3) << rank << ". "
+            << std::left << std::setw(40) << candidate.address << std::right
+            << " score " << std::setw(8) << format_ms(candidate.score) << " ms"
+            << "  rtt " << std::setw(8) << format_ms(candidate.rtt_ms) << " ms"
+            << "  lag " << std::setw(8) << format_ms(candidate.tick_lag_ms) << " ms"
+            << (candidate.reachable ? "" : "  UNREACHABLE")
+            << (candidate.server_name.empty() ? "" : "  (" + candidate.server_name + ")")
+            << "\n";
+    }
+    out << reachable << "/" << candidates.size() << " fronts reachable\n";
+    return out.str();
+}
+
+size_t FrontProber::candidate_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return candidates_.size();
+}
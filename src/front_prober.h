@@ -0,0 +1,77 @@
+#pragma once
+
+#include "multi_ctp_config.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// 候选行情前置（来自 broker_data.json）
+struct FrontCandidate {
+    std::string broker_id;
+    std::string broker_name;
+    std::string server_name;        // 所属线路（如"电信"、"联通"）
+    std::string address;            // host:port
+
+    double rtt_ms = -1.0;           // TCP建连耗时EWMA，-1 表示尚未探测成功
+    double tick_lag_ms = -1.0;      // 在用前置的行情延迟（本地接收时间 - 交易所UpdateTime），-1 表示未知
+    int probe_count = 0;
+    int consecutive_failures = 0;
+    bool reachable = false;         // 最近一次探测是否成功
+    double score = -1.0;            // 排名评分（越小越好），-1 表示不可达
+
+    std::string front_addr() const { return "tcp://" + address; }
+};
+
+// 行情前置探测与排名
+// 并发测量候选前置的 TCP 建连 RTT，并结合已登录连接实测的行情延迟，为每个经纪商的前置排序。
+// 评分 = RTT + 行情延迟相对同经纪商最快在用前置的超出部分。没有延迟样本的前置按同经纪商
+// 最大的超出部分计（不假设未实测的前置更快），在用前置的行情延迟不会让它输给未实测的前置。
+// 不可达的前置排在最后。
+class FrontProber {
+public:
+    explicit FrontProber(std::chrono::milliseconds connect_timeout = std::chrono::milliseconds(1000));
+
+    // 加载 broker_data.json；broker_ids 非空时只保留这些经纪商的前置
+    bool load_broker_data(const std::string& file_path, const std::set<std::string>& broker_ids = {});
+
+    // 并发探测全部候选前置（阻塞至全部完成或超时）
+    void probe_all();
+
+    // 更新在用前置的行情延迟（键为 tcp://host:port 或 host:port），未出现的前置清除延迟
+    void set_tick_lags(const std::map<std::string, double>& lags);
+
+    // 排名结果（按经纪商分组、组内按评分升序，不可达的排在组内最后）
+    std::vector<FrontCandidate> ranked() const;
+    std::vector<FrontCandidate> ranked_for_broker(const std::string& broker_id) const;
+
+    // 前置评分（越小越好），未知或不可达的前置返回 -1
+    double score_of(const std::string& broker_id, const std::string& front_addr) const;
+
+    // 每个经纪商取最快的 fronts_per_broker 个可达前置生成连接配置，priority 按排名递增
+    std::vector<CTPConnectionConfig> suggest_connections(size_t fronts_per_broker,
+                                                         int max_subscriptions) const;
+
+    // 文本报告
+    std::string report() const;
+
+    size_t candidate_count() const;
+
+    static std::string strip_scheme(const std::string& front_addr);
+
+private:
+    std::vector<FrontCandidate> ranked_locked() const;
+    // 同经纪商在用前置的行情延迟范围，没有样本时 min/max 为 -1
+    struct LagRange {
+        double min = -1.0;
+        double max = -1.0;
+    };
+    std::map<std::string, LagRange> broker_lag_ranges() const;
+    static double score(const FrontCandidate& candidate, const LagRange& broker_lags);
+
+    std::chrono::milliseconds connect_timeout_;
+    std::vector<FrontCandidate> candidates_;
+    mutable std::mutex mutex_;
+};
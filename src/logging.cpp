@@ -1,4 +1,5 @@
 #include "logging.h"
+#include "fast_log.h"
 
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
@@ -37,7 +38,7 @@ void do_init_logging(const std::string& log_dir) {
         keywords::file_name = log_dir + "/market_data_%Y%m%d.log",
         keywords::open_mode = std::ios_base::app,
         keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),
-        keywords::auto_flush = true);
+        keywords::auto_flush = false);  // 由 fastlog 后台线程定期刷盘
 
     g_file_sink = boost::make_shared<file_sink_t>(backend);
     g_file_sink->set_formatter(
@@ -55,10 +56,14 @@ void do_init_logging(const std::string& log_dir) {
 void init_logging(const std::string& log_dir) {
     std::call_once(g_init_flag, [log_dir]() {
         do_init_logging(log_dir);
+        fastlog::start_backend();
     });
 }
 
 void shutdown_logging() {
+    // 先排空热路径日志队列，再移除 sink
+    fastlog::stop_backend();
+
     if (g_file_sink) {
         logging::core::get()->remove_sink(g_file_sink);
         g_file_sink->stop();
@@ -67,4 +72,10 @@ void shutdown_logging() {
     }
 }
 
+void flush_logging() {
+    if (g_file_sink) {
+        g_file_sink->flush();
+    }
+}
+
 
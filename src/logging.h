@@ -9,4 +9,7 @@ void init_logging(const std::string& log_dir = "logs");
 // 可选：退出时调用，刷新并移除日志 sink
 void shutdown_logging();
 
+// 将已排队的日志写入文件（由 fastlog 后台线程在空闲时调用）
+void flush_logging();
+
 
@@ -1,10 +1,15 @@
 #include "market_data_server.h"
 #include "multi_ctp_config.h"
+#include "front_prober.h"
+#include "field_diff.h"
+#include "quote_emitter.h"
 #include "logging.h"
 #include <iostream>
 #include <signal.h>
 #include <thread>
 #include <sstream>
+#include <set>
+#include <algorithm>
 
 std::unique_ptr<MarketDataServer> g_server;
 
@@ -13,6 +18,7 @@ void signal_handler(int signal) {
     if (g_server) {
         g_server->stop();
     }
+    shutdown_logging();
     exit(0);
 }
 
@@ -28,6 +34,15 @@ void print_usage() {
     std::cout << "    --config <config_file>    Load multi-CTP configuration from JSON file" << std::endl;
     std::cout << "    --multi-ctp               Use default multi-CTP configuration (SimNow)" << std::endl;
     std::cout << std::endl;
+    std::cout << "  Front probing:" << std::endl;
+    std::cout << "    --probe-fronts <file>     Probe and rank market data fronts from broker_data.json, then exit" << std::endl;
+    std::cout << "    --probe-broker <id>       Only probe this broker (repeatable)" << std::endl;
+    std::cout << "    --probe-top <n>           Fronts per broker in the suggested connections (default: 2)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "  Benchmarks:" << std::endl;
+    std::cout << "    --bench-field-diff <n>    Benchmark the changed-field kernels over n simulated ticks, then exit" << std::endl;
+    std::cout << "    --bench-quote-json <n>    Benchmark the quote JSON emitter against rapidjson::Writer over n frames, then exit" << std::endl;
+    std::cout << std::endl;
     std::cout << "  Common options:" << std::endl;
     std::cout << "    --help                    Show this help message" << std::endl;
     std::cout << "    --status                  Show connection status and exit" << std::endl;
@@ -36,9 +51,47 @@ void print_usage() {
     std::cout << "Multi-CTP mode provides better performance and fault tolerance." << std::endl;
 }
 
+// 探测 broker_data.json 中的行情前置，输出排名报告和建议的 connections 配置
+int run_front_probe(const std::string& broker_data_file, const std::set<std::string>& broker_ids, size_t top)
+{
+    FrontProber prober;
+    if (!prober.load_broker_data(broker_data_file, broker_ids)) {
+        std::cerr << "Failed to load broker data file: " << broker_data_file << std::endl;
+        return 1;
+    }
+    if (prober.candidate_count() == 0) {
+        std::cerr << "No market data fronts found in " << broker_data_file << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Probing " << prober.candidate_count() << " market data fronts..." << std::endl;
+    prober.probe_all();
+    std::cout << prober.report() << std::endl;
+    
+    std::cout << "Suggested connections:" << std::endl;
+    std::cout << "\"connections\": [" << std::endl;
+    const auto connections = prober.suggest_connections(top, 500);
+    for (size_t i = 0; i < connections.size(); ++i) {
+        const auto& conn = connections[i];
+        std::cout << "  {\"connection_id\": \"" << conn.connection_id << "\", "
+                  << "\"front_addr\": \"" << conn.front_addr << "\", "
+                  << "\"broker_id\": \"" << conn.broker_id << "\", "
+                  << "\"max_subscriptions\": " << conn.max_subscriptions << ", "
+                  << "\"priority\": " << conn.priority << ", "
+                  << "\"enabled\": true}"
+                  << (i + 1 < connections.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     init_logging();
+    // 任何返回路径都要排空异步日志队列并刷盘
+    struct LoggingGuard {
+        ~LoggingGuard() { shutdown_logging(); }
+    } logging_guard;
+
     // 单CTP模式参数（兼容性）
     std::string front_addr = "tcp://182.254.243.31:30011";
     std::string broker_id = "9999";
@@ -48,6 +101,15 @@ int main(int argc, char* argv[]) {
     bool use_multi_ctp = false;
     std::string config_file;
     bool show_status = false;
+    
+    // 前置探测参数
+    std::string probe_file;
+    std::set<std::string> probe_brokers;
+    size_t probe_top = 2;
+    
+    // 基准测试参数
+    size_t bench_field_diff_iterations = 0;
+    size_t bench_quote_json_iterations = 0;
 
     // 解析命令行参数
     for (int i = 1; i < argc; i++) {
@@ -69,6 +131,16 @@ int main(int argc, char* argv[]) {
             broker_id = argv[++i];
         } else if (arg == "--port" && i + 1 < argc) {
             port = std::atoi(argv[++i]);
+        } else if (arg == "--probe-fronts" && i + 1 < argc) {
+            probe_file = argv[++i];
+        } else if (arg == "--probe-broker" && i + 1 < argc) {
+            probe_brokers.insert(argv[++i]);
+        } else if (arg == "--probe-top" && i + 1 < argc) {
+            probe_top = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--bench-field-diff" && i + 1 < argc) {
+            bench_field_diff_iterations = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--bench-quote-json" && i + 1 < argc) {
+            bench_quote_json_iterations = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
         } else {
             std::cerr << "Unknown argument: " << arg << std::endl;
             print_usage();
@@ -76,6 +148,17 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (!probe_file.empty()) {
+        return run_front_probe(probe_file, probe_brokers, probe_top);
+    }
+    
+    if (bench_field_diff_iterations > 0) {
+        return FieldDiff::run_benchmark(bench_field_diff_iterations, std::cout) ? 0 : 1;
+    }
+    if (bench_quote_json_iterations > 0) {
+        return QuoteEmitter::run_benchmark(bench_quote_json_iterations, std::cout) ? 0 : 1;
+    }
+
     // 设置信号处理
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -157,8 +240,14 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            // 等待连接建立
-            std::this_thread::sleep_for(std::chrono::seconds(5));
+            // 等待连接建立：多连接模式下等到达到启动法定数（最多10秒）
+            if (g_server->get_connection_manager()) {
+                if (!g_server->get_connection_manager()->wait_until_ready(std::chrono::seconds(10))) {
+                    BOOST_LOG_TRIVIAL(warning) << "Startup quorum not reached within 10 seconds";
+                }
+            } else {
+                std::this_thread::sleep_for(std::chrono::seconds(5));
+            }
             
             BOOST_LOG_TRIVIAL(info) << "Connection Status:";
             BOOST_LOG_TRIVIAL(info) << "  Active connections: " << g_server->get_active_connections_count();
@@ -206,6 +295,5 @@ int main(int argc, char* argv[]) {
     }
 
     BOOST_LOG_TRIVIAL(info) << "Server stopped gracefully.";
-    shutdown_logging();
     return 0;
 }
\ No newline at end of file
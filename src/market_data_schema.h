@@ -0,0 +1,410 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include "../libs/ThostFtdcUserApiStruct.h"
+
+// 结构化行情数据（紧凑存储，用于缓存）
+struct MarketDataStruct {
+    char instrument_id[32];
+    char datetime[32];
+    uint64_t timestamp;
+
+    double ask_price[10];
+    int ask_volume[10];
+    double bid_price[10];
+    int bid_volume[10];
+
+    double last_price;
+    double highest;
+    double lowest;
+    double open;
+    double close;
+    double average;
+    int volume;
+    double amount;
+    int64_t open_interest;
+    double settlement;
+    double upper_limit;
+    double lower_limit;
+    int64_t pre_open_interest;
+    double pre_settlement;
+    double pre_close;
+
+    // Flags to indicate validity of fields (since we need to handle nulls/-)
+    // Using a simple convention:
+    // Prices: > 1e-6 && < 1e300 is valid.
+    // Close/Settlement: checks against 1e300.
+};
+
+// 行情字段在变化掩码中的位（顺序即增量推送时的字段输出顺序）
+enum MarketDataField {
+    FIELD_INSTRUMENT_ID = 0,
+    FIELD_DATETIME = 1,
+    FIELD_TIMESTAMP = 2,
+    FIELD_ASK_PRICE = 3,                        // 3..12 对应 ask_price1..10
+    FIELD_ASK_VOLUME = FIELD_ASK_PRICE + 10,    // 13..22
+    FIELD_BID_PRICE = FIELD_ASK_VOLUME + 10,    // 23..32
+    FIELD_BID_VOLUME = FIELD_BID_PRICE + 10,    // 33..42
+    FIELD_LAST_PRICE = FIELD_BID_VOLUME + 10,
+    FIELD_HIGHEST,
+    FIELD_LOWEST,
+    FIELD_OPEN,
+    FIELD_CLOSE,
+    FIELD_UPPER_LIMIT,
+    FIELD_LOWER_LIMIT,
+    FIELD_PRE_SETTLEMENT,
+    FIELD_PRE_CLOSE,
+    FIELD_SETTLEMENT,
+    FIELD_VOLUME,
+    FIELD_AMOUNT,
+    FIELD_OPEN_INTEREST,
+    FIELD_PRE_OPEN_INTEREST,
+    FIELD_COUNT
+};
+static_assert(FIELD_COUNT <= 64, "changed-field mask must fit in 64 bits");
+
+constexpr uint64_t kAllFieldsMask = ~0ULL;          // 全量（首个版本或掩码历史已覆盖）
+
+// 行情字段描述表：MarketDataStruct 的每个字段在这里登记一次（JSON key、类型、偏移、变化位、
+// 全量推送时的null规则、从CTP行情的取值规则），全量序列化、变化掩码和CTP行情转换都由模板按表展开。
+// 新增字段：MarketDataStruct 加成员、MarketDataField 加位、kFields 加一行。
+namespace md_schema {
+
+enum class FieldType : uint8_t {
+    STRING,
+    UINT64,
+    DOUBLE,
+    INT,
+    INT64
+};
+
+// 从 CThostFtdcDepthMarketDataField 取值的规则
+enum class Source : uint8_t {
+    NONE,           // 不从CTP字段直接取值（合约、时间由 build_market_data_struct 处理，6-10档和average恒为空）
+    PRICE,          // 有效价格（1e-6 < p < 1e300）保留两位小数，否则为0
+    BOOK_VOLUME,    // 同档价格有效时才取量
+    INT_VALUE,      // int 原样
+    DOUBLE_VALUE,   // double 原样
+    INT64_VALUE     // double 转 int64（持仓量）
+};
+
+struct Field {
+    const char* key;
+    uint32_t key_length;
+    FieldType type;
+    uint32_t offset;            // MarketDataStruct 内偏移
+    int bit;                    // MarketDataField 位，-1 表示不参与变化比较
+    bool snapshot_null;         // 全量推送时恒为null（盘口6-10档、average）
+    Source source;
+    uint32_t ctp_offset;        // CThostFtdcDepthMarketDataField 内偏移
+    uint32_t ctp_guard_offset;  // BOOK_VOLUME：同档价格的偏移
+};
+
+constexpr uint32_t key_length(const char* key)
+{
+    uint32_t length = 0;
+    while (key[length] != '\0') {
+        ++length;
+    }
+    return length;
+}
+
+#define MD_OFFSET(member) static_cast<uint32_t>(offsetof(MarketDataStruct, member))
+#define CTP_OFFSET(member) static_cast<uint32_t>(offsetof(CThostFtdcDepthMarketDataField, member))
+
+inline constexpr const char* kAskPriceKeys[] = {
+    "ask_price1", "ask_price2", "ask_price3", "ask_price4", "ask_price5",
+    "ask_price6", "ask_price7", "ask_price8", "ask_price9", "ask_price10"
+};
+inline constexpr const char* kAskVolumeKeys[] = {
+    "ask_volume1", "ask_volume2", "ask_volume3", "ask_volume4", "ask_volume5",
+    "ask_volume6", "ask_volume7", "ask_volume8", "ask_volume9", "ask_volume10"
+};
+inline constexpr const char* kBidPriceKeys[] = {
+    "bid_price1", "bid_price2", "bid_price3", "bid_price4", "bid_price5",
+    "bid_price6", "bid_price7", "bid_price8", "bid_price9", "bid_price10"
+};
+inline constexpr const char* kBidVolumeKeys[] = {
+    "bid_volume1", "bid_volume2", "bid_volume3", "bid_volume4", "bid_volume5",
+    "bid_volume6", "bid_volume7", "bid_volume8", "bid_volume9", "bid_volume10"
+};
+
+// CTP只提供5档
+inline constexpr uint32_t kCtpAskPrice[] = {
+    CTP_OFFSET(AskPrice1), CTP_OFFSET(AskPrice2), CTP_OFFSET(AskPrice3), CTP_OFFSET(AskPrice4), CTP_OFFSET(AskPrice5)
+};
+inline constexpr uint32_t kCtpAskVolume[] = {
+    CTP_OFFSET(AskVolume1), CTP_OFFSET(AskVolume2), CTP_OFFSET(AskVolume3), CTP_OFFSET(AskVolume4), CTP_OFFSET(AskVolume5)
+};
+inline constexpr uint32_t kCtpBidPrice[] = {
+    CTP_OFFSET(BidPrice1), CTP_OFFSET(BidPrice2), CTP_OFFSET(BidPrice3), CTP_OFFSET(BidPrice4), CTP_OFFSET(BidPrice5)
+};
+inline constexpr uint32_t kCtpBidVolume[] = {
+    CTP_OFFSET(BidVolume1), CTP_OFFSET(BidVolume2), CTP_OFFSET(BidVolume3), CTP_OFFSET(BidVolume4), CTP_OFFSET(BidVolume5)
+};
+constexpr int kCtpBookLevels = 5;
+
+constexpr Field field(const char* key, FieldType type, uint32_t offset, int bit,
+                      Source source = Source::NONE, uint32_t ctp_offset = 0)
+{
+    return Field{key, key_length(key), type, offset, bit, false, source, ctp_offset, 0};
+}
+
+constexpr Field price(const char* key, uint32_t offset, int bit, uint32_t ctp_offset)
+{
+    return field(key, FieldType::DOUBLE, offset, bit, Source::PRICE, ctp_offset);
+}
+
+constexpr Field null_field(const char* key, FieldType type, uint32_t offset, int bit)
+{
+    return Field{key, key_length(key), type, offset, bit, true, Source::NONE, 0, 0};
+}
+
+// level 从1开始
+constexpr Field book_price(const char* const* keys, const uint32_t* ctp, uint32_t offset, int first_bit, int level)
+{
+    const int i = level - 1;
+    const uint32_t field_offset = offset + static_cast<uint32_t>(i * sizeof(double));
+    return level <= kCtpBookLevels
+        ? price(keys[i], field_offset, first_bit + i, ctp[i])
+        : null_field(keys[i], FieldType::DOUBLE, field_offset, first_bit + i);
+}
+
+constexpr Field book_volume(const char* const* keys, const uint32_t* ctp, const uint32_t* ctp_price,
+                            uint32_t offset, int first_bit, int level)
+{
+    const int i = level - 1;
+    const uint32_t field_offset = offset + static_cast<uint32_t>(i * sizeof(int));
+    return level <= kCtpBookLevels
+        ? Field{keys[i], key_length(keys[i]), FieldType::INT, field_offset, first_bit + i, false,
+                Source::BOOK_VOLUME, ctp[i], ctp_price[i]}
+        : null_field(keys[i], FieldType::INT, field_offset, first_bit + i);
+}
+
+constexpr Field ask_price(int level) { return book_price(kAskPriceKeys, kCtpAskPrice, MD_OFFSET(ask_price), FIELD_ASK_PRICE, level); }
+constexpr Field ask_volume(int level) { return book_volume(kAskVolumeKeys, kCtpAskVolume, kCtpAskPrice, MD_OFFSET(ask_volume), FIELD_ASK_VOLUME, level); }
+constexpr Field bid_price(int level) { return book_price(kBidPriceKeys, kCtpBidPrice, MD_OFFSET(bid_price), FIELD_BID_PRICE, level); }
+constexpr Field bid_volume(int level) { return book_volume(kBidVolumeKeys, kCtpBidVolume, kCtpBidPrice, MD_OFFSET(bid_volume), FIELD_BID_VOLUME, level); }
+
+// 顺序即全量推送时的字段顺序（与mdservice一致：卖盘10->1，买盘1->10）
+inline constexpr Field kFields[] = {
+    field("instrument_id", FieldType::STRING, MD_OFFSET(instrument_id), FIELD_INSTRUMENT_ID),
+    field("datetime", FieldType::STRING, MD_OFFSET(datetime), FIELD_DATETIME),
+    field("timestamp", FieldType::UINT64, MD_OFFSET(timestamp), FIELD_TIMESTAMP),
+    ask_price(10), ask_volume(10), ask_price(9), ask_volume(9), ask_price(8), ask_volume(8),
+    ask_price(7), ask_volume(7), ask_price(6), ask_volume(6),
+    ask_price(5), ask_volume(5), ask_price(4), ask_volume(4), ask_price(3), ask_volume(3),
+    ask_price(2), ask_volume(2), ask_price(1), ask_volume(1),
+    bid_price(1), bid_volume(1), bid_price(2), bid_volume(2), bid_price(3), bid_volume(3),
+    bid_price(4), bid_volume(4), bid_price(5), bid_volume(5),
+    bid_price(6), bid_volume(6), bid_price(7), bid_volume(7), bid_price(8), bid_volume(8),
+    bid_price(9), bid_volume(9), bid_price(10), bid_volume(10),
+    price("last_price", MD_OFFSET(last_price), FIELD_LAST_PRICE, CTP_OFFSET(LastPrice)),
+    price("highest", MD_OFFSET(highest), FIELD_HIGHEST, CTP_OFFSET(HighestPrice)),
+    price("lowest", MD_OFFSET(lowest), FIELD_LOWEST, CTP_OFFSET(LowestPrice)),
+    price("open", MD_OFFSET(open), FIELD_OPEN, CTP_OFFSET(OpenPrice)),
+    price("close", MD_OFFSET(close), FIELD_CLOSE, CTP_OFFSET(ClosePrice)),
+    null_field("average", FieldType::DOUBLE, MD_OFFSET(average), -1),
+    field("volume", FieldType::INT, MD_OFFSET(volume), FIELD_VOLUME, Source::INT_VALUE, CTP_OFFSET(Volume)),
+    field("amount", FieldType::DOUBLE, MD_OFFSET(amount), FIELD_AMOUNT, Source::DOUBLE_VALUE, CTP_OFFSET(Turnover)),
+    field("open_interest", FieldType::INT64, MD_OFFSET(open_interest), FIELD_OPEN_INTEREST, Source::INT64_VALUE, CTP_OFFSET(OpenInterest)),
+    price("settlement", MD_OFFSET(settlement), FIELD_SETTLEMENT, CTP_OFFSET(SettlementPrice)),
+    price("upper_limit", MD_OFFSET(upper_limit), FIELD_UPPER_LIMIT, CTP_OFFSET(UpperLimitPrice)),
+    price("lower_limit", MD_OFFSET(lower_limit), FIELD_LOWER_LIMIT, CTP_OFFSET(LowerLimitPrice)),
+    field("pre_open_interest", FieldType::INT64, MD_OFFSET(pre_open_interest), FIELD_PRE_OPEN_INTEREST, Source::INT64_VALUE, CTP_OFFSET(PreOpenInterest)),
+    price("pre_settlement", MD_OFFSET(pre_settlement), FIELD_PRE_SETTLEMENT, CTP_OFFSET(PreSettlementPrice)),
+    price("pre_close", MD_OFFSET(pre_close), FIELD_PRE_CLOSE, CTP_OFFSET(PreClosePrice)),
+};
+
+#undef MD_OFFSET
+#undef CTP_OFFSET
+
+constexpr size_t kFieldCount = sizeof(kFields) / sizeof(kFields[0]);
+using FieldIndices = std::make_index_sequence<kFieldCount>;
+
+// 变化位 -> kFields 下标
+constexpr std::array<uint8_t, FIELD_COUNT> make_index_by_bit()
+{
+    std::array<uint8_t, FIELD_COUNT> index{};
+    for (size_t i = 0; i < kFieldCount; ++i) {
+        if (kFields[i].bit >= 0) {
+            index[static_cast<size_t>(kFields[i].bit)] = static_cast<uint8_t>(i);
+        }
+    }
+    return index;
+}
+inline constexpr std::array<uint8_t, FIELD_COUNT> kIndexByBit = make_index_by_bit();
+
+// 每个变化位恰好登记一个字段
+constexpr bool bits_are_complete()
+{
+    for (int bit = 0; bit < FIELD_COUNT; ++bit) {
+        int count = 0;
+        for (size_t i = 0; i < kFieldCount; ++i) {
+            count += kFields[i].bit == bit ? 1 : 0;
+        }
+        if (count != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(bits_are_complete(), "every MarketDataField bit must map to exactly one schema field");
+
+// 全量推送时有值的字段（不含恒为null的盘口6-10档），字段投影下的全量帧只写这些字段
+constexpr uint64_t make_snapshot_value_mask()
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < kFieldCount; ++i) {
+        if (kFields[i].bit >= 0 && !kFields[i].snapshot_null) {
+            mask |= 1ULL << kFields[i].bit;
+        }
+    }
+    return mask;
+}
+inline constexpr uint64_t kSnapshotValueMask = make_snapshot_value_mask();
+
+// 按JSON key查找字段，未登记的key返回nullptr
+inline const Field* find_field(std::string_view key)
+{
+    for (const Field& f : kFields) {
+        if (key == std::string_view(f.key, f.key_length)) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+template<FieldType Type> struct CppType;
+template<> struct CppType<FieldType::UINT64> { using type = uint64_t; };
+template<> struct CppType<FieldType::DOUBLE> { using type = double; };
+template<> struct CppType<FieldType::INT> { using type = int; };
+template<> struct CppType<FieldType::INT64> { using type = int64_t; };
+
+template<typename T>
+inline const T& value_at(const MarketDataStruct& data, uint32_t offset)
+{
+    return *reinterpret_cast<const T*>(reinterpret_cast<const char*>(&data) + offset);
+}
+
+template<typename T>
+inline T& value_at(MarketDataStruct& data, uint32_t offset)
+{
+    return *reinterpret_cast<T*>(reinterpret_cast<char*>(&data) + offset);
+}
+
+// ---- 全量序列化（SAX Writer，按表完全展开，key长度编译期已知） ----
+
+template<size_t I, typename Writer>
+inline void write_field(const MarketDataStruct& data, Writer& writer)
+{
+    constexpr Field f = kFields[I];
+    writer.Key(f.key, f.key_length);
+    if constexpr (f.snapshot_null) {
+        writer.Null();
+    } else if constexpr (f.type == FieldType::STRING) {
+        writer.String(&value_at<char>(data, f.offset));
+    } else if constexpr (f.type == FieldType::UINT64) {
+        writer.Uint64(value_at<uint64_t>(data, f.offset));
+    } else if constexpr (f.type == FieldType::DOUBLE) {
+        writer.Double(value_at<double>(data, f.offset));
+    } else if constexpr (f.type == FieldType::INT) {
+        writer.Int(value_at<int>(data, f.offset));
+    } else {
+        writer.Int64(value_at<int64_t>(data, f.offset));
+    }
+}
+
+template<typename Writer, size_t... I>
+inline void write_snapshot(const MarketDataStruct& data, Writer& writer, std::index_sequence<I...>)
+{
+    writer.StartObject();
+    (write_field<I>(data, writer), ...);
+    writer.EndObject();
+}
+
+// ---- 变化掩码（Selector::select(field) 为true的字段逐个比较，无分支） ----
+
+template<size_t I>
+inline uint64_t field_change_bit(const MarketDataStruct& old_data, const MarketDataStruct& new_data)
+{
+    constexpr Field f = kFields[I];
+    if constexpr (f.type == FieldType::STRING) {
+        return static_cast<uint64_t>(strcmp(&value_at<char>(old_data, f.offset),
+                                            &value_at<char>(new_data, f.offset)) != 0) << f.bit;
+    } else {
+        using T = typename CppType<f.type>::type;
+        return static_cast<uint64_t>(value_at<T>(old_data, f.offset) != value_at<T>(new_data, f.offset)) << f.bit;
+    }
+}
+
+template<typename Selector, size_t I>
+inline uint64_t selected_change_bit(const MarketDataStruct& old_data, const MarketDataStruct& new_data)
+{
+    if constexpr (kFields[I].bit >= 0 && Selector::select(kFields[I])) {
+        return field_change_bit<I>(old_data, new_data);
+    } else {
+        return 0;
+    }
+}
+
+template<typename Selector, size_t... I>
+inline uint64_t change_mask(const MarketDataStruct& old_data, const MarketDataStruct& new_data,
+                            std::index_sequence<I...>)
+{
+    return (selected_change_bit<Selector, I>(old_data, new_data) | ... | 0ULL);
+}
+
+struct AllFields {
+    static constexpr bool select(const Field&) { return true; }
+};
+
+// ---- 从CTP行情取值 ----
+
+inline bool valid_price(double price)
+{
+    return price > 1e-6 && price < 1e300;
+}
+
+template<typename T>
+inline T ctp_value(const CThostFtdcDepthMarketDataField& ctp, uint32_t offset)
+{
+    return *reinterpret_cast<const T*>(reinterpret_cast<const char*>(&ctp) + offset);
+}
+
+template<size_t I>
+inline void fill_field(const CThostFtdcDepthMarketDataField& ctp, MarketDataStruct& data)
+{
+    constexpr Field f = kFields[I];
+    if constexpr (f.source == Source::PRICE) {
+        const double price = ctp_value<double>(ctp, f.ctp_offset);
+        if (valid_price(price)) {
+            value_at<double>(data, f.offset) = round(price * 100.0) / 100.0;
+        }
+    } else if constexpr (f.source == Source::BOOK_VOLUME) {
+        if (valid_price(ctp_value<double>(ctp, f.ctp_guard_offset))) {
+            value_at<int>(data, f.offset) = ctp_value<int>(ctp, f.ctp_offset);
+        }
+    } else if constexpr (f.source == Source::INT_VALUE) {
+        value_at<int>(data, f.offset) = ctp_value<int>(ctp, f.ctp_offset);
+    } else if constexpr (f.source == Source::DOUBLE_VALUE) {
+        value_at<double>(data, f.offset) = ctp_value<double>(ctp, f.ctp_offset);
+    } else if constexpr (f.source == Source::INT64_VALUE) {
+        value_at<int64_t>(data, f.offset) = static_cast<int64_t>(ctp_value<double>(ctp, f.ctp_offset));
+    }
+}
+
+// data 需已清零
+template<size_t... I>
+inline void fill_from_ctp(const CThostFtdcDepthMarketDataField& ctp, MarketDataStruct& data, std::index_sequence<I...>)
+{
+    (fill_field<I>(ctp, data), ...);
+}
+
+}  // namespace md_schema
@@ -1,39 +1,75 @@
 #include "market_data_server.h"
+#include "field_diff.h"
+#include "quote_emitter.h"
+#include "fast_log.h"
 #include <boost/log/trivial.hpp>
 #include <boost/filesystem.hpp>
 #include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <cstddef>
 #include <cstring>
 #include <chrono>
 #include <random>
 #include <algorithm>
+#include <limits>
 #include <cmath>
 
-// 预分配的JSON key字符串（避免运行时字符串拼接）
-namespace {
-    const char* const ASK_PRICE_KEYS[] = {
-        "ask_price1", "ask_price2", "ask_price3", "ask_price4", "ask_price5",
-        "ask_price6", "ask_price7", "ask_price8", "ask_price9", "ask_price10"
-    };
-    const char* const ASK_VOLUME_KEYS[] = {
-        "ask_volume1", "ask_volume2", "ask_volume3", "ask_volume4", "ask_volume5",
-        "ask_volume6", "ask_volume7", "ask_volume8", "ask_volume9", "ask_volume10"
-    };
-    const char* const BID_PRICE_KEYS[] = {
-        "bid_price1", "bid_price2", "bid_price3", "bid_price4", "bid_price5",
-        "bid_price6", "bid_price7", "bid_price8", "bid_price9", "bid_price10"
-    };
-    const char* const BID_VOLUME_KEYS[] = {
-        "bid_volume1", "bid_volume2", "bid_volume3", "bid_volume4", "bid_volume5",
-        "bid_volume6", "bid_volume7", "bid_volume8", "bid_volume9", "bid_volume10"
-    };
-}
-
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace websocket = beast::websocket;
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
 
+namespace {
+
+// subscribe_quote 的 fields：逗号分隔的字符串或字符串数组，空列表表示全部字段
+bool parse_field_mask(const rapidjson::Value& fields, uint64_t& mask, std::string& unknown_field)
+{
+    std::vector<std::string> keys;
+    if (fields.IsString()) {
+        std::istringstream iss(fields.GetString());
+        std::string key;
+        while (std::getline(iss, key, ',')) {
+            if (!key.empty()) {
+                keys.push_back(key);
+            }
+        }
+    } else if (fields.IsArray()) {
+        for (const auto& key : fields.GetArray()) {
+            if (!key.IsString()) {
+                unknown_field = "<non-string>";
+                return false;
+            }
+            keys.emplace_back(key.GetString(), key.GetStringLength());
+        }
+    } else {
+        unknown_field = "<invalid>";
+        return false;
+    }
+
+    mask = 0;
+    for (const auto& key : keys) {
+        const md_schema::Field* field = md_schema::find_field(key);
+        if (!field) {
+            unknown_field = key;
+            return false;
+        }
+        if (field->bit >= 0) {
+            mask |= 1ULL << field->bit;
+        }
+    }
+
+    // 未指定字段或覆盖了全部字段时不投影，保持原有的全量输出格式
+    constexpr uint64_t kFieldBitsMask = (1ULL << FIELD_COUNT) - 1;
+    if (keys.empty() || (mask & kFieldBitsMask) == kFieldBitsMask) {
+        mask = kAllFieldsMask;
+    }
+    return true;
+}
+
+}  // namespace
+
 // WebSocketSession实现
 WebSocketSession::WebSocketSession(tcp::socket&& socket, MarketDataServer* server)
     : ws_(std::move(socket))
@@ -42,11 +78,20 @@ WebSocketSession::WebSocketSession(tcp::socket&& socket, MarketDataServer* serve
 {
     // 生成唯一的session ID
     session_id_ = server_->create_session_id();
+    resume_token_ = server_->create_resume_token();
+    coalesce_max_bytes_ = server_->get_websocket_coalesce_max_bytes();
+    if (const SessionPolicy* policy = server_->find_session_policy("default")) {
+        throttle_.configure(*policy, 0.0);
+    }
 }
 
 WebSocketSession::~WebSocketSession()
 {
     if (server_) {
+        if (flush_count_ > 0) {
+            server_->log_info("Session " + session_id_ + " wrote " + std::to_string(flushed_frames_) +
+                              " frames in " + std::to_string(flush_count_) + " flushes");
+        }
         server_->remove_session(session_id_);
     }
 }
@@ -55,6 +100,19 @@ void WebSocketSession::run()
 {
     // 设置WebSocket选项
     ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    
+    // 客户端在握手中请求 permessage-deflate 时协商启用，未请求的客户端不受影响
+    const MultiCTPConfig& config = server_->get_config();
+    if (config.websocket_deflate_enabled) {
+        websocket::permessage_deflate deflate;
+        deflate.server_enable = true;
+        deflate.server_max_window_bits = config.websocket_deflate_window_bits;
+        deflate.server_no_context_takeover = config.websocket_deflate_no_context_takeover;
+        deflate.compLevel = config.websocket_deflate_level;
+        deflate.memLevel = config.websocket_deflate_mem_level;
+        ws_.set_option(deflate);
+    }
+    
     ws_.set_option(websocket::stream_base::decorator(
         [](websocket::response_type& res)
         {
@@ -84,6 +142,9 @@ void WebSocketSession::on_accept(beast::error_code ec)
     welcome.AddMember("message", "Connected to QuantAxis MarketData Server", allocator);
     welcome.AddMember("session_id", rapidjson::StringRef(session_id_.c_str()), allocator);
     welcome.AddMember("ctp_connected", server_->is_ctp_connected(), allocator);
+    if (!resume_token_.empty()) {
+        welcome.AddMember("resume_token", rapidjson::StringRef(resume_token_.c_str()), allocator);
+    }
     welcome.AddMember("timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::system_clock::now().time_since_epoch()).count(), allocator);
     
@@ -111,7 +172,9 @@ void WebSocketSession::on_read(beast::error_code ec, std::size_t bytes_transferr
     }
 
     if (ec) {
+        // 连接异常断开（网络闪断）同样移除session，使其状态可以被重连的客户端恢复
         server_->log_error("WebSocket read error: " + ec.message());
+        server_->remove_session(session_id_);
         return;
     }
 
@@ -125,7 +188,7 @@ void WebSocketSession::on_read(beast::error_code ec, std::size_t bytes_transferr
 
 void WebSocketSession::handle_message(const std::string& message)
 {
-    server_->log_info("Received message from session " + session_id_ + ": " + message);
+    FLOG_INFO_RL(20, "Received message from session {}: {}", session_id_, message);
     
     try {
         rapidjson::Document doc;
@@ -145,6 +208,43 @@ void WebSocketSession::handle_message(const std::string& message)
                     return;
                 }
                 
+                // 可选的字段投影：只推送列出的字段
+                uint64_t field_mask = get_field_mask();
+                if (doc.HasMember("fields")) {
+                    std::string unknown_field;
+                    if (!parse_field_mask(doc["fields"], field_mask, unknown_field)) {
+                        send_error("Unknown field in 'fields': " + unknown_field);
+                        return;
+                    }
+                }
+                
+                // 可选的推送策略：policy 选择配置中的策略，max_update_rate 只能进一步降低推送频率
+                if (doc.HasMember("policy") || doc.HasMember("max_update_rate")) {
+                    std::string policy_name = throttle_.policy_name();
+                    if (doc.HasMember("policy")) {
+                        if (!doc["policy"].IsString()) {
+                            send_error("Invalid 'policy' field");
+                            return;
+                        }
+                        policy_name = doc["policy"].GetString();
+                    }
+                    double max_update_rate = 0.0;
+                    if (doc.HasMember("max_update_rate")) {
+                        if (!doc["max_update_rate"].IsNumber() || doc["max_update_rate"].GetDouble() < 0.0) {
+                            send_error("Invalid 'max_update_rate' field");
+                            return;
+                        }
+                        max_update_rate = doc["max_update_rate"].GetDouble();
+                    }
+                    
+                    const SessionPolicy* policy = server_->find_session_policy(policy_name);
+                    if (!policy && !policy_name.empty()) {
+                        send_error("Unknown policy: " + policy_name);
+                        return;
+                    }
+                    throttle_.configure(policy ? *policy : SessionPolicy{}, max_update_rate);
+                }
+                
                 std::string ins_list = doc["ins_list"].GetString();
                 std::vector<std::string> instruments;
                 
@@ -169,6 +269,11 @@ void WebSocketSession::handle_message(const std::string& message)
                     }
                 }
                 
+                const uint64_t old_field_mask = field_mask_.exchange(field_mask, std::memory_order_relaxed);
+                if (old_field_mask != field_mask) {
+                    server_->on_session_field_mask_changed(session_id_, old_field_mask, field_mask);
+                }
+                
                 // 发送mdservice格式响应
                 rapidjson::Document response;
                 response.SetObject();
@@ -180,10 +285,44 @@ void WebSocketSession::handle_message(const std::string& message)
                 return;
             }
             if (aid == "peek_message") {
-                // 处理peek_message，发送缓存的行情数据
+                // 处理peek_message，发送缓存的行情数据；peek_message 同时表示此前的行情已被客户端处理
+                if (defer_peek_while_streaming()) {
+                    return;  // 全量尚未发完，此peek只确认了部分块，不确认版本
+                }
+                server_->acknowledge_session(session_id_);
                 server_->handle_peek_message(session_id_);
                 return;
             }
+            if (aid == "resume_session") {
+                // 断线重连：恢复原会话已确认的版本、订阅和字段投影，之后的peek只推送增量
+                if (!doc.HasMember("resume_token") || !doc["resume_token"].IsString()) {
+                    send_error("Missing or invalid 'resume_token' field");
+                    return;
+                }
+                
+                std::set<std::string> subscriptions;
+                uint64_t field_mask = kAllFieldsMask;
+                const bool resumed = server_->resume_session(session_id_, doc["resume_token"].GetString(),
+                                                             subscriptions, field_mask);
+                if (resumed) {
+                    field_mask_.store(field_mask, std::memory_order_relaxed);
+                    for (const auto& instrument : subscriptions) {
+                        if (subscriptions_.insert(instrument).second) {
+                            server_->subscribe_instrument(session_id_, instrument);
+                        }
+                    }
+                }
+                
+                rapidjson::Document response;
+                response.SetObject();
+                auto& allocator = response.GetAllocator();
+                response.AddMember("aid", "resume_session", allocator);
+                response.AddMember("status", rapidjson::StringRef(resumed ? "ok" : "expired"), allocator);
+                response.AddMember("instrument_count", static_cast<uint64_t>(subscriptions.size()), allocator);
+                
+                send_response("resume_session_response", response);
+                return;
+            }
         }
     } catch (const std::exception& e) {
         send_error("Error processing message: " + std::string(e.what()));
@@ -205,18 +344,35 @@ void WebSocketSession::send_error(const std::string& error_msg)
 
 void WebSocketSession::send_response(const std::string& type, const rapidjson::Document& data)
 {
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    FrameBufferPtr buffer = FrameBufferPool::acquire();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer->data());
     data.Accept(writer);
+    buffer->seal();
     
-    send_message(buffer.GetString());
+    send_frame(OutboundFrame{std::move(buffer)});
 }
 
 void WebSocketSession::send_message(const std::string& message)
 {
+    send_frame(OutboundFrame{FrameBufferPool::copy_of(message)});
+}
+
+void WebSocketSession::send_frame(OutboundFrame frame, bool rtn_data)
+{
+    if (rtn_data) {
+        size_t bytes = 0;
+        for (const auto& fragment : frame) {
+            bytes += fragment->size();
+        }
+        throttle_.on_frame(SessionThrottle::now_ms(), bytes);
+    }
+    
     std::lock_guard<std::mutex> lock(write_mutex_);
+    if (write_failed_) {
+        return;  // 写出已失败，连接即将关闭，不再排队
+    }
     
-    message_queue_.push(message);
+    message_queue_.push_back(QueuedFrame{std::move(frame), rtn_data});
     
     if (!is_writing_) {
         is_writing_ = true;
@@ -231,14 +387,66 @@ void WebSocketSession::start_write()
         return;
     }
 
-    current_write_message_ = std::move(message_queue_.front());
-    message_queue_.pop();
+    // 各片段直接引用池化缓冲，一次分散-聚集写出为一条WebSocket消息。
+    // 上一次写出未完成期间排队的相邻 rtn_data 帧合并为一条消息：socket 写得快时逐帧发送，
+    // 写不动时积压的帧在下一次写出时一并发送，合并程度随 socket 可写速度自适应
+    write_buffers_.clear();
+    const bool coalesce = message_queue_.front().rtn_data && coalesce_max_bytes_ > 0 &&
+                          message_queue_.size() > 1 && message_queue_[1].rtn_data;
+    if (!coalesce) {
+        for (const auto& fragment : message_queue_.front().fragments) {
+            write_buffers_.push_back(fragment->buffer());
+        }
+        writing_frames_.push_back(std::move(message_queue_.front().fragments));
+        message_queue_.pop_front();
+    } else {
+        size_t bytes = 0;
+        while (!message_queue_.empty() && message_queue_.front().rtn_data &&
+               writing_frames_.size() < kMaxFramesPerFlush) {
+            size_t frame_bytes = 0;
+            for (const auto& fragment : message_queue_.front().fragments) {
+                frame_bytes += fragment->size();
+            }
+            if (!writing_frames_.empty() && bytes + frame_bytes > coalesce_max_bytes_) {
+                break;
+            }
+            bytes += frame_bytes;
+            append_rtn_data(message_queue_.front().fragments, writing_frames_.empty());
+            writing_frames_.push_back(std::move(message_queue_.front().fragments));
+            message_queue_.pop_front();
+        }
+        const std::string_view end = QuoteEmitter::rtn_data_end();
+        write_buffers_.push_back(net::const_buffer(end.data(), end.size()));
+    }
+
+    flush_count_++;
+    flushed_frames_ += writing_frames_.size();
+    server_->record_websocket_flush(writing_frames_.size());
 
     ws_.async_write(
-        net::buffer(current_write_message_),
+        write_buffers_,
         beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this()));
 }
 
+void WebSocketSession::append_rtn_data(const OutboundFrame& frame, bool first)
+{
+    // 首帧保留帧头，其余帧去掉帧头并以 "}},{\"quotes\":{" 接在前一帧之后；帧尾统一去掉，整批最后补一个
+    if (!first) {
+        const std::string_view join = QuoteEmitter::rtn_data_join();
+        write_buffers_.push_back(net::const_buffer(join.data(), join.size()));
+    }
+    for (size_t i = 0; i < frame.size(); ++i) {
+        net::const_buffer fragment = frame[i]->buffer();
+        if (i + 1 == frame.size()) {
+            fragment = net::const_buffer(fragment.data(), fragment.size() - QuoteEmitter::rtn_data_end_size());
+        }
+        if (i == 0 && !first) {
+            fragment += QuoteEmitter::rtn_data_begin_size();
+        }
+        write_buffers_.push_back(fragment);
+    }
+}
+
 void WebSocketSession::on_write(beast::error_code ec, std::size_t bytes_transferred)
 {
     boost::ignore_unused(bytes_transferred);
@@ -246,13 +454,22 @@ void WebSocketSession::on_write(beast::error_code ec, std::size_t bytes_transfer
     if (ec) {
         server_->log_error("WebSocket write error: " + ec.message());
         std::lock_guard<std::mutex> lock(write_mutex_);
+        // 不再写出：残留的 writing_frames_ 会让下一次合并把首帧当作续帧拼接，并长期占住池化缓冲
+        write_failed_ = true;
         is_writing_ = false;
+        writing_frames_.clear();
+        write_buffers_.clear();
+        message_queue_.clear();
+        // 关闭底层socket，挂起的读操作随之出错并移除会话
+        beast::error_code ignored;
+        beast::get_lowest_layer(ws_).socket().shutdown(net::ip::tcp::socket::shutdown_both, ignored);
         return;
     }
 
     std::lock_guard<std::mutex> lock(write_mutex_);
     
-    // 继续写入队列中的下一条消息
+    // 释放已写出的片段（最后一个引用释放时归还缓冲池），继续写入队列中的下一条消息
+    writing_frames_.clear();
     start_write();
 }
 
@@ -265,6 +482,23 @@ void WebSocketSession::close()
     }
 }
 
+bool WebSocketSession::defer_peek_while_streaming()
+{
+    if (!snapshot_streaming_) {
+        return false;
+    }
+    peek_during_stream_ = true;
+    return true;
+}
+
+bool WebSocketSession::end_snapshot_stream()
+{
+    const bool peek = peek_during_stream_;
+    snapshot_streaming_ = false;
+    peek_during_stream_ = false;
+    return peek;
+}
+
 // MarketDataSpi实现
 MarketDataSpi::MarketDataSpi(MarketDataServer* server) : server_(server)
 {
@@ -359,132 +593,8 @@ MarketDataStruct MarketDataServer::build_market_data_struct(CThostFtdcDepthMarke
     
     data.timestamp = cur_time;
     
-    // 初始化数组为0
-    for (int i = 0; i < 10; ++i) {
-        data.ask_price[i] = 0.0;
-        data.ask_volume[i] = 0;
-        data.bid_price[i] = 0.0;
-        data.bid_volume[i] = 0;
-    }
-    
-    // Ask 5-1
-    double ask5 = pDepthMarketData->AskPrice5;
-    if (ask5 > 1e-6 && ask5 < 1e300) {
-        data.ask_price[4] = round(ask5 * 100.0) / 100.0;
-        data.ask_volume[4] = pDepthMarketData->AskVolume5;
-    }
-    
-    double ask4 = pDepthMarketData->AskPrice4;
-    if (ask4 > 1e-6 && ask4 < 1e300) {
-        data.ask_price[3] = round(ask4 * 100.0) / 100.0;
-        data.ask_volume[3] = pDepthMarketData->AskVolume4;
-    }
-    
-    double ask3 = pDepthMarketData->AskPrice3;
-    if (ask3 > 1e-6 && ask3 < 1e300) {
-        data.ask_price[2] = round(ask3 * 100.0) / 100.0;
-        data.ask_volume[2] = pDepthMarketData->AskVolume3;
-    }
-    
-    double ask2 = pDepthMarketData->AskPrice2;
-    if (ask2 > 1e-6 && ask2 < 1e300) {
-        data.ask_price[1] = round(ask2 * 100.0) / 100.0;
-        data.ask_volume[1] = pDepthMarketData->AskVolume2;
-    }
-    
-    double ask1 = pDepthMarketData->AskPrice1;
-    if (ask1 > 1e-6 && ask1 < 1e300) {
-        data.ask_price[0] = round(ask1 * 100.0) / 100.0;
-        data.ask_volume[0] = pDepthMarketData->AskVolume1;
-    }
-    
-    // Bid 1-5
-    double bid1 = pDepthMarketData->BidPrice1;
-    if (bid1 > 1e-6 && bid1 < 1e300) {
-        data.bid_price[0] = round(bid1 * 100.0) / 100.0;
-        data.bid_volume[0] = pDepthMarketData->BidVolume1;
-    }
-    
-    double bid2 = pDepthMarketData->BidPrice2;
-    if (bid2 > 1e-6 && bid2 < 1e300) {
-        data.bid_price[1] = round(bid2 * 100.0) / 100.0;
-        data.bid_volume[1] = pDepthMarketData->BidVolume2;
-    }
-    
-    double bid3 = pDepthMarketData->BidPrice3;
-    if (bid3 > 1e-6 && bid3 < 1e300) {
-        data.bid_price[2] = round(bid3 * 100.0) / 100.0;
-        data.bid_volume[2] = pDepthMarketData->BidVolume3;
-    }
-    
-    double bid4 = pDepthMarketData->BidPrice4;
-    if (bid4 > 1e-6 && bid4 < 1e300) {
-        data.bid_price[3] = round(bid4 * 100.0) / 100.0;
-        data.bid_volume[3] = pDepthMarketData->BidVolume4;
-    }
-    
-    double bid5 = pDepthMarketData->BidPrice5;
-    if (bid5 > 1e-6 && bid5 < 1e300) {
-        data.bid_price[4] = round(bid5 * 100.0) / 100.0;
-        data.bid_volume[4] = pDepthMarketData->BidVolume5;
-    }
-    
-    // 其他价格字段
-    double last_price = pDepthMarketData->LastPrice;
-    if (last_price > 1e-6 && last_price < 1e300) {
-        data.last_price = round(last_price * 100.0) / 100.0;
-    }
-    
-    double highest = pDepthMarketData->HighestPrice;
-    if (highest > 1e-6 && highest < 1e300) {
-        data.highest = round(highest * 100.0) / 100.0;
-    }
-    
-    double lowest = pDepthMarketData->LowestPrice;
-    if (lowest > 1e-6 && lowest < 1e300) {
-        data.lowest = round(lowest * 100.0) / 100.0;
-    }
-    
-    double open = pDepthMarketData->OpenPrice;
-    if (open > 1e-6 && open < 1e300) {
-        data.open = round(open * 100.0) / 100.0;
-    }
-    
-    double close = pDepthMarketData->ClosePrice;
-    if (close > 1e-6 && close < 1e300) {
-        data.close = round(close * 100.0) / 100.0;
-    }
-    
-    data.volume = pDepthMarketData->Volume;
-    data.amount = pDepthMarketData->Turnover;
-    data.open_interest = static_cast<int64_t>(pDepthMarketData->OpenInterest);
-    
-    double settlement = pDepthMarketData->SettlementPrice;
-    if (settlement > 1e-6 && settlement < 1e300) {
-        data.settlement = round(settlement * 100.0) / 100.0;
-    }
-    
-    double upper_limit = pDepthMarketData->UpperLimitPrice;
-    if (upper_limit > 1e-6 && upper_limit < 1e300) {
-        data.upper_limit = round(upper_limit * 100.0) / 100.0;
-    }
-    
-    double lower_limit = pDepthMarketData->LowerLimitPrice;
-    if (lower_limit > 1e-6 && lower_limit < 1e300) {
-        data.lower_limit = round(lower_limit * 100.0) / 100.0;
-    }
-    
-    data.pre_open_interest = static_cast<int64_t>(pDepthMarketData->PreOpenInterest);
-    
-    double pre_settlement = pDepthMarketData->PreSettlementPrice;
-    if (pre_settlement > 1e-6 && pre_settlement < 1e300) {
-        data.pre_settlement = round(pre_settlement * 100.0) / 100.0;
-    }
-    
-    double pre_close = pDepthMarketData->PreClosePrice;
-    if (pre_close > 1e-6 && pre_close < 1e300) {
-        data.pre_close = round(pre_close * 100.0) / 100.0;
-    }
+    // 价格、盘口、成交与持仓字段按字段描述表转换（md_schema::kFields）
+    md_schema::fill_from_ctp(*pDepthMarketData, data, md_schema::FieldIndices{});
     
     return data;
 }
@@ -494,294 +604,82 @@ rapidjson::Value MarketDataServer::struct_to_json(const MarketDataStruct& data,
                                                   rapidjson::Document::AllocatorType& allocator)
 {
     rapidjson::Value inst_data(rapidjson::kObjectType);
-    inst_data.AddMember("instrument_id", rapidjson::Value(data.instrument_id, allocator), allocator);
-    inst_data.AddMember("datetime", rapidjson::Value(data.datetime, allocator), allocator);
-    inst_data.AddMember("timestamp", data.timestamp, allocator);
-    
-    // Ask 10-1 (10-6为null)
-    inst_data.AddMember("ask_price10", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_volume10", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_price9", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_volume9", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_price8", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_volume8", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_price7", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_volume7", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_price6", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("ask_volume6", rapidjson::Value().SetNull(), allocator);
-    
-    // Ask 5-1 (使用预分配的key，使用StringRef避免拷贝)
-    for (int i = 4; i >= 0; --i) {
-        inst_data.AddMember(rapidjson::StringRef(ASK_PRICE_KEYS[i]), data.ask_price[i], allocator);
-        inst_data.AddMember(rapidjson::StringRef(ASK_VOLUME_KEYS[i]), data.ask_volume[i], allocator);
-    }
-    
-    // Bid 1-5 (使用预分配的key，使用StringRef避免拷贝)
-    for (int i = 0; i < 5; ++i) {
-        inst_data.AddMember(rapidjson::StringRef(BID_PRICE_KEYS[i]), data.bid_price[i], allocator);
-        inst_data.AddMember(rapidjson::StringRef(BID_VOLUME_KEYS[i]), data.bid_volume[i], allocator);
-    }
-    
-    // Bid 6-10为null
-    inst_data.AddMember("bid_price6", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_volume6", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_price7", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_volume7", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_price8", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_volume8", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_price9", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_volume9", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_price10", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("bid_volume10", rapidjson::Value().SetNull(), allocator);
-    
-    // 其他字段
-    inst_data.AddMember("last_price", data.last_price, allocator);
-    inst_data.AddMember("highest", data.highest, allocator);
-    inst_data.AddMember("lowest", data.lowest, allocator);
-    inst_data.AddMember("open", data.open, allocator);
-    inst_data.AddMember("close", data.close, allocator);
-    
-    inst_data.AddMember("average", rapidjson::Value().SetNull(), allocator);
-    inst_data.AddMember("volume", data.volume, allocator);
-    inst_data.AddMember("amount", data.amount, allocator);
-    inst_data.AddMember("open_interest", data.open_interest, allocator);
-    
-    inst_data.AddMember("settlement", data.settlement, allocator);
-    inst_data.AddMember("upper_limit", data.upper_limit, allocator);
-    inst_data.AddMember("lower_limit", data.lower_limit, allocator);
-    
-    inst_data.AddMember("pre_open_interest", data.pre_open_interest, allocator);
-    
-    inst_data.AddMember("pre_settlement", data.pre_settlement, allocator);
-    inst_data.AddMember("pre_close", data.pre_close, allocator);
+    
+    for (const md_schema::Field& field : md_schema::kFields) {
+        rapidjson::Value value;
+        if (!field.snapshot_null) {
+            switch (field.type) {
+                case md_schema::FieldType::STRING:
+                    value.SetString(&md_schema::value_at<char>(data, field.offset), allocator);
+                    break;
+                case md_schema::FieldType::UINT64:
+                    value.SetUint64(md_schema::value_at<uint64_t>(data, field.offset));
+                    break;
+                case md_schema::FieldType::DOUBLE:
+                    value.SetDouble(md_schema::value_at<double>(data, field.offset));
+                    break;
+                case md_schema::FieldType::INT:
+                    value.SetInt(md_schema::value_at<int>(data, field.offset));
+                    break;
+                case md_schema::FieldType::INT64:
+                    value.SetInt64(md_schema::value_at<int64_t>(data, field.offset));
+                    break;
+            }
+        }
+        inst_data.AddMember(rapidjson::StringRef(field.key, field.key_length), value, allocator);
+    }
     
     return inst_data;
 }
 
-// 优化：直接写入Writer，避免DOM构建（SAX模式）
+// 优化：直接写入Writer，避免DOM构建（SAX模式），按字段描述表在编译期展开
 template<typename Writer>
 void MarketDataServer::struct_to_writer(const MarketDataStruct& data, Writer& writer)
 {
-    writer.StartObject();
-    
-    writer.Key("instrument_id");
-    writer.String(data.instrument_id);
-    writer.Key("datetime");
-    writer.String(data.datetime);
-    writer.Key("timestamp");
-    writer.Uint64(data.timestamp);
-    
-    // Ask 10-1 (10-6为null)
-    writer.Key("ask_price10"); writer.Null();
-    writer.Key("ask_volume10"); writer.Null();
-    writer.Key("ask_price9"); writer.Null();
-    writer.Key("ask_volume9"); writer.Null();
-    writer.Key("ask_price8"); writer.Null();
-    writer.Key("ask_volume8"); writer.Null();
-    writer.Key("ask_price7"); writer.Null();
-    writer.Key("ask_volume7"); writer.Null();
-    writer.Key("ask_price6"); writer.Null();
-    writer.Key("ask_volume6"); writer.Null();
-    
-    // Ask 5-1 (使用预分配的key)
-    for (int i = 4; i >= 0; --i) {
-        writer.Key(ASK_PRICE_KEYS[i]);
-        writer.Double(data.ask_price[i]);
-        writer.Key(ASK_VOLUME_KEYS[i]);
-        writer.Int(data.ask_volume[i]);
-    }
-    
-    // Bid 1-5 (使用预分配的key)
-    for (int i = 0; i < 5; ++i) {
-        writer.Key(BID_PRICE_KEYS[i]);
-        writer.Double(data.bid_price[i]);
-        writer.Key(BID_VOLUME_KEYS[i]);
-        writer.Int(data.bid_volume[i]);
-    }
-    
-    // Bid 6-10为null
-    writer.Key("bid_price6"); writer.Null();
-    writer.Key("bid_volume6"); writer.Null();
-    writer.Key("bid_price7"); writer.Null();
-    writer.Key("bid_volume7"); writer.Null();
-    writer.Key("bid_price8"); writer.Null();
-    writer.Key("bid_volume8"); writer.Null();
-    writer.Key("bid_price9"); writer.Null();
-    writer.Key("bid_volume9"); writer.Null();
-    writer.Key("bid_price10"); writer.Null();
-    writer.Key("bid_volume10"); writer.Null();
-    
-    // 其他字段
-    writer.Key("last_price");
-    writer.Double(data.last_price);
-    writer.Key("highest");
-    writer.Double(data.highest);
-    writer.Key("lowest");
-    writer.Double(data.lowest);
-    writer.Key("open");
-    writer.Double(data.open);
-    writer.Key("close");
-    writer.Double(data.close);
-    
-    writer.Key("average"); writer.Null();
-    writer.Key("volume");
-    writer.Int(data.volume);
-    writer.Key("amount");
-    writer.Double(data.amount);
-    writer.Key("open_interest");
-    writer.Int64(data.open_interest);
-    
-    writer.Key("settlement");
-    writer.Double(data.settlement);
-    writer.Key("upper_limit");
-    writer.Double(data.upper_limit);
-    writer.Key("lower_limit");
-    writer.Double(data.lower_limit);
-    
-    writer.Key("pre_open_interest");
-    writer.Int64(data.pre_open_interest);
-    
-    writer.Key("pre_settlement");
-    writer.Double(data.pre_settlement);
-    writer.Key("pre_close");
-    writer.Double(data.pre_close);
-    
-    writer.EndObject();
+    md_schema::write_snapshot(data, writer, md_schema::FieldIndices{});
 }
 
 // 显式实例化模板
 template void MarketDataServer::struct_to_writer<rapidjson::Writer<rapidjson::StringBuffer>>(
     const MarketDataStruct&, rapidjson::Writer<rapidjson::StringBuffer>&);
 
-// 结构体字段级比较，返回差异字段的JSON
-bool MarketDataServer::has_struct_changes(const MarketDataStruct& old_data, const MarketDataStruct& new_data)
+// 结构体字段级比较，返回变化字段的掩码（SIMD实现按CPU能力选择，见 field_diff.h）
+uint64_t MarketDataServer::compute_change_mask(const MarketDataStruct& old_data, const MarketDataStruct& new_data)
 {
-    // 快速比较：先比较基本字段
-    if (strcmp(old_data.instrument_id, new_data.instrument_id) != 0 ||
-        strcmp(old_data.datetime, new_data.datetime) != 0 ||
-        old_data.timestamp != new_data.timestamp) {
-        return true;
-    }
-    
-    // 比较数组字段
-    if (memcmp(old_data.ask_price, new_data.ask_price, sizeof(old_data.ask_price)) != 0 ||
-        memcmp(old_data.ask_volume, new_data.ask_volume, sizeof(old_data.ask_volume)) != 0 ||
-        memcmp(old_data.bid_price, new_data.bid_price, sizeof(old_data.bid_price)) != 0 ||
-        memcmp(old_data.bid_volume, new_data.bid_volume, sizeof(old_data.bid_volume)) != 0) {
-        return true;
-    }
-    
-    // 比较其他价格字段
-    if (old_data.last_price != new_data.last_price ||
-        old_data.highest != new_data.highest ||
-        old_data.lowest != new_data.lowest ||
-        old_data.open != new_data.open ||
-        old_data.close != new_data.close ||
-        old_data.settlement != new_data.settlement ||
-        old_data.upper_limit != new_data.upper_limit ||
-        old_data.lower_limit != new_data.lower_limit ||
-        old_data.pre_settlement != new_data.pre_settlement ||
-        old_data.pre_close != new_data.pre_close) {
-        return true;
-    }
-    
-    // 比较整数字段
-    if (old_data.volume != new_data.volume ||
-        old_data.amount != new_data.amount ||
-        old_data.open_interest != new_data.open_interest ||
-        old_data.pre_open_interest != new_data.pre_open_interest) {
-        return true;
-    }
-    
-    return false;
+    return FieldDiff::compute(old_data, new_data);
 }
 
-void MarketDataServer::compute_struct_diff(const MarketDataStruct& old_data,
-                                          const MarketDataStruct& new_data,
-                                          rapidjson::Writer<rapidjson::StringBuffer>& writer)
+void MarketDataServer::write_changed_fields(const MarketDataStruct& data, uint64_t mask,
+                                           rapidjson::Writer<rapidjson::StringBuffer>& writer)
 {
-    writer.StartObject();
-    
-    // 比较基本字段
-    if (strcmp(old_data.instrument_id, new_data.instrument_id) != 0) {
-        writer.Key("instrument_id");
-        writer.String(new_data.instrument_id);
-    }
-    
-    if (strcmp(old_data.datetime, new_data.datetime) != 0) {
-        writer.Key("datetime");
-        writer.String(new_data.datetime);
-    }
-    
-    if (old_data.timestamp != new_data.timestamp) {
-        writer.Key("timestamp");
-        writer.Uint64(new_data.timestamp);
-    }
+    constexpr uint64_t kFieldBitsMask = (1ULL << FIELD_COUNT) - 1;
     
-    // 比较Ask价格和量
-    for (int i = 0; i < 10; ++i) {
-        if (old_data.ask_price[i] != new_data.ask_price[i]) {
-            writer.Key(ASK_PRICE_KEYS[i]);
-            writer.Double(new_data.ask_price[i]);
-        }
-        if (old_data.ask_volume[i] != new_data.ask_volume[i]) {
-            writer.Key(ASK_VOLUME_KEYS[i]);
-            writer.Int(new_data.ask_volume[i]);
-        }
-    }
+    writer.StartObject();
     
-    // 比较Bid价格和量
-    for (int i = 0; i < 10; ++i) {
-        if (old_data.bid_price[i] != new_data.bid_price[i]) {
-            writer.Key(BID_PRICE_KEYS[i]);
-            writer.Double(new_data.bid_price[i]);
-        }
-        if (old_data.bid_volume[i] != new_data.bid_volume[i]) {
-            writer.Key(BID_VOLUME_KEYS[i]);
-            writer.Int(new_data.bid_volume[i]);
+    // 只遍历置位：每笔行情通常只有十来个字段变化，不逐个检查全部字段
+    for (uint64_t bits = mask & kFieldBitsMask; bits != 0; bits &= bits - 1) {
+        const md_schema::Field& field = md_schema::kFields[md_schema::kIndexByBit[__builtin_ctzll(bits)]];
+        
+        writer.Key(field.key, field.key_length);
+        switch (field.type) {
+            case md_schema::FieldType::STRING:
+                writer.String(&md_schema::value_at<char>(data, field.offset));
+                break;
+            case md_schema::FieldType::UINT64:
+                writer.Uint64(md_schema::value_at<uint64_t>(data, field.offset));
+                break;
+            case md_schema::FieldType::DOUBLE:
+                writer.Double(md_schema::value_at<double>(data, field.offset));
+                break;
+            case md_schema::FieldType::INT:
+                writer.Int(md_schema::value_at<int>(data, field.offset));
+                break;
+            case md_schema::FieldType::INT64:
+                writer.Int64(md_schema::value_at<int64_t>(data, field.offset));
+                break;
         }
     }
     
-    // 比较其他价格字段
-    auto add_price_diff = [&](const char* key, double old_val, double new_val) {
-        if (old_val != new_val) {
-            writer.Key(key);
-            writer.Double(new_val);
-        }
-    };
-    
-    add_price_diff("last_price", old_data.last_price, new_data.last_price);
-    add_price_diff("highest", old_data.highest, new_data.highest);
-    add_price_diff("lowest", old_data.lowest, new_data.lowest);
-    add_price_diff("open", old_data.open, new_data.open);
-    add_price_diff("close", old_data.close, new_data.close);
-    add_price_diff("upper_limit", old_data.upper_limit, new_data.upper_limit);
-    add_price_diff("lower_limit", old_data.lower_limit, new_data.lower_limit);
-    add_price_diff("pre_settlement", old_data.pre_settlement, new_data.pre_settlement);
-    add_price_diff("pre_close", old_data.pre_close, new_data.pre_close);
-    add_price_diff("settlement", old_data.settlement, new_data.settlement);
-    
-    // 比较整数字段
-    if (old_data.volume != new_data.volume) {
-        writer.Key("volume");
-        writer.Int(new_data.volume);
-    }
-    
-    if (old_data.amount != new_data.amount) {
-        writer.Key("amount");
-        writer.Double(new_data.amount);
-    }
-    
-    if (old_data.open_interest != new_data.open_interest) {
-        writer.Key("open_interest");
-        writer.Int64(new_data.open_interest);
-    }
-    
-    if (old_data.pre_open_interest != new_data.pre_open_interest) {
-        writer.Key("pre_open_interest");
-        writer.Int64(new_data.pre_open_interest);
-    }
-    
     writer.EndObject();
 }
 
@@ -818,7 +716,7 @@ void MarketDataSpi::OnRtnDepthMarketData(CThostFtdcDepthMarketDataField *pDepthM
 
     if ((count % 1000) == 0) {                 // 任意输出周期
         const auto avg_ns = total_ns.load(std::memory_order_relaxed) / count;
-        server_->log_info("OnRtnDepthMarketData avg cost: " + std::to_string(avg_ns) + " ns (" + std::to_string(count) + " calls)");
+        FLOG_INFO("OnRtnDepthMarketData avg cost: {} ns ({} calls)", avg_ns, count);
     }
 }
 
@@ -851,6 +749,8 @@ MarketDataServer::MarketDataServer(const std::string& ctp_front_addr,
     // 预分配缓存，避免运行时的内存重分配
     market_data_cache_.resize(50000);
     display_instruments_cache_.resize(50000);
+    price_decimals_cache_.resize(50000, QuoteEmitter::kDefaultPriceDecimals);
+    quote_fragments_.resize(50000);
 }
 
 MarketDataServer::MarketDataServer(const MultiCTPConfig& config)
@@ -872,6 +772,8 @@ MarketDataServer::MarketDataServer(const MultiCTPConfig& config)
     // 预分配缓存，避免运行时的内存重分配
     market_data_cache_.resize(50000);
     display_instruments_cache_.resize(50000);
+    price_decimals_cache_.resize(50000, QuoteEmitter::kDefaultPriceDecimals);
+    quote_fragments_.resize(50000);
 }
 
 MarketDataServer::~MarketDataServer()
@@ -887,6 +789,13 @@ bool MarketDataServer::start()
     
     std::string mode = use_multi_ctp_mode_ ? "multi-CTP" : "single-CTP";
     log_info("Starting MarketData Server in " + mode + " mode...");
+    log_info(std::string("Field diff kernel: ") + FieldDiff::kernel_name(FieldDiff::active_kernel()));
+    if (multi_ctp_config_.websocket_deflate_enabled) {
+        log_info("WebSocket permessage-deflate enabled: level " + std::to_string(multi_ctp_config_.websocket_deflate_level) +
+                 ", window_bits " + std::to_string(multi_ctp_config_.websocket_deflate_window_bits) +
+                 ", mem_level " + std::to_string(multi_ctp_config_.websocket_deflate_mem_level) +
+                 (multi_ctp_config_.websocket_deflate_no_context_takeover ? ", no context takeover" : ""));
+    }
     
     try {
         // 初始化共享内存
@@ -931,6 +840,12 @@ bool MarketDataServer::start()
             ioc_.run();
         });
         
+        // 后台预序列化全量片段，新会话的全量帧由片段拼接，不在io线程上逐合约序列化
+        if (multi_ctp_config_.snapshot_refresh_ms > 0) {
+            snapshot_thread_stop_ = false;
+            snapshot_thread_ = std::thread(&MarketDataServer::snapshot_refresh_loop, this);
+        }
+        
         log_info("MarketData Server started on port " + std::to_string(websocket_port_));
         return true;
         
@@ -984,6 +899,15 @@ void MarketDataServer::stop()
         server_thread_.join();
     }
     
+    if (snapshot_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(snapshot_thread_mutex_);
+            snapshot_thread_stop_ = true;
+        }
+        snapshot_thread_cv_.notify_all();
+        snapshot_thread_.join();
+    }
+    
     // 清理CTP资源
     if (ctp_api_) {
         ctp_api_->Release();
@@ -1175,18 +1099,52 @@ void MarketDataServer::remove_session(const std::string& session_id)
     }
     
     // 通用的session移除逻辑
-    std::lock_guard<std::mutex> lock1(sessions_mutex_);
-    auto it = sessions_.find(session_id);
-    if (it != sessions_.end()) {
-        sessions_.erase(it);
-        log_info("Session removed: " + session_id);
+    std::shared_ptr<WebSocketSession> removed;
+    {
+        std::lock_guard<std::mutex> lock1(sessions_mutex_);
+        auto it = sessions_.find(session_id);
+        if (it != sessions_.end()) {
+            removed = it->second;
+            sessions_.erase(it);
+            log_info("Session removed: " + session_id);
+        }
     }
     
-    // 清理上次发送的快照和版本号
+    // 清理上次发送的版本号；启用会话恢复时把客户端已确认的版本按token保留一段时间
     {
         std::lock_guard<std::mutex> lock_json(session_last_sent_mutex_);
-        session_last_sent_structs_.erase(session_id);
-        session_last_versions_.erase(session_id);
+        auto ver_it = session_last_versions_.find(session_id);
+        if (removed && !removed->get_resume_token().empty() && ver_it != session_last_versions_.end() &&
+            !ver_it->second.empty()) {
+            RetainedSession retained;
+            retained.versions = std::move(ver_it->second);
+            // 未确认的帧可能没有送达，按发送前的版本保留
+            auto unacked_it = session_unacked_versions_.find(session_id);
+            if (unacked_it != session_unacked_versions_.end()) {
+                for (const auto& entry : unacked_it->second) {
+                    if (entry.second == 0) {
+                        retained.versions.erase(entry.first);
+                    } else {
+                        retained.versions[entry.first] = entry.second;
+                    }
+                }
+            }
+            retained.subscriptions = removed->get_subscriptions();
+            retained.field_mask = removed->get_field_mask();
+            
+            const int64_t now_ms = SessionThrottle::now_ms();
+            retained.expire_ms = now_ms + multi_ctp_config_.session_resume_grace_seconds * 1000LL;
+            
+            if (!retained.versions.empty()) {
+                std::lock_guard<std::mutex> lock_retained(retained_sessions_mutex_);
+                retained_sessions_[removed->get_resume_token()] = std::move(retained);
+                net::post(ioc_, [this]() { arm_retained_sessions_timer(); });
+            }
+        }
+        if (ver_it != session_last_versions_.end()) {
+            session_last_versions_.erase(ver_it);
+        }
+        session_unacked_versions_.erase(session_id);
     }
     
     // 清理挂起队列
@@ -1194,6 +1152,7 @@ void MarketDataServer::remove_session(const std::string& session_id)
         std::lock_guard<std::mutex> lock_pending(pending_peek_mutex_);
         pending_peek_sessions_.erase(session_id);
     }
+    deferred_peeks_.remove(session_id);
 }
 
 void MarketDataServer::subscribe_instrument(const std::string& session_id, const std::string& instrument_id)
@@ -1220,7 +1179,7 @@ void MarketDataServer::subscribe_instrument(const std::string& session_id, const
             char* instruments[] = {const_cast<char*>(instrument_id.c_str())};
             int ret = ctp_api_->SubscribeMarketData(instruments, 1);
             if (ret == 0) {
-                log_info("Subscribed to CTP market data: " + instrument_id);
+                FLOG_INFO("Subscribed to CTP market data: {}", instrument_id);
             } else {
                 log_error("Failed to subscribe to CTP market data: " + instrument_id + 
                          ", return code: " + std::to_string(ret));
@@ -1276,6 +1235,124 @@ void MarketDataServer::unsubscribe_instrument(const std::string& session_id, con
     }
 }
 
+void MarketDataServer::on_session_field_mask_changed(const std::string& session_id, uint64_t old_mask, uint64_t new_mask)
+{
+    // 只减少字段时客户端已有的数据仍然有效；新增字段需要重新推送全量，客户端才有这些字段的初值
+    if ((new_mask & ~old_mask) == 0) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(session_last_sent_mutex_);
+    session_last_versions_.erase(session_id);
+    session_unacked_versions_.erase(session_id);
+}
+
+std::string MarketDataServer::create_resume_token()
+{
+    if (multi_ctp_config_.session_resume_grace_seconds <= 0) {
+        return std::string();
+    }
+    
+    // token 是接管保留会话的唯一凭据：128位全部直接取自 std::random_device（libstdc++ 在Linux上为硬件随机数或 /dev/urandom），
+    // 不经过可由输出反推状态的伪随机数生成器
+    static std::mutex rd_mutex;
+    static std::random_device rd;
+    
+    std::ostringstream oss;
+    oss << std::hex << std::setfill('0');
+    std::lock_guard<std::mutex> lock(rd_mutex);
+    for (int i = 0; i < 4; ++i) {
+        oss << std::setw(8) << static_cast<uint32_t>(rd());
+    }
+    return oss.str();
+}
+
+void MarketDataServer::acknowledge_session(const std::string& session_id)
+{
+    std::lock_guard<std::mutex> lock(session_last_sent_mutex_);
+    auto it = session_unacked_versions_.find(session_id);
+    if (it != session_unacked_versions_.end()) {
+        it->second.clear();
+    }
+}
+
+void MarketDataServer::arm_retained_sessions_timer()
+{
+    if (retained_sessions_timer_armed_) {
+        return;
+    }
+    
+    int64_t next_expire_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(retained_sessions_mutex_);
+        for (const auto& pair : retained_sessions_) {
+            if (next_expire_ms == 0 || pair.second.expire_ms < next_expire_ms) {
+                next_expire_ms = pair.second.expire_ms;
+            }
+        }
+    }
+    if (next_expire_ms == 0) {
+        return;
+    }
+    
+    retained_sessions_timer_armed_ = true;
+    retained_sessions_timer_.expires_after(
+        std::chrono::milliseconds(std::max<int64_t>(next_expire_ms - SessionThrottle::now_ms(), 0)));
+    retained_sessions_timer_.async_wait([this](const boost::system::error_code& ec) {
+        retained_sessions_timer_armed_ = false;
+        if (!ec) {
+            purge_retained_sessions();
+        }
+    });
+}
+
+void MarketDataServer::purge_retained_sessions()
+{
+    // 过期的token及其版本表不等到下一次断线才释放
+    {
+        const int64_t now_ms = SessionThrottle::now_ms();
+        std::lock_guard<std::mutex> lock(retained_sessions_mutex_);
+        for (auto it = retained_sessions_.begin(); it != retained_sessions_.end();) {
+            it = it->second.expire_ms <= now_ms ? retained_sessions_.erase(it) : std::next(it);
+        }
+    }
+    arm_retained_sessions_timer();
+}
+
+bool MarketDataServer::resume_session(const std::string& session_id, const std::string& token,
+                                      std::set<std::string>& subscriptions, uint64_t& field_mask)
+{
+    RetainedSession retained;
+    {
+        std::lock_guard<std::mutex> lock(retained_sessions_mutex_);
+        auto it = retained_sessions_.find(token);
+        if (it == retained_sessions_.end()) {
+            return false;
+        }
+        const bool expired = it->second.expire_ms <= SessionThrottle::now_ms();
+        if (!expired) {
+            retained = std::move(it->second);
+        }
+        retained_sessions_.erase(it);
+        if (expired) {
+            return false;
+        }
+    }
+    
+    // 掩码历史之内的版本差按增量推送，超出历史的合约按全量推送
+    {
+        std::lock_guard<std::mutex> lock(session_last_sent_mutex_);
+        session_last_versions_[session_id] = std::move(retained.versions);
+        session_unacked_versions_.erase(session_id);
+    }
+    subscriptions = std::move(retained.subscriptions);
+    field_mask = retained.field_mask;
+    
+    resumed_sessions_.fetch_add(1, std::memory_order_relaxed);
+    log_info("Session " + session_id + " resumed " + std::to_string(subscriptions.size()) + " subscriptions");
+    return true;
+}
+
 int MarketDataServer::get_or_create_index(const std::string& instrument_id, const std::string& display_instrument)
 {
     // 快速路径：使用读锁查找
@@ -1313,10 +1390,26 @@ int MarketDataServer::get_or_create_index(const std::string& instrument_id, cons
         display_instruments_cache_[index] = (map_it != noheadtohead_instruments_map_.end()) 
             ? map_it->second : instrument_id;
     }
+    price_decimals_cache_[index] = lookup_price_decimals(display_instruments_cache_[index]);
     
     return index;
 }
 
+uint8_t MarketDataServer::lookup_price_decimals(const std::string& display_instrument) const
+{
+    if (!ins_map_ || display_instrument.size() >= sizeof(InsMapKeyType)) {
+        return QuoteEmitter::kDefaultPriceDecimals;
+    }
+    
+    InsMapKeyType key{};
+    memcpy(key.data(), display_instrument.data(), display_instrument.size());
+    auto it = ins_map_->find(key);
+    if (it == ins_map_->end()) {
+        return QuoteEmitter::kDefaultPriceDecimals;
+    }
+    return QuoteEmitter::decimals_for_tick(it->second.price_tick);
+}
+
 int MarketDataServer::get_index(const std::string& instrument_id) const
 {
     std::shared_lock<std::shared_mutex> lock(index_map_mutex_);
@@ -1327,22 +1420,39 @@ int MarketDataServer::get_index(const std::string& instrument_id) const
     return -1;
 }
 
-void MarketDataServer::cache_market_data(const std::string& instrument_id, const MarketDataStruct& data, const std::string& display_instrument)
+bool MarketDataServer::cache_market_data(const std::string& instrument_id, const MarketDataStruct& data, const std::string& display_instrument)
 {
     int index = get_or_create_index(instrument_id, display_instrument);
-    if (index < 0) return;
+    if (index < 0) return false;
     
     // SeqLock 写入过程:
-    // 1. 加载当前序列号
-    // 2. 序列号 + 1 (变奇数) -> 内存屏障 release
+    // 1. CAS 将序列号由偶数改为奇数（冗余订阅下多个CTP回调线程可能同时写同一合约）
+    // 2. 内存屏障 release，保证数据写入不会重排到序列号之前
     // 3. 写入数据
     // 4. 序列号 + 1 (变偶数) -> 内存屏障 release
     
     AtomicMarketDataEntry& entry = market_data_cache_[index];
     
     uint64_t seq = entry.sequence.load(std::memory_order_relaxed);
-    entry.sequence.store(seq + 1, std::memory_order_release);
+    while ((seq & 1) != 0 ||
+           !entry.sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+        if ((seq & 1) != 0) {
+            seq = entry.sequence.load(std::memory_order_relaxed);
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    // 相对上一版本变化的字段，所有session增量推送共用
+    const uint64_t mask = entry.has_data ? compute_change_mask(entry.data, data) : kAllFieldsMask;
+    
+    // 前置重发的相同快照（只有本地接收时间不同）：恢复原序列号（数据未改动，读者按原版本读取仍然有效），不唤醒session
+    if ((mask & ~(1ULL << FIELD_TIMESTAMP)) == 0) {
+        entry.sequence.store(seq, std::memory_order_release);
+        return false;
+    }
     
+    const uint64_t version = (seq + 2) / 2;
+    entry.change_masks[version % kChangeMaskHistory] = mask;
     entry.data = data;
     entry.has_data = true;
     
@@ -1352,6 +1462,7 @@ void MarketDataServer::cache_market_data(const std::string& instrument_id, const
     ioc_.post([this, instrument_id]() {
         notify_pending_sessions(instrument_id);
     });
+    return true;
 }
 
 void MarketDataServer::on_component_update(const std::string& component_id, const MarketDataStruct& market_data)
@@ -1383,40 +1494,35 @@ void MarketDataServer::handle_peek_message(const std::string& session_id)
         return;
     }
     
+    if (session_ptr->defer_peek_while_streaming()) {
+        return;
+    }
+    
+    // 会话推送策略：未到允许推送的时间时放入时间轮，到期后按最新版本合并推送期间的变化
+    const int64_t now_ms = SessionThrottle::now_ms();
+    const int64_t delay_ms = session_ptr->throttle().delay_ms(now_ms);
+    if (delay_ms > 0) {
+        defer_peek(session_id, now_ms, now_ms + delay_ms);
+        return;
+    }
+    
     // 创建局部拷贝用于后续处理（此时已释放锁）
     std::set<std::string> subscriptions = *subscriptions_ptr;
 
     // 2. 获取该 Session 上次的状态（版本号和快照）
     // 使用指针引用避免不必要的拷贝，只在需要时拷贝
-    const std::unordered_map<std::string, uint64_t>* last_versions_ptr = nullptr;
-    const std::unordered_map<std::string, MarketDataStruct>* last_sent_structs_ptr = nullptr;
+    // 版本号map需要拷贝（锁外使用，其它peek可能同时更新）；增量内容由缓存条目的变化掩码得出
+    std::unordered_map<std::string, uint64_t> last_versions_copy;
     bool has_last_snapshot = false;
     
     {
         std::lock_guard<std::mutex> lock(session_last_sent_mutex_);
         auto ver_it = session_last_versions_.find(session_id);
         if (ver_it != session_last_versions_.end() && !ver_it->second.empty()) {
-            last_versions_ptr = &ver_it->second;
+            last_versions_copy = ver_it->second;
+            has_last_snapshot = true;
         }
-        
-        auto struct_it = session_last_sent_structs_.find(session_id);
-        has_last_snapshot = (struct_it != session_last_sent_structs_.end() && !struct_it->second.empty());
-        if (has_last_snapshot) {
-            last_sent_structs_ptr = &struct_it->second;
-        }
-    }
-    
-    // 优化：避免拷贝大map，使用引用或指针
-    // 对于版本号map，需要拷贝用于collect_market_data_updates（因为需要修改）
-    std::unordered_map<std::string, uint64_t> last_versions_copy;
-    if (last_versions_ptr) {
-        last_versions_copy = *last_versions_ptr;
     }
-    
-    // 对于last_sent_structs，使用引用避免拷贝（在锁保护下获取引用，后续只读）
-    // 如果last_sent_structs_ptr为空，创建空map作为fallback
-    static const std::unordered_map<std::string, MarketDataStruct> empty_map;
-    const auto& last_snapshots = last_sent_structs_ptr ? *last_sent_structs_ptr : empty_map;
 
     // 3. 收集有更新的合约数据
     auto updated_instruments = collect_market_data_updates(subscriptions, last_versions_copy);
@@ -1431,13 +1537,24 @@ void MarketDataServer::handle_peek_message(const std::string& session_id)
     }
  
     // 5. 发送数据（全量或增量）
+    const uint64_t field_mask = session_ptr->get_field_mask();
     if (!has_last_snapshot) {
-        send_full_snapshot(session_ptr, updated_instruments);
-    } else {
-        size_t diff_count = send_diff_snapshot(session_ptr, updated_instruments, last_snapshots);
-        const auto end_time = clock::now();
-        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
-        BOOST_LOG_TRIVIAL(info) << "peek_message processing time: " << elapsed_ms << " ns, diff instrument count: " << diff_count;
+        // 全量在发送前记录session状态（可能分块跨多个io轮次发送）
+        send_full_snapshot(session_ptr, updated_instruments, field_mask);
+        return;
+    }
+    
+    size_t diff_count = send_diff_snapshot(session_ptr, updated_instruments, field_mask);
+    const auto end_time = clock::now();
+    const auto elapsed_ms = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+    FLOG_INFO_RL(10, "peek_message processing time: {} ns, diff instrument count: {}", elapsed_ms, diff_count);
+    
+    // 变化的字段都不在该session的字段投影中：记下版本后继续挂起
+    if (diff_count == 0) {
+        update_session_state(session_id, updated_instruments, false);
+        std::lock_guard<std::mutex> lock(pending_peek_mutex_);
+        pending_peek_sessions_.insert(session_id);
+        return;
     }
 
     // 6. 更新 Session 状态
@@ -1458,7 +1575,12 @@ std::vector<std::pair<std::string, MarketDataServer::SnapshotData>> MarketDataSe
         AtomicMarketDataEntry& entry = market_data_cache_[index];
         if (!entry.has_data) continue;
 
+        // 该session上次发送的版本，0 表示尚未发送过
+        auto ver_it = last_versions.find(instrument_id);
+        const uint64_t last_version = ver_it != last_versions.end() ? ver_it->second : 0;
+
         MarketDataStruct data_snapshot;
+        uint64_t changed_mask = kAllFieldsMask;
         uint64_t seq_start = 0, seq_end = 0;
         int retries = 0;
 
@@ -1473,6 +1595,16 @@ std::vector<std::pair<std::string, MarketDataServer::SnapshotData>> MarketDataSe
             
             data_snapshot = entry.data;
             
+            // 合并跳过的各版本的变化掩码；间隔超出掩码历史时按全量发送
+            const uint64_t version = seq_start / 2;
+            changed_mask = kAllFieldsMask;
+            if (last_version > 0 && version > last_version && version - last_version <= kChangeMaskHistory) {
+                changed_mask = 0;
+                for (uint64_t v = last_version + 1; v <= version; ++v) {
+                    changed_mask |= entry.change_masks[v % kChangeMaskHistory];
+                }
+            }
+            
             seq_end = entry.sequence.load(std::memory_order_acquire);
             if (++retries > 100) break;
             
@@ -1484,16 +1616,13 @@ std::vector<std::pair<std::string, MarketDataServer::SnapshotData>> MarketDataSe
 
         uint64_t current_version = seq_end / 2;
 
-        // 检查版本号（优化：合并 find + at 为一次查找）
-        auto ver_it = last_versions.find(instrument_id);
-        if (last_versions.empty() || 
-            ver_it == last_versions.end() ||
-            current_version > ver_it->second) {
-            
+        // 检查版本号
+        if (current_version > last_version) {
             SnapshotData snapshot;
             snapshot.data = data_snapshot;
             snapshot.has_data = true;
             snapshot.version = current_version;
+            snapshot.changed_mask = changed_mask;
             snapshot.index = index;  // 保存index，用于批量获取display_instrument
             updated_instruments.emplace_back(instrument_id, std::move(snapshot));
         }
@@ -1506,6 +1635,7 @@ std::vector<std::pair<std::string, MarketDataServer::SnapshotData>> MarketDataSe
             auto& snapshot = entry.second;
             if (snapshot.index >= 0 && snapshot.index < static_cast<int>(display_instruments_cache_.size())) {
                 snapshot.display_instrument = &display_instruments_cache_[snapshot.index];
+                snapshot.price_decimals = price_decimals_cache_[snapshot.index];
             }
         }
     }
@@ -1515,178 +1645,243 @@ std::vector<std::pair<std::string, MarketDataServer::SnapshotData>> MarketDataSe
 
 void MarketDataServer::send_full_snapshot(
     std::shared_ptr<WebSocketSession> session,
-    const std::vector<std::pair<std::string, SnapshotData>>& updates)
+    std::vector<std::pair<std::string, SnapshotData>>& updates,
+    uint64_t field_mask)
 {
-    // 优化：使用Writer模式，避免DOM构建
-    rapidjson::StringBuffer buffer;
-    buffer.Reserve(updates.size() * 300);  // 预分配
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    // 未投影的全量帧由预序列化片段拼接。片段可能落后于缓存最多一个刷新周期，
+    // session 记录片段的版本，下一次peek按变化掩码历史推送片段版本之后的增量
+    std::vector<FrameBufferPtr> fragments;
+    if (field_mask == kAllFieldsMask && multi_ctp_config_.snapshot_refresh_ms > 0) {
+        fragments.resize(updates.size());
+        size_t used = 0;
+        std::lock_guard<std::mutex> lock(quote_fragments_mutex_);
+        for (size_t i = 0; i < updates.size(); ++i) {
+            SnapshotData& snapshot = updates[i].second;
+            if (snapshot.index < 0) {
+                continue;
+            }
+            const QuoteFragment& fragment = quote_fragments_[snapshot.index];
+            if (fragment.bytes) {
+                fragments[i] = fragment.bytes;
+                snapshot.version = fragment.version;
+                ++used;
+            }
+        }
+        quote_fragments_used_.fetch_add(used, std::memory_order_relaxed);
+    }
     
-    // 开始构建JSON: { "aid": "rtn_data", "data": [ ... ] }
-    writer.StartObject();
+    // 订阅集合、字段投影和各合约版本都相同的session收到的全量帧逐字节相同，只序列化一次，共享同一缓冲
+    std::vector<std::pair<int, uint64_t>> versions;
+    versions.reserve(updates.size());
+    uint64_t key = (14695981039346656037ULL ^ field_mask) * 1099511628211ULL;
+    for (const auto& entry : updates) {
+        versions.emplace_back(entry.second.index, entry.second.version);
+        key = (key ^ static_cast<uint32_t>(entry.second.index)) * 1099511628211ULL;
+    }
     
-    writer.Key("aid");
-    writer.String("rtn_data");
+    std::vector<FrameBufferPtr> frames;
+    {
+        std::lock_guard<std::mutex> lock(shared_full_snapshots_mutex_);
+        auto it = shared_full_snapshots_.find(key);
+        if (it != shared_full_snapshots_.end() && it->second.field_mask == field_mask &&
+            it->second.versions == versions) {
+            it->second.last_used = ++shared_full_snapshot_clock_;
+            frames = it->second.frames;
+        }
+    }
     
-    writer.Key("data");
-    writer.StartArray();
+    // session 的版本在发送前记录：分块发送期间该session的peek会等到最后一块发出后再处理
+    update_session_state(session->get_session_id(), updates);
     
-    // Data Object 1: Quotes
-    writer.StartObject();
-    writer.Key("quotes");
-    writer.StartObject();
+    if (!frames.empty()) {
+        shared_full_snapshot_hits_.fetch_add(1, std::memory_order_relaxed);
+        for (auto& frame : frames) {
+            session->send_frame(OutboundFrame{std::move(frame)}, true);
+        }
+        return;
+    }
     
-    for (const auto& entry : updates) {
-        const auto& instrument_id = entry.first;
-        const auto& cached_data = entry.second;
+    auto stream = std::make_shared<SnapshotStream>();
+    stream->session = std::move(session);
+    stream->updates = std::move(updates);
+    stream->fragments = std::move(fragments);
+    stream->field_mask = field_mask;
+    stream->key = key;
+    stream->versions = std::move(versions);
+    continue_snapshot_stream(stream);
+}
+
+void MarketDataServer::continue_snapshot_stream(const std::shared_ptr<SnapshotStream>& stream)
+{
+    WebSocketSession& session = *stream->session;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        if (sessions_.find(session.get_session_id()) == sessions_.end()) {
+            session.end_snapshot_stream();
+            return;  // session 已断开
+        }
+    }
+    
+    // 每轮只写出一块（不超过 snapshot_chunk_bytes），其余留到io线程处理完其它session的事件之后
+    const size_t chunk_bytes = multi_ctp_config_.snapshot_chunk_bytes > 0
+        ? static_cast<size_t>(multi_ctp_config_.snapshot_chunk_bytes) : std::numeric_limits<size_t>::max();
+    FrameBufferPtr frame;
+    stream->position = build_full_snapshot(frame, stream->updates, stream->position, stream->field_mask,
+                                           stream->fragments, chunk_bytes);
+    stream->frames.push_back(frame);
+    session.send_frame(OutboundFrame{std::move(frame)}, true);
+    
+    if (stream->position < stream->updates.size()) {
+        if (stream->frames.size() == 1) {
+            session.begin_snapshot_stream();
+            chunked_snapshots_.fetch_add(1, std::memory_order_relaxed);
+        }
+        net::post(ioc_, [this, stream]() { continue_snapshot_stream(stream); });
+        return;
+    }
+    
+    shared_full_snapshot_builds_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(shared_full_snapshots_mutex_);
+        if (shared_full_snapshots_.size() >= kMaxSharedFullSnapshots &&
+            shared_full_snapshots_.find(stream->key) == shared_full_snapshots_.end()) {
+            auto oldest = std::min_element(shared_full_snapshots_.begin(), shared_full_snapshots_.end(),
+                [](const auto& a, const auto& b) { return a.second.last_used < b.second.last_used; });
+            shared_full_snapshots_.erase(oldest);
+        }
+        SharedFullSnapshot& shared = shared_full_snapshots_[stream->key];
+        shared.versions = std::move(stream->versions);
+        shared.field_mask = stream->field_mask;
+        shared.frames = std::move(stream->frames);
+        shared.last_used = ++shared_full_snapshot_clock_;
+    }
+    
+    // 分块发送期间收到的peek在最后一块发出后处理
+    if (session.end_snapshot_stream()) {
+        handle_peek_message(session.get_session_id());
+    }
+}
+
+size_t MarketDataServer::build_full_snapshot(
+    FrameBufferPtr& frame,
+    const std::vector<std::pair<std::string, SnapshotData>>& updates, size_t begin,
+    uint64_t field_mask, const std::vector<FrameBufferPtr>& fragments, size_t max_bytes)
+{
+    // 字段投影下只写出投影中全量时有值的字段，不写恒为null的6-10档
+    const uint64_t quote_mask = field_mask == kAllFieldsMask ? kAllFieldsMask : field_mask & md_schema::kSnapshotValueMask;
+
+    // 专用输出器：固定字节整段拷贝，价格定点格式化（与rapidjson::Writer输出一致），直接写入池化缓冲
+    // 预分配：按剩余合约估算，分块时不超过一块（块在超过 max_bytes 后的合约边界结束，多留一个合约的余量）；
+    // 不分块时 max_bytes 为 SIZE_MAX，不能直接加余量
+    const size_t estimate = (updates.size() - begin) * 300;
+    frame = FrameBufferPool::acquire(max_bytes < estimate ? max_bytes + 1024 : estimate);
+    rapidjson::StringBuffer& buffer = frame->data();
+    
+    // { "aid": "rtn_data", "data": [ { "quotes": { ... } }, { meta } ] }
+    QuoteEmitter::begin_rtn_data(buffer);
+    
+    size_t i = begin;
+    for (; i < updates.size() && buffer.GetSize() < max_bytes; ++i) {
+        const auto& instrument_id = updates[i].first;
+        const auto& cached_data = updates[i].second;
+
+        if (!fragments.empty() && fragments[i]) {
+            // 预序列化片段："key":{...}
+            if (i > begin) {
+                buffer.Put(',');
+            }
+            const FrameBuffer& fragment = *fragments[i];
+            memcpy(buffer.Push(fragment.size()), fragment.bytes(), fragment.size());
+            continue;
+        }
 
         // display_instrument 已在 collect_market_data_updates 中设置，无需重复查找
         const std::string& display_instrument = (cached_data.display_instrument == nullptr || cached_data.display_instrument->empty())
             ? instrument_id : *cached_data.display_instrument;
 
-        writer.Key(display_instrument.c_str());
-        struct_to_writer(cached_data.data, writer);  // 直接写入Writer
+        QuoteEmitter::write_quote(buffer, display_instrument, i == begin, cached_data.data, quote_mask,
+                                  cached_data.price_decimals);
     }
 
-    writer.EndObject(); // End quotes
-    writer.EndObject(); // End Data Object 1
-
-    // Data Object 2: Meta
-    writer.StartObject();
-    writer.Key("account_id"); writer.String("");
-    writer.Key("ins_list"); writer.String("");
-    writer.Key("mdhis_more_data"); writer.Bool(false);
-    writer.EndObject();
-
-    writer.EndArray(); // End data array
-    writer.EndObject(); // End root object
-
-    session->send_message(buffer.GetString());
+    QuoteEmitter::end_rtn_data(buffer);
+    frame->seal();
+    return i;
 }
 
 size_t MarketDataServer::send_diff_snapshot(
     std::shared_ptr<WebSocketSession> session, 
     const std::vector<std::pair<std::string, SnapshotData>>& updates,
-    const std::unordered_map<std::string, MarketDataStruct>& last_snapshots)
-{
-    // 优化：合并两次遍历，缓存查找结果，避免重复查找
-    // 存储需要发送的diff数据及其对应的旧数据指针
-    struct DiffEntry {
-        const std::string* instrument_id;
-        const SnapshotData* snapshot_data;
-        const MarketDataStruct* old_data;  // nullptr表示新增合约
-    };
+    uint64_t field_mask)
+{
+    // updates 中的合约已经通过版本号筛选（current_version > last_version），
+    // changed_mask 为该session跳过的各版本变化掩码之并
+    if (updates.empty()) return 0;
+
+    // 池化缓冲，估算大小：每个合约约200-500字节
+    FrameBufferPtr frame = FrameBufferPool::acquire(updates.size() * 300);
+    rapidjson::StringBuffer& buffer = frame->data();
     
-    std::vector<DiffEntry> diff_entries;
-    diff_entries.reserve(updates.size());
+    // { "aid": "rtn_data", "data": [ { "quotes": { ... } }, { meta } ] }
+    QuoteEmitter::begin_rtn_data(buffer);
     
-    // 第一次遍历：筛选需要发送的合约，并缓存查找结果
-    // 注意：updates中的合约已经通过版本号筛选（current_version > last_version），
-    // 所以版本号不同 = 数据已更新，无需再调用 has_struct_changes 检查
+    size_t count = 0;
     for (const auto& entry : updates) {
         const auto& instrument_id = entry.first;
         const auto& cached_data = entry.second;
         
-        auto old_it = last_snapshots.find(instrument_id);
-        if (old_it != last_snapshots.end()) {
-            // 版本号已不同，直接加入（无需 has_struct_changes 检查）
-            diff_entries.push_back({&instrument_id, &cached_data, &old_it->second});
-        } else {
-            // 新增合约
-            diff_entries.push_back({&instrument_id, &cached_data, nullptr});
+        // changed_mask 为 kAllFieldsMask（新增合约或超出掩码历史）时写全量，否则只写变化的字段；
+        // 有字段投影时只写投影中的字段
+        uint64_t quote_mask = cached_data.changed_mask;
+        if (field_mask != kAllFieldsMask) {
+            quote_mask = quote_mask == kAllFieldsMask ? field_mask & md_schema::kSnapshotValueMask
+                                                      : quote_mask & field_mask;
+            if (quote_mask == 0) {
+                continue;
+            }
         }
-    }
-    
-    if (diff_entries.empty()) return 0;
-
-    // 预分配StringBuffer，估算大小：每个合约约200-500字节
-    rapidjson::StringBuffer buffer;
-    buffer.Reserve(diff_entries.size() * 300);
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-    
-    // 开始构建JSON: { "aid": "rtn_data", "data": [ ... ] }
-    writer.StartObject();
-    
-    writer.Key("aid");
-    writer.String("rtn_data");
-    
-    writer.Key("data");
-    writer.StartArray();
-    
-    // Data Object 1: Quotes
-    writer.StartObject();
-    writer.Key("quotes");
-    writer.StartObject();
-    
-    bool has_content = false;
-
-    // 第二次遍历：直接使用缓存的查找结果构建JSON
-    for (const auto& diff_entry : diff_entries) {
-        const auto& instrument_id = *diff_entry.instrument_id;
-        const auto& cached_data = *diff_entry.snapshot_data;
         
         // display_instrument 已在 collect_market_data_updates 中设置，无需重复查找
         const std::string& display_instrument = (cached_data.display_instrument == nullptr || cached_data.display_instrument->empty()) 
             ? instrument_id : *cached_data.display_instrument;
         
-        if (diff_entry.old_data != nullptr) {
-            // 计算 Diff 并直接写入 Writer（使用缓存的旧数据指针）
-            writer.Key(display_instrument.c_str());
-            compute_struct_diff(*diff_entry.old_data, cached_data.data, writer);
-            has_content = true;
-        } else {
-            // 全量 - 使用Writer模式（优化：避免DOM构建）
-            writer.Key(display_instrument.c_str());
-            struct_to_writer(cached_data.data, writer);
-            has_content = true;
-        }
+        QuoteEmitter::write_quote(buffer, display_instrument, count == 0, cached_data.data, quote_mask,
+                                  cached_data.price_decimals);
+        ++count;
     }
     
-    writer.EndObject(); // End quotes
-    writer.EndObject(); // End Data Object 1
-
-    // Data Object 2: Meta
-    writer.StartObject();
-    writer.Key("account_id"); writer.String("");
-    writer.Key("ins_list"); writer.String("");
-    writer.Key("mdhis_more_data"); writer.Bool(false);
-    writer.EndObject();
-    
-    writer.EndArray(); // End data array
-    writer.EndObject(); // End root object
-    
-    // 如果没有实际内容（理论上 diff_entries 不空就不会发生，除非 compute_struct_diff 全空）
-    if (has_content) {
-        session->send_message(buffer.GetString());
-    } else {
-        std::lock_guard<std::mutex> lock(pending_peek_mutex_);
-        pending_peek_sessions_.insert(session->get_session_id());
+    if (count == 0) {
+        return 0;
     }
     
-    return diff_entries.size();
+    QuoteEmitter::end_rtn_data(buffer);
+    frame->seal();
+    
+    session->send_frame(OutboundFrame{std::move(frame)}, true);
+    return count;
 }
 
 void MarketDataServer::update_session_state(
     const std::string& session_id, 
-    const std::vector<std::pair<std::string, SnapshotData>>& updates)
+    const std::vector<std::pair<std::string, SnapshotData>>& updates,
+    bool sent)
 {
     std::lock_guard<std::mutex> lock(session_last_sent_mutex_);
     
-    // 再次检查 session 是否存在，可能在处理过程中被删除
-    auto struct_it = session_last_sent_structs_.find(session_id);
-    if (struct_it == session_last_sent_structs_.end()) {
-        session_last_sent_structs_[session_id] = std::unordered_map<std::string, MarketDataStruct>();
-        struct_it = session_last_sent_structs_.find(session_id);
-    }
-    
-    auto& snapshot_structs = struct_it->second;
     auto& version_map = session_last_versions_[session_id];
+    if (!sent) {
+        for (const auto& entry : updates) {
+            version_map[entry.first] = entry.second.version;
+        }
+        return;
+    }
     
+    // 每帧都应答一次peek，通常发送时上一帧已确认；未确认时 emplace 保留同一合约第一次发送前的版本
+    auto& unacked = session_unacked_versions_[session_id];
     for (const auto& entry : updates) {
-        const auto& instrument_id = entry.first;
-        const auto& cached_data = entry.second;
-        snapshot_structs[instrument_id] = cached_data.data;
-        version_map[instrument_id] = cached_data.version;
+        auto ver_it = version_map.find(entry.first);
+        const uint64_t previous = ver_it != version_map.end() ? ver_it->second : 0;
+        unacked.emplace(entry.first, previous);
+        version_map[entry.first] = entry.second.version;
     }
 }
 
@@ -1714,12 +1909,152 @@ void MarketDataServer::notify_pending_sessions(const std::string& instrument_id)
     }
     
     // 唤醒这些session，触发数据推送
-    for (const auto& session_id : sessions_to_notify) {
-        log_info("Waking up pending session: " + session_id + " due to market data update: " + instrument_id);
-        handle_peek_message(session_id);  // 重新处理peek_message
+    FLOG_DEBUG("Waking up {} pending sessions due to market data update: {}", sessions_to_notify.size(), instrument_id);
+    wake_sessions(std::vector<std::string>(sessions_to_notify.begin(), sessions_to_notify.end()));
+}
+
+void MarketDataServer::wake_sessions(const std::vector<std::string>& session_ids)
+{
+    if (session_ids.size() == 1) {
+        handle_peek_message(session_ids.front());  // 重新处理peek_message
+        return;
+    }
+    
+    // 优先级高的session先处理，同优先级保持原顺序
+    std::vector<std::pair<int, const std::string*>> ordered;
+    ordered.reserve(session_ids.size());
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        for (const auto& session_id : session_ids) {
+            auto it = sessions_.find(session_id);
+            if (it != sessions_.end()) {
+                ordered.emplace_back(it->second->throttle().priority(), &session_id);
+            }
+        }
+    }
+    std::stable_sort(ordered.begin(), ordered.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    for (const auto& entry : ordered) {
+        handle_peek_message(*entry.second);
+    }
+}
+
+void MarketDataServer::defer_peek(const std::string& session_id, int64_t now_ms, int64_t due_ms)
+{
+    if (!deferred_peeks_.schedule(session_id, now_ms, due_ms)) {
+        return;
+    }
+    throttled_peeks_.fetch_add(1, std::memory_order_relaxed);
+    
+    if (!throttle_timer_armed_) {
+        throttle_timer_armed_ = true;
+        throttle_timer_.expires_after(std::chrono::milliseconds(DeferredPeekWheel::kTickMs));
+        throttle_timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (!ec) {
+                on_throttle_tick();
+            }
+        });
     }
 }
 
+void MarketDataServer::on_throttle_tick()
+{
+    std::vector<std::string> due;
+    deferred_peeks_.collect_due(SessionThrottle::now_ms(), due);
+    
+    if (deferred_peeks_.empty() && due.empty()) {
+        throttle_timer_armed_ = false;
+        return;
+    }
+    
+    // 先续期定时器：唤醒的session仍被节流时会重新加入时间轮
+    throttle_timer_.expires_after(std::chrono::milliseconds(DeferredPeekWheel::kTickMs));
+    throttle_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (!ec) {
+            on_throttle_tick();
+        }
+    });
+    
+    if (!due.empty()) {
+        wake_sessions(due);
+    }
+}
+
+void MarketDataServer::snapshot_refresh_loop()
+{
+    const auto interval = std::chrono::milliseconds(multi_ctp_config_.snapshot_refresh_ms);
+    std::unique_lock<std::mutex> lock(snapshot_thread_mutex_);
+    while (!snapshot_thread_stop_) {
+        lock.unlock();
+        refresh_quote_fragments();
+        lock.lock();
+        snapshot_thread_cv_.wait_for(lock, interval, [this]() { return snapshot_thread_stop_; });
+    }
+}
+
+void MarketDataServer::refresh_quote_fragments()
+{
+    size_t count = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_map_mutex_);
+        count = instrument_index_map_.size();
+    }
+    
+    std::vector<uint64_t> fragment_versions(count);
+    {
+        std::lock_guard<std::mutex> lock(quote_fragments_mutex_);
+        for (size_t index = 0; index < count; ++index) {
+            fragment_versions[index] = quote_fragments_[index].version;
+        }
+    }
+    
+    // 锁外序列化版本有变化的合约，最后一次性替换
+    std::vector<std::pair<size_t, QuoteFragment>> refreshed;
+    for (size_t index = 0; index < count; ++index) {
+        AtomicMarketDataEntry& entry = market_data_cache_[index];
+        if (!entry.has_data) continue;
+        
+        const uint64_t seq_start = entry.sequence.load(std::memory_order_acquire);
+        if (seq_start % 2 != 0 || seq_start / 2 == fragment_versions[index]) {
+            continue;  // 正在更新（下一轮再刷新）或片段已是最新
+        }
+        const MarketDataStruct data = entry.data;
+        if (entry.sequence.load(std::memory_order_acquire) != seq_start) {
+            continue;
+        }
+        
+        QuoteFragment fragment;
+        fragment.version = seq_start / 2;
+        fragment.bytes = FrameBufferPool::acquire();
+        QuoteEmitter::write_quote(fragment.bytes->data(), display_instruments_cache_[index], true, data,
+                                  kAllFieldsMask, price_decimals_cache_[index]);
+        fragment.bytes->seal();
+        refreshed.emplace_back(index, std::move(fragment));
+    }
+    
+    if (refreshed.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(quote_fragments_mutex_);
+        for (auto& item : refreshed) {
+            quote_fragments_[item.first] = std::move(item.second);
+        }
+    }
+    quote_fragments_built_.fetch_add(refreshed.size(), std::memory_order_relaxed);
+}
+
+const SessionPolicy* MarketDataServer::find_session_policy(const std::string& name) const
+{
+    for (const auto& policy : multi_ctp_config_.session_policies) {
+        if (policy.name == name) {
+            return &policy;
+        }
+    }
+    return nullptr;
+}
+
 void MarketDataServer::send_to_session(const std::string& session_id, const std::string& message)
 {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
@@ -1799,6 +2134,7 @@ bool MarketDataServer::init_multi_ctp_system()
         
         // 创建连接管理器
         connection_manager_ = std::make_unique<CTPConnectionManager>(this, subscription_dispatcher_.get());
+        connection_manager_->configure(multi_ctp_config_);
         
         // 初始化订阅分发器
         if (!subscription_dispatcher_->initialize(connection_manager_.get(), multi_ctp_config_)) {
@@ -1806,6 +2142,11 @@ bool MarketDataServer::init_multi_ctp_system()
             return false;
         }
         
+        // 启动预订阅：在连接启动前登记，连接登录后按容量批量下发
+        if (multi_ctp_config_.preload_source != "none") {
+            subscription_dispatcher_->preload_subscriptions(load_preload_instruments());
+        }
+        
         // 添加所有连接配置
         for (const auto& conn_config : multi_ctp_config_.connections) {
             if (conn_config.enabled) {
@@ -1820,7 +2161,7 @@ bool MarketDataServer::init_multi_ctp_system()
             }
         }
         
-        // 启动所有连接
+        // 启动所有连接（并发、非阻塞，达到 startup_quorum 时输出就绪日志）
         if (!connection_manager_->start_all_connections()) {
             log_warning("Some CTP connections failed to start");
         }
@@ -1835,6 +2176,58 @@ bool MarketDataServer::init_multi_ctp_system()
     }
 }
 
+std::vector<std::string> MarketDataServer::load_preload_instruments()
+{
+    // 合约统一转为CTP格式（去掉交易所前缀），并登记显示名映射
+    std::vector<std::string> instruments;
+    auto add_instrument = [this, &instruments](const std::string& instrument) {
+        std::string nohead_instrument = instrument;
+        size_t dot_pos = instrument.find('.');
+        if (dot_pos != std::string::npos) {
+            nohead_instrument = instrument.substr(dot_pos + 1);
+        }
+        if (nohead_instrument.empty()) {
+            return;
+        }
+        noheadtohead_instruments_map_.emplace(nohead_instrument, instrument);
+        instruments.push_back(nohead_instrument);
+    };
+    
+    if (multi_ctp_config_.preload_source == "shm") {
+        if (!ins_map_) {
+            log_warning("Preload source is shm but InsMap is not available");
+            return instruments;
+        }
+        for (auto it = ins_map_->begin(); it != ins_map_->end(); ++it) {
+            // 跳过已到期合约和组合合约
+            if (it->second.expired || (it->second.product_class & kProductClassCombination)) {
+                continue;
+            }
+            std::string key(it->first.data());
+            key.erase(std::find(key.begin(), key.end(), '\0'), key.end());
+            add_instrument(key);
+        }
+    } else if (multi_ctp_config_.preload_source == "file") {
+        std::ifstream file(multi_ctp_config_.preload_file);
+        if (!file.is_open()) {
+            log_warning("Failed to open preload file: " + multi_ctp_config_.preload_file);
+            return instruments;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') {
+                add_instrument(line);
+            }
+        }
+    }
+    
+    log_info("Loaded " + std::to_string(instruments.size()) + " instruments for preload from " +
+             (multi_ctp_config_.preload_source == "file" ? multi_ctp_config_.preload_file : std::string("InsMap")));
+    return instruments;
+}
+
 void MarketDataServer::cleanup_multi_ctp_system()
 {
     if (connection_manager_) {
@@ -1877,11 +2270,38 @@ size_t MarketDataServer::get_active_connections_count() const
     return ctp_logged_in_ ? 1 : 0;
 }
 
+size_t MarketDataServer::get_websocket_coalesce_max_bytes() const
+{
+    // 全量分块时合并上限不超过块大小，否则排队的相邻块会在写出时重新拼成一条大消息
+    const size_t coalesce_max_bytes = static_cast<size_t>(multi_ctp_config_.websocket_coalesce_max_bytes);
+    if (multi_ctp_config_.snapshot_chunk_bytes > 0) {
+        return std::min(coalesce_max_bytes, static_cast<size_t>(multi_ctp_config_.snapshot_chunk_bytes));
+    }
+    return coalesce_max_bytes;
+}
+
+void MarketDataServer::record_websocket_flush(size_t frames)
+{
+    websocket_flushes_.fetch_add(1, std::memory_order_relaxed);
+    websocket_flushed_frames_.fetch_add(frames, std::memory_order_relaxed);
+    uint64_t max_frames = websocket_max_frames_per_flush_.load(std::memory_order_relaxed);
+    while (frames > max_frames &&
+           !websocket_max_frames_per_flush_.compare_exchange_weak(max_frames, frames, std::memory_order_relaxed)) {
+    }
+}
+
 std::vector<std::string> MarketDataServer::get_connection_status() const
 {
     std::vector<std::string> status_list;
     
     if (use_multi_ctp_mode_ && connection_manager_) {
+        std::map<std::string, ConnectionLoadSnapshot> loads;
+        if (subscription_dispatcher_) {
+            for (const auto& snapshot : subscription_dispatcher_->get_connection_load_snapshot()) {
+                loads[snapshot.connection_id] = snapshot;
+            }
+        }
+        
         auto connections = connection_manager_->get_all_connections();
         for (const auto& conn : connections) {
             std::string status = conn->get_connection_id() + ": ";
@@ -1895,9 +2315,17 @@ std::vector<std::string> MarketDataServer::get_connection_status() const
                 case CTPConnectionStatus::CONNECTED:
                     status += "CONNECTED";
                     break;
-                case CTPConnectionStatus::LOGGED_IN:
-                    status += "LOGGED_IN (" + std::to_string(conn->get_subscription_count()) + " subs)";
+                case CTPConnectionStatus::LOGGED_IN: {
+                    status += "LOGGED_IN (" + std::to_string(conn->get_subscription_count()) + " subs";
+                    auto load_it = loads.find(conn->get_connection_id());
+                    if (load_it != loads.end()) {
+                        status += ", latency " + std::to_string(load_it->second.latency_ms) + " ms" +
+                                  ", " + std::to_string(load_it->second.tick_rate) + " ticks/s" +
+                                  ", " + std::to_string(load_it->second.duplicates_suppressed) + " duplicates suppressed";
+                    }
+                    status += ")";
                     break;
+                }
                 case CTPConnectionStatus::ERROR:
                     status += "ERROR";
                     break;
@@ -1916,5 +2344,39 @@ std::vector<std::string> MarketDataServer::get_connection_status() const
         status_list.push_back(status);
     }
     
+    const uint64_t flushes = websocket_flushes_.load(std::memory_order_relaxed);
+    if (flushes > 0) {
+        const uint64_t frames = websocket_flushed_frames_.load(std::memory_order_relaxed);
+        std::ostringstream oss;
+        oss << "websocket_writes: " << frames << " frames in " << flushes << " flushes"
+            << ", avg " << std::fixed << std::setprecision(2) << static_cast<double>(frames) / flushes
+            << " frames/flush, max " << websocket_max_frames_per_flush_.load(std::memory_order_relaxed);
+        status_list.push_back(oss.str());
+    }
+    
+    const uint64_t resumed = resumed_sessions_.load(std::memory_order_relaxed);
+    if (resumed > 0) {
+        status_list.push_back("session_resume: " + std::to_string(resumed) + " sessions resumed");
+    }
+    
+    const uint64_t throttled = throttled_peeks_.load(std::memory_order_relaxed);
+    if (throttled > 0) {
+        status_list.push_back("session_policies: " + std::to_string(throttled) + " peeks deferred");
+    }
+    
+    const uint64_t fragments_built = quote_fragments_built_.load(std::memory_order_relaxed);
+    if (fragments_built > 0) {
+        status_list.push_back("quote_fragments: " + std::to_string(fragments_built) + " built, " +
+                              std::to_string(quote_fragments_used_.load(std::memory_order_relaxed)) +
+                              " used in full snapshots");
+    }
+    
+    const uint64_t shared_builds = shared_full_snapshot_builds_.load(std::memory_order_relaxed);
+    if (shared_builds > 0) {
+        status_list.push_back("full_snapshots: " + std::to_string(shared_builds) + " built, " +
+                              std::to_string(shared_full_snapshot_hits_.load(std::memory_order_relaxed)) + " shared, " +
+                              std::to_string(chunked_snapshots_.load(std::memory_order_relaxed)) + " chunked");
+    }
+    
     return status_list;
 }
\ No newline at end of file
@@ -15,6 +15,8 @@
 #include <string>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <queue>
 #include <array>
 #include <unordered_map>
@@ -22,46 +24,22 @@
 #include "ctp_connection_manager.h"
 #include "subscription_dispatcher.h"
 #include "multi_ctp_config.h"
+#include "market_data_schema.h"
+#include "quote_emitter.h"
+#include "frame_buffer.h"
+#include "session_throttle.h"
 
 using TcpSocket = boost::asio::ip::tcp::socket;
 
-struct MarketDataStruct {
-    char instrument_id[32];
-    char datetime[32];
-    uint64_t timestamp;
-    
-    double ask_price[10];
-    int ask_volume[10];
-    double bid_price[10];
-    int bid_volume[10];
-    
-    double last_price;
-    double highest;
-    double lowest;
-    double open;
-    double close;
-    double average;
-    int volume;
-    double amount;
-    int64_t open_interest;
-    double settlement;
-    double upper_limit;
-    double lower_limit;
-    int64_t pre_open_interest;
-    double pre_settlement;
-    double pre_close;
-
-    // Flags to indicate validity of fields (since we need to handle nulls/-)
-    // Using a simple convention: 
-    // Prices: > 1e-6 && < 1e300 is valid.
-    // Close/Settlement: checks against 1e300.
-};
+constexpr size_t kChangeMaskHistory = 32;           // 每个合约保留的最近版本变化掩码数
 
 // 内存对齐的原子行情缓存条目（SeqLock模式）
 struct alignas(64) AtomicMarketDataEntry {
     std::atomic<uint64_t> sequence{0}; // 序列号（偶数=有效，奇数=更新中）
     MarketDataStruct data;
     bool has_data = false;
+    // change_masks[v % kChangeMaskHistory]：版本 v 相对版本 v-1 变化的字段（与 data 一起在SeqLock内写入）
+    std::array<uint64_t, kChangeMaskHistory> change_masks{};
     
     AtomicMarketDataEntry() = default;
 
@@ -70,6 +48,7 @@ struct alignas(64) AtomicMarketDataEntry {
         sequence.store(other.sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
         data = other.data;
         has_data = other.has_data;
+        change_masks = other.change_masks;
     }
 
     // 移动构造函数
@@ -77,6 +56,7 @@ struct alignas(64) AtomicMarketDataEntry {
         sequence.store(other.sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
         data = other.data;
         has_data = other.has_data;
+        change_masks = other.change_masks;
     }
 
     AtomicMarketDataEntry& operator=(const AtomicMarketDataEntry& other) {
@@ -84,6 +64,7 @@ struct alignas(64) AtomicMarketDataEntry {
             sequence.store(other.sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
             data = other.data;
             has_data = other.has_data;
+            change_masks = other.change_masks;
         }
         return *this;
     }
@@ -99,17 +80,33 @@ public:
     ~WebSocketSession();
     
     void run();
+    // 拷贝到池化缓冲后发送（冷路径的响应）
     void send_message(const std::string& message);
+    // 发送已seal的片段，片段按顺序拼成一条消息，可与其它session共享
+    // rtn_data 为 true 表示该帧由 QuoteEmitter::begin_rtn_data/end_rtn_data 包围，写出时可与相邻 rtn_data 帧合并
+    void send_frame(OutboundFrame frame, bool rtn_data = false);
     void close();
     
     std::string get_session_id() const { return session_id_; }
+    const std::string& get_resume_token() const { return resume_token_; }
     const std::set<std::string>& get_subscriptions() const { return subscriptions_; }
+    // 字段投影（MarketDataField 位），kAllFieldsMask 表示不投影
+    uint64_t get_field_mask() const { return field_mask_.load(std::memory_order_relaxed); }
+    SessionThrottle& throttle() { return throttle_; }
+    
+    // 分块发送全量期间（io线程）：peek_message 只确认了部分块，推迟到最后一块发出后处理
+    void begin_snapshot_stream() { snapshot_streaming_ = true; }
+    // 正在分块发送全量时记下这次peek并返回 true
+    bool defer_peek_while_streaming();
+    // 结束分块发送，返回期间是否收到过peek
+    bool end_snapshot_stream();
     
 private:
     void on_accept(boost::beast::error_code ec);
     void do_read();
     void on_read(boost::beast::error_code ec, std::size_t bytes_transferred);
     void start_write();
+    void append_rtn_data(const OutboundFrame& frame, bool first);
     void on_write(boost::beast::error_code ec, std::size_t bytes_transferred);
     
     void handle_message(const std::string& message);
@@ -117,14 +114,32 @@ private:
     void send_response(const std::string& type, const rapidjson::Document& data);
     
     boost::beast::websocket::stream<boost::beast::tcp_stream> ws_;
+    struct QueuedFrame {
+        OutboundFrame fragments;
+        bool rtn_data;
+    };
+    
+    // 单次写出最多合并的 rtn_data 帧数
+    static constexpr size_t kMaxFramesPerFlush = 64;
+    
     boost::beast::flat_buffer buffer_;
-    std::queue<std::string> message_queue_;
-    std::string current_write_message_;
+    std::deque<QueuedFrame> message_queue_;
+    std::vector<OutboundFrame> writing_frames_;                 // 写出中的帧，写完前保持片段引用
+    std::vector<boost::asio::const_buffer> write_buffers_;      // writing_frames_ 的分散-聚集缓冲
+    size_t coalesce_max_bytes_;                                 // 合并写出的消息大小上限，0 表示不合并
+    uint64_t flush_count_ = 0;                                  // async_write 次数
+    uint64_t flushed_frames_ = 0;                               // 写出的帧数（合并前）
     std::string session_id_;
+    std::string resume_token_;                                  // 断线重连时凭此恢复已确认的版本，空表示未启用
     std::set<std::string> subscriptions_;
+    std::atomic<uint64_t> field_mask_{kAllFieldsMask};          // subscribe_quote 的 fields 列表
+    SessionThrottle throttle_;                                  // 推送策略（限频、带宽、优先级）
+    bool snapshot_streaming_ = false;                           // 全量帧尚未发完最后一块
+    bool peek_during_stream_ = false;                           // 分块发送期间收到的peek_message
     MarketDataServer* server_;
     std::mutex write_mutex_;
     bool is_writing_;
+    bool write_failed_ = false;                                 // 写出出错后丢弃后续消息，会话随读出错关闭
 };
 
 // CTP行情SPI回调实现
@@ -173,11 +188,21 @@ public:
     void remove_session(const std::string& session_id);
     void subscribe_instrument(const std::string& session_id, const std::string& instrument_id);
     void unsubscribe_instrument(const std::string& session_id, const std::string& instrument_id);
+    // 字段投影新增了字段时清除该session的已发送版本，下一次peek按新投影推送全量
+    void on_session_field_mask_changed(const std::string& session_id, uint64_t old_mask, uint64_t new_mask);
+    
+    // 会话恢复：peek_message 确认此前发送的行情已被客户端处理；断线会话的已确认版本按token保留一段时间
+    std::string create_resume_token();
+    void acknowledge_session(const std::string& session_id);
+    // 以token恢复断线会话的已确认版本到新session，返回原订阅和字段投影；token无效或已过期时返回false
+    bool resume_session(const std::string& session_id, const std::string& token,
+                        std::set<std::string>& subscriptions, uint64_t& field_mask);
     
     // 行情数据推送
     void send_to_session(const std::string& session_id, const std::string& message);
     void handle_peek_message(const std::string& session_id);
-    void cache_market_data(const std::string& instrument_id, const MarketDataStruct& data, const std::string& display_instrument);
+    // 写入行情缓存；与缓存内容完全相同的重发快照不更新版本号、不唤醒session，返回 false
+    bool cache_market_data(const std::string& instrument_id, const MarketDataStruct& data, const std::string& display_instrument);
     void on_component_update(const std::string& component_id, const MarketDataStruct& market_data);
     
     
@@ -194,13 +219,12 @@ public:
     template<typename Writer>
     static void struct_to_writer(const MarketDataStruct& data, Writer& writer);
     
-    // 快速检查结构体是否有差异（避免无差异时构建JSON）
-    static bool has_struct_changes(const MarketDataStruct& old_data, const MarketDataStruct& new_data);
+    // 字段级变化掩码（MarketDataField 位），入缓存时计算一次，所有session共用
+    static uint64_t compute_change_mask(const MarketDataStruct& old_data, const MarketDataStruct& new_data);
     
-    // 结构体字段级比较，直接写入Writer（SAX模式优化）
-    static void compute_struct_diff(const MarketDataStruct& old_data,
-                                   const MarketDataStruct& new_data,
-                                   rapidjson::Writer<rapidjson::StringBuffer>& writer);
+    // 只写出掩码中标记的字段（SAX模式）
+    static void write_changed_fields(const MarketDataStruct& data, uint64_t mask,
+                                     rapidjson::Writer<rapidjson::StringBuffer>& writer);
 
     // 合约管理
     std::vector<std::string> get_all_instruments();
@@ -212,6 +236,14 @@ public:
     size_t get_active_connections_count() const;
     std::vector<std::string> get_connection_status() const;
     
+    const MultiCTPConfig& get_config() const { return multi_ctp_config_; }
+    // 按名称查找会话推送策略，未配置时返回nullptr
+    const SessionPolicy* find_session_policy(const std::string& name) const;
+    
+    // WebSocket写出统计：每次 async_write 记录本次合并写出的帧数
+    size_t get_websocket_coalesce_max_bytes() const;
+    void record_websocket_flush(size_t frames);
+    
     // 多连接管理接口
     CTPConnectionManager* get_connection_manager() { return connection_manager_.get(); }
     SubscriptionDispatcher* get_subscription_dispatcher() { return subscription_dispatcher_.get(); }
@@ -219,6 +251,8 @@ public:
     // 获取服务器状态信息
     rapidjson::Document get_server_status_json();
     void notify_pending_sessions(const std::string& instrument_id);
+    // 按会话策略优先级依次处理等待推送的session
+    void wake_sessions(const std::vector<std::string>& session_ids);
     
     boost::asio::io_context& io_context() { return ioc_; }
 
@@ -233,8 +267,10 @@ private:
         MarketDataStruct data;
         const std::string* display_instrument = nullptr;
         uint64_t version = 0;
+        uint64_t changed_mask = kAllFieldsMask;  // 相对session上次发送版本变化的字段
         bool has_data = false;
         int index = -1;  // 用于批量获取display_instrument
+        uint8_t price_decimals = QuoteEmitter::kDefaultPriceDecimals;
     };
 
     // handle_peek_message 的辅助函数
@@ -242,18 +278,44 @@ private:
         const std::set<std::string>& subscriptions, 
         const std::unordered_map<std::string, uint64_t>& last_versions);
         
+    // 使用预序列化片段时把 updates 中的版本改为片段的版本（之后的peek以增量补齐）
     void send_full_snapshot(
         std::shared_ptr<WebSocketSession> session, 
-        const std::vector<std::pair<std::string, SnapshotData>>& updates);
+        std::vector<std::pair<std::string, SnapshotData>>& updates,
+        uint64_t field_mask);
+    // 分块发送中的全量帧：每个io轮次写出一块，块与块之间io线程可以处理其它session
+    struct SnapshotStream {
+        std::shared_ptr<WebSocketSession> session;
+        std::vector<std::pair<std::string, SnapshotData>> updates;
+        std::vector<FrameBufferPtr> fragments;
+        uint64_t field_mask = kAllFieldsMask;
+        size_t position = 0;                      // 下一块的起始合约
+        std::vector<FrameBufferPtr> frames;       // 已写出的块，发完后放入共享全量缓存
+        uint64_t key = 0;
+        std::vector<std::pair<int, uint64_t>> versions;
+    };
+    void continue_snapshot_stream(const std::shared_ptr<SnapshotStream>& stream);
+    // 从 updates[begin] 起写出一块完整的 rtn_data 帧，超过 max_bytes 后在合约边界结束，返回下一块的起始合约
+    // fragments 非空时与 updates 一一对应，有片段的合约直接拷贝片段字节
+    size_t build_full_snapshot(FrameBufferPtr& frame,
+                               const std::vector<std::pair<std::string, SnapshotData>>& updates, size_t begin,
+                               uint64_t field_mask, const std::vector<FrameBufferPtr>& fragments, size_t max_bytes);
+    
+    // 后台预序列化：定期把版本有变化的合约重新写成全量片段
+    void snapshot_refresh_loop();
+    void refresh_quote_fragments();
         
+    // 返回实际写出的合约数；变化的字段都不在 field_mask 中的合约不写出，全部不写出时不发送
     size_t send_diff_snapshot(
         std::shared_ptr<WebSocketSession> session, 
         const std::vector<std::pair<std::string, SnapshotData>>& updates,
-        const std::unordered_map<std::string, MarketDataStruct>& last_snapshots);
+        uint64_t field_mask);
         
+    // sent 为 false 表示版本前移但没有帧发出（变化的字段都不在投影中），不记为待确认
     void update_session_state(
         const std::string& session_id, 
-        const std::vector<std::pair<std::string, SnapshotData>>& updates);
+        const std::vector<std::pair<std::string, SnapshotData>>& updates,
+        bool sent = true);
 
     void init_shared_memory();
     void cleanup_shared_memory();
@@ -264,6 +326,8 @@ private:
     int get_or_create_index(const std::string& instrument_id, const std::string& display_instrument = "");
     // 助手函数：获取现有合约索引（无锁或读锁）
     int get_index(const std::string& instrument_id) const;
+    // 助手函数：从共享内存合约信息查价格小数位数（未找到时按两位）
+    uint8_t lookup_price_decimals(const std::string& display_instrument) const;
 
 public:
     void ctp_login();
@@ -272,6 +336,7 @@ public:
 private:
     bool init_multi_ctp_system();
     void cleanup_multi_ctp_system();
+    std::vector<std::string> load_preload_instruments();
     
     // 兼容性：单连接模式
     std::string ctp_front_addr_;
@@ -289,27 +354,86 @@ private:
     
     // WebSocket服务器
     boost::asio::io_context ioc_;
+    
+    // 被推送策略节流的peek：所有session共用一个时间轮和一个定时器（io线程）
+    void defer_peek(const std::string& session_id, int64_t now_ms, int64_t due_ms);
+    void on_throttle_tick();
+    DeferredPeekWheel deferred_peeks_;
+    boost::asio::steady_timer throttle_timer_{ioc_};
+    bool throttle_timer_armed_ = false;
+    std::atomic<uint64_t> throttled_peeks_{0};
     int websocket_port_;
     boost::asio::ip::tcp::acceptor acceptor_;
     std::map<std::string, std::shared_ptr<WebSocketSession>> sessions_;
     std::map<std::string, std::set<std::string>> instrument_subscribers_; // instrument_id -> session_ids
+    std::atomic<uint64_t> websocket_flushes_{0};
+    std::atomic<uint64_t> websocket_flushed_frames_{0};
+    std::atomic<uint64_t> websocket_max_frames_per_flush_{0};
+    
+    // 共享全量帧：订阅集合、字段投影和各合约版本都相同的全量帧只序列化一次，所有session引用同一缓冲
+    struct SharedFullSnapshot {
+        std::vector<std::pair<int, uint64_t>> versions;  // (合约index, 版本号)，按订阅顺序
+        uint64_t field_mask = kAllFieldsMask;
+        std::vector<FrameBufferPtr> frames;   // 按 snapshot_chunk_bytes 分块，依次发送
+        uint64_t last_used = 0;
+    };
+    static constexpr size_t kMaxSharedFullSnapshots = 16;
+    std::unordered_map<uint64_t, SharedFullSnapshot> shared_full_snapshots_;  // 订阅集合哈希 -> 最近一次全量帧
+    std::mutex shared_full_snapshots_mutex_;
+    uint64_t shared_full_snapshot_clock_ = 0;
+    std::atomic<uint64_t> shared_full_snapshot_hits_{0};
+    std::atomic<uint64_t> shared_full_snapshot_builds_{0};
+    std::atomic<uint64_t> chunked_snapshots_{0};
     
     // --- 优化后的缓存存储 (SeqLock + 扁平数组) ---
     // 预分配的行情缓存
     std::vector<AtomicMarketDataEntry> market_data_cache_;
     // 并行的显示名称数组（写一次，读多次）
     std::vector<std::string> display_instruments_cache_;
+    // 并行的价格小数位数（由共享内存中合约的最小变动价位得出，供行情JSON定点格式化）
+    std::vector<uint8_t> price_decimals_cache_;
+    
+    // 并行的预序列化全量片段（"key":{...}）及其对应的缓存版本，由后台线程刷新
+    struct QuoteFragment {
+        FrameBufferPtr bytes;
+        uint64_t version = 0;
+    };
+    std::vector<QuoteFragment> quote_fragments_;
+    std::mutex quote_fragments_mutex_;
+    std::thread snapshot_thread_;
+    std::mutex snapshot_thread_mutex_;
+    std::condition_variable snapshot_thread_cv_;
+    bool snapshot_thread_stop_ = false;
+    std::atomic<uint64_t> quote_fragments_built_{0};
+    std::atomic<uint64_t> quote_fragments_used_{0};
     
     // InstrumentID 到 索引 的映射
     std::unordered_map<std::string, int> instrument_index_map_;
     mutable std::shared_mutex index_map_mutex_; // 保护映射表和索引分配
     
-    // 客户端上次发送的行情数据快照（使用结构体存储）: session_id -> instrument_id -> MarketDataStruct
-    std::map<std::string, std::unordered_map<std::string, MarketDataStruct>> session_last_sent_structs_;
     // session上次发送的合约版本号: session_id -> instrument_id -> version
+    // 增量内容由缓存条目的变化掩码历史得出，session不再保存已发送的结构体
     std::unordered_map<std::string, std::unordered_map<std::string, uint64_t>> session_last_versions_;
+    // 已发送、客户端尚未以peek_message确认的合约及其第一次发送前的版本（0 表示此前未发送）
+    std::unordered_map<std::string, std::unordered_map<std::string, uint64_t>> session_unacked_versions_;
     std::mutex session_last_sent_mutex_;
     
+    // 断线会话保留的状态：resume token -> 已确认版本、订阅和字段投影
+    struct RetainedSession {
+        std::unordered_map<std::string, uint64_t> versions;
+        std::set<std::string> subscriptions;
+        uint64_t field_mask = kAllFieldsMask;
+        int64_t expire_ms = 0;
+    };
+    std::unordered_map<std::string, RetainedSession> retained_sessions_;
+    std::mutex retained_sessions_mutex_;
+    // 到期清理保留的会话（io线程），没有保留的会话时不挂定时器
+    void arm_retained_sessions_timer();
+    void purge_retained_sessions();
+    boost::asio::steady_timer retained_sessions_timer_{ioc_};
+    bool retained_sessions_timer_armed_ = false;
+    std::atomic<uint64_t> resumed_sessions_{0};
+    
     // 等待行情更新的session集合（挂起的peek_message）
     std::set<std::string> pending_peek_sessions_;
     std::mutex pending_peek_mutex_;
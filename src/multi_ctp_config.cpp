@@ -48,10 +48,190 @@ bool ConfigLoader::load_from_json(const std::string& json_content, MultiCTPConfi
             config.max_retry_count = doc["max_retry_count"].GetInt();
         }
         
+        if (doc.HasMember("unsubscribe_linger_seconds") && doc["unsubscribe_linger_seconds"].IsInt()) {
+            config.unsubscribe_linger_seconds = doc["unsubscribe_linger_seconds"].GetInt();
+        }
+        
+        if (doc.HasMember("snapshot_chunk_bytes") && doc["snapshot_chunk_bytes"].IsInt()) {
+            config.snapshot_chunk_bytes = doc["snapshot_chunk_bytes"].GetInt();
+        }
+        
+        if (doc.HasMember("snapshot_refresh_ms") && doc["snapshot_refresh_ms"].IsInt()) {
+            config.snapshot_refresh_ms = doc["snapshot_refresh_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("session_resume_grace_seconds") && doc["session_resume_grace_seconds"].IsInt()) {
+            config.session_resume_grace_seconds = doc["session_resume_grace_seconds"].GetInt();
+        }
+        
         if (doc.HasMember("auto_failover") && doc["auto_failover"].IsBool()) {
             config.auto_failover = doc["auto_failover"].GetBool();
         }
         
+        if (doc.HasMember("restart_backoff_initial_ms") && doc["restart_backoff_initial_ms"].IsInt()) {
+            config.restart_backoff_initial_ms = doc["restart_backoff_initial_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("restart_backoff_max_ms") && doc["restart_backoff_max_ms"].IsInt()) {
+            config.restart_backoff_max_ms = doc["restart_backoff_max_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("startup_quorum") && doc["startup_quorum"].IsInt()) {
+            config.startup_quorum = doc["startup_quorum"].GetInt();
+        }
+        
+        if (doc.HasMember("websocket_coalesce_max_bytes") && doc["websocket_coalesce_max_bytes"].IsInt()) {
+            config.websocket_coalesce_max_bytes = doc["websocket_coalesce_max_bytes"].GetInt();
+        }
+        
+        if (doc.HasMember("websocket_deflate_enabled") && doc["websocket_deflate_enabled"].IsBool()) {
+            config.websocket_deflate_enabled = doc["websocket_deflate_enabled"].GetBool();
+        }
+        
+        if (doc.HasMember("websocket_deflate_level") && doc["websocket_deflate_level"].IsInt()) {
+            config.websocket_deflate_level = doc["websocket_deflate_level"].GetInt();
+        }
+        
+        if (doc.HasMember("websocket_deflate_window_bits") && doc["websocket_deflate_window_bits"].IsInt()) {
+            config.websocket_deflate_window_bits = doc["websocket_deflate_window_bits"].GetInt();
+        }
+        
+        if (doc.HasMember("websocket_deflate_mem_level") && doc["websocket_deflate_mem_level"].IsInt()) {
+            config.websocket_deflate_mem_level = doc["websocket_deflate_mem_level"].GetInt();
+        }
+        
+        if (doc.HasMember("websocket_deflate_no_context_takeover") && doc["websocket_deflate_no_context_takeover"].IsBool()) {
+            config.websocket_deflate_no_context_takeover = doc["websocket_deflate_no_context_takeover"].GetBool();
+        }
+        
+        if (doc.HasMember("load_balance_strategy") && doc["load_balance_strategy"].IsString()) {
+            config.load_balance_strategy = doc["load_balance_strategy"].GetString();
+        }
+        
+        if (doc.HasMember("exchange_utc_offset_minutes") && doc["exchange_utc_offset_minutes"].IsInt()) {
+            config.exchange_utc_offset_minutes = doc["exchange_utc_offset_minutes"].GetInt();
+        }
+        
+        if (doc.HasMember("load_rebalance_enabled") && doc["load_rebalance_enabled"].IsBool()) {
+            config.load_rebalance_enabled = doc["load_rebalance_enabled"].GetBool();
+        }
+        
+        if (doc.HasMember("load_rebalance_threshold") && doc["load_rebalance_threshold"].IsNumber()) {
+            config.load_rebalance_threshold = doc["load_rebalance_threshold"].GetDouble();
+        }
+        
+        if (doc.HasMember("load_rebalance_max_utilization") && doc["load_rebalance_max_utilization"].IsNumber()) {
+            config.load_rebalance_max_utilization = doc["load_rebalance_max_utilization"].GetDouble();
+        }
+        
+        if (doc.HasMember("load_rebalance_min_rate") && doc["load_rebalance_min_rate"].IsNumber()) {
+            config.load_rebalance_min_rate = doc["load_rebalance_min_rate"].GetDouble();
+        }
+        
+        if (doc.HasMember("load_rebalance_max_moves") && doc["load_rebalance_max_moves"].IsInt()) {
+            config.load_rebalance_max_moves = doc["load_rebalance_max_moves"].GetInt();
+        }
+        
+        if (doc.HasMember("stale_feed_detection") && doc["stale_feed_detection"].IsBool()) {
+            config.stale_feed_detection = doc["stale_feed_detection"].GetBool();
+        }
+        
+        if (doc.HasMember("stale_feed_multiplier") && doc["stale_feed_multiplier"].IsNumber()) {
+            config.stale_feed_multiplier = doc["stale_feed_multiplier"].GetDouble();
+        }
+        
+        if (doc.HasMember("stale_feed_min_ms") && doc["stale_feed_min_ms"].IsInt()) {
+            config.stale_feed_min_ms = doc["stale_feed_min_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("stale_feed_max_ms") && doc["stale_feed_max_ms"].IsInt()) {
+            config.stale_feed_max_ms = doc["stale_feed_max_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("front_probe_enabled") && doc["front_probe_enabled"].IsBool()) {
+            config.front_probe_enabled = doc["front_probe_enabled"].GetBool();
+        }
+        
+        if (doc.HasMember("broker_data_file") && doc["broker_data_file"].IsString()) {
+            config.broker_data_file = doc["broker_data_file"].GetString();
+        }
+        
+        if (doc.HasMember("front_probe_interval") && doc["front_probe_interval"].IsInt()) {
+            config.front_probe_interval = doc["front_probe_interval"].GetInt();
+        }
+        
+        if (doc.HasMember("front_probe_timeout_ms") && doc["front_probe_timeout_ms"].IsInt()) {
+            config.front_probe_timeout_ms = doc["front_probe_timeout_ms"].GetInt();
+        }
+        
+        if (doc.HasMember("front_auto_switch") && doc["front_auto_switch"].IsBool()) {
+            config.front_auto_switch = doc["front_auto_switch"].GetBool();
+        }
+        
+        if (doc.HasMember("front_switch_min_gain_ms") && doc["front_switch_min_gain_ms"].IsNumber()) {
+            config.front_switch_min_gain_ms = doc["front_switch_min_gain_ms"].GetDouble();
+        }
+        
+        if (doc.HasMember("preload_source") && doc["preload_source"].IsString()) {
+            config.preload_source = doc["preload_source"].GetString();
+        }
+        
+        if (doc.HasMember("preload_file") && doc["preload_file"].IsString()) {
+            config.preload_file = doc["preload_file"].GetString();
+        }
+        
+        if (doc.HasMember("preload_patterns") && doc["preload_patterns"].IsArray()) {
+            config.preload_patterns.clear();
+            for (const auto& pattern : doc["preload_patterns"].GetArray()) {
+                if (pattern.IsString()) {
+                    config.preload_patterns.push_back(pattern.GetString());
+                }
+            }
+        }
+        
+        // 解析冗余订阅规则
+        if (doc.HasMember("redundancy_rules") && doc["redundancy_rules"].IsArray()) {
+            config.redundancy_rules.clear();
+            for (const auto& rule_json : doc["redundancy_rules"].GetArray()) {
+                if (!rule_json.IsObject()) continue;
+                
+                RedundancyRule rule;
+                if (rule_json.HasMember("pattern") && rule_json["pattern"].IsString()) {
+                    rule.pattern = rule_json["pattern"].GetString();
+                }
+                if (rule_json.HasMember("replicas") && rule_json["replicas"].IsInt()) {
+                    rule.replicas = rule_json["replicas"].GetInt();
+                }
+                config.redundancy_rules.push_back(rule);
+            }
+        }
+        
+        // 解析会话推送策略
+        if (doc.HasMember("session_policies") && doc["session_policies"].IsArray()) {
+            config.session_policies.clear();
+            for (const auto& policy_json : doc["session_policies"].GetArray()) {
+                if (!policy_json.IsObject()) continue;
+                
+                SessionPolicy policy;
+                if (policy_json.HasMember("name") && policy_json["name"].IsString()) {
+                    policy.name = policy_json["name"].GetString();
+                }
+                if (policy_json.HasMember("max_update_rate") && policy_json["max_update_rate"].IsNumber()) {
+                    policy.max_update_rate = policy_json["max_update_rate"].GetDouble();
+                }
+                if (policy_json.HasMember("bandwidth_bytes_per_sec") && policy_json["bandwidth_bytes_per_sec"].IsInt()) {
+                    policy.bandwidth_bytes_per_sec = policy_json["bandwidth_bytes_per_sec"].GetInt();
+                }
+                if (policy_json.HasMember("bandwidth_burst_bytes") && policy_json["bandwidth_burst_bytes"].IsInt()) {
+                    policy.bandwidth_burst_bytes = policy_json["bandwidth_burst_bytes"].GetInt();
+                }
+                if (policy_json.HasMember("priority") && policy_json["priority"].IsInt()) {
+                    policy.priority = policy_json["priority"].GetInt();
+                }
+                config.session_policies.push_back(policy);
+            }
+        }
+        
         // 解析连接配置
         if (doc.HasMember("connections") && doc["connections"].IsArray()) {
             const auto& connections_array = doc["connections"].GetArray();
@@ -126,6 +306,127 @@ bool ConfigLoader::validate_config(const MultiCTPConfig& config)
         return false;
     }
     
+    if (config.load_balance_strategy != "round_robin" &&
+        config.load_balance_strategy != "least_latency" &&
+        config.load_balance_strategy != "least_load" &&
+        config.load_balance_strategy != "consistent_hash") {
+        std::cerr << "Invalid load_balance_strategy: " << config.load_balance_strategy << std::endl;
+        return false;
+    }
+    
+    if (config.exchange_utc_offset_minutes < -720 || config.exchange_utc_offset_minutes > 840) {
+        std::cerr << "Invalid exchange_utc_offset_minutes: " << config.exchange_utc_offset_minutes << std::endl;
+        return false;
+    }
+    
+    for (const auto& rule : config.redundancy_rules) {
+        if (rule.pattern.empty() || rule.replicas < 1) {
+            std::cerr << "Invalid redundancy rule: pattern='" << rule.pattern
+                      << "', replicas=" << rule.replicas << std::endl;
+            return false;
+        }
+    }
+    
+    for (size_t i = 0; i < config.session_policies.size(); ++i) {
+        const auto& policy = config.session_policies[i];
+        bool duplicate = false;
+        for (size_t j = 0; j < i; ++j) {
+            duplicate = duplicate || config.session_policies[j].name == policy.name;
+        }
+        if (policy.name.empty() || duplicate || policy.max_update_rate < 0.0 ||
+            policy.bandwidth_bytes_per_sec < 0 || policy.bandwidth_burst_bytes < 0 ||
+            policy.priority < 1 || policy.priority > 10) {
+            std::cerr << "Invalid session policy: name='" << policy.name << "'" << std::endl;
+            return false;
+        }
+    }
+    
+    if (config.restart_backoff_initial_ms <= 0 || config.restart_backoff_max_ms < config.restart_backoff_initial_ms) {
+        std::cerr << "Invalid restart backoff: initial_ms=" << config.restart_backoff_initial_ms
+                  << ", max_ms=" << config.restart_backoff_max_ms << std::endl;
+        return false;
+    }
+    
+    if (config.startup_quorum < 1) {
+        std::cerr << "Invalid startup_quorum: " << config.startup_quorum << std::endl;
+        return false;
+    }
+    
+    if (config.websocket_coalesce_max_bytes < 0) {
+        std::cerr << "Invalid websocket_coalesce_max_bytes: " << config.websocket_coalesce_max_bytes << std::endl;
+        return false;
+    }
+    
+    // zlib 的 8 位窗口有缺陷，Beast 要求窗口大于 8
+    if (config.websocket_deflate_enabled &&
+        (config.websocket_deflate_level < 1 || config.websocket_deflate_level > 9 ||
+         config.websocket_deflate_window_bits < 9 || config.websocket_deflate_window_bits > 15 ||
+         config.websocket_deflate_mem_level < 1 || config.websocket_deflate_mem_level > 9)) {
+        std::cerr << "Invalid websocket deflate settings: level=" << config.websocket_deflate_level
+                  << ", window_bits=" << config.websocket_deflate_window_bits
+                  << ", mem_level=" << config.websocket_deflate_mem_level << std::endl;
+        return false;
+    }
+    
+    if (config.load_rebalance_enabled &&
+        (config.load_rebalance_threshold <= 1.0 || config.load_rebalance_max_utilization <= 0.0 ||
+         config.load_rebalance_max_utilization > 1.0 || config.load_rebalance_min_rate < 0.0 ||
+         config.load_rebalance_max_moves <= 0)) {
+        std::cerr << "Invalid load rebalance settings: threshold=" << config.load_rebalance_threshold
+                  << ", max_utilization=" << config.load_rebalance_max_utilization
+                  << ", min_rate=" << config.load_rebalance_min_rate
+                  << ", max_moves=" << config.load_rebalance_max_moves << std::endl;
+        return false;
+    }
+    
+    if (config.stale_feed_multiplier <= 1.0 || config.stale_feed_min_ms <= 0 ||
+        config.stale_feed_max_ms < config.stale_feed_min_ms) {
+        std::cerr << "Invalid stale feed settings: multiplier=" << config.stale_feed_multiplier
+                  << ", min_ms=" << config.stale_feed_min_ms
+                  << ", max_ms=" << config.stale_feed_max_ms << std::endl;
+        return false;
+    }
+
+    if (config.front_probe_enabled &&
+        (config.broker_data_file.empty() || config.front_probe_interval <= 0 ||
+         config.front_probe_timeout_ms <= 0 || config.front_switch_min_gain_ms < 0)) {
+        std::cerr << "Invalid front probe settings: broker_data_file=" << config.broker_data_file
+                  << ", interval=" << config.front_probe_interval
+                  << ", timeout_ms=" << config.front_probe_timeout_ms
+                  << ", min_gain_ms=" << config.front_switch_min_gain_ms << std::endl;
+        return false;
+    }
+    
+    if (config.snapshot_chunk_bytes < 0) {
+        std::cerr << "Invalid snapshot_chunk_bytes: " << config.snapshot_chunk_bytes << std::endl;
+        return false;
+    }
+    
+    if (config.snapshot_refresh_ms < 0) {
+        std::cerr << "Invalid snapshot_refresh_ms: " << config.snapshot_refresh_ms << std::endl;
+        return false;
+    }
+    
+    if (config.session_resume_grace_seconds < 0) {
+        std::cerr << "Invalid session_resume_grace_seconds: " << config.session_resume_grace_seconds << std::endl;
+        return false;
+    }
+    
+    if (config.unsubscribe_linger_seconds < 0) {
+        std::cerr << "Invalid unsubscribe_linger_seconds: " << config.unsubscribe_linger_seconds << std::endl;
+        return false;
+    }
+    
+    if (config.preload_source != "none" && config.preload_source != "shm" && config.preload_source != "file") {
+        std::cerr << "Invalid preload_source: " << config.preload_source << " (expected none/shm/file)" << std::endl;
+        return false;
+    }
+    
+    if (config.preload_source == "file" && config.preload_file.empty()) {
+        std::cerr << "preload_file is required when preload_source is file" << std::endl;
+        return false;
+    }
+    
     // 检查连接配置
     std::set<std::string> connection_ids;
     for (const auto& conn : config.connections) {
@@ -14,10 +14,33 @@ struct CTPConnectionConfig {
     bool enabled = true;          // 是否启用此连接
 };
 
+// 冗余订阅规则：匹配的合约同时在多个连接上订阅，以先到达的行情为准
+struct RedundancyRule {
+    std::string pattern;          // 合约通配符（CTP格式，支持 * 和 ?，如 "rb*"）
+    int replicas = 2;             // 同时订阅的连接数（含主连接）
+};
+
+// 会话推送策略：客户端在 subscribe_quote 中用 "policy" 选择，名为 default 的策略用于未选择的会话
+struct SessionPolicy {
+    std::string name;
+    double max_update_rate = 0.0;     // 每个合约每秒最多推送次数，0 表示不限
+    int bandwidth_bytes_per_sec = 0;  // 令牌桶速率(字节/秒)，0 表示不限
+    int bandwidth_burst_bytes = 0;    // 令牌桶容量(字节)，0 表示取1秒的速率
+    int priority = 1;                 // 同一批唤醒的会话的处理顺序（1-10，数字越小越先处理）
+};
+
 // 多CTP连接配置
 struct MultiCTPConfig {
     // 全局配置
     int websocket_port = 7799;
+    int websocket_coalesce_max_bytes = 1048576;  // 写出时合并相邻 rtn_data 帧的消息大小上限(字节)，0 表示不合并
+    
+    // WebSocket permessage-deflate：客户端在握手中请求时启用压缩
+    bool websocket_deflate_enabled = false;
+    int websocket_deflate_level = 6;                  // zlib 压缩级别 1-9
+    int websocket_deflate_window_bits = 15;           // 服务端滑动窗口 9-15，越小每连接内存越少
+    int websocket_deflate_mem_level = 8;              // zlib memLevel 1-9
+    bool websocket_deflate_no_context_takeover = false;  // 每条消息独立压缩，不保留跨消息的压缩上下文
     
     // 连接配置列表
     std::vector<CTPConnectionConfig> connections;
@@ -26,7 +49,51 @@ struct MultiCTPConfig {
     int health_check_interval = 30;     // 健康检查间隔(秒)
     int maintenance_interval = 60;      // 维护间隔(秒)  
     int max_retry_count = 3;           // 最大重试次数
+    int unsubscribe_linger_seconds = 30;     // 最后一个客户端退订后保持CTP订阅的时长(秒)，0 表示立即退订
+    int snapshot_chunk_bytes = 262144;       // 全量帧分块大小(字节)，超过后在合约边界切分为多条 rtn_data 跨io轮次发送，0 表示不分块
+    int snapshot_refresh_ms = 500;           // 后台预序列化单合约全量片段的刷新间隔(毫秒)，新会话的全量帧由片段拼接，0 表示不预序列化
+    int session_resume_grace_seconds = 30;   // 断线会话的已确认版本保留时长(秒)，客户端凭resume token重连后只收增量，0 表示不保留
     bool auto_failover = true;         // 是否开启自动故障转移
+    int restart_backoff_initial_ms = 1000;   // 连接重启退避初始值(毫秒)，每次失败翻倍并加随机抖动
+    int restart_backoff_max_ms = 60000;      // 连接重启退避上限(毫秒)
+    int startup_quorum = 1;                  // 启动就绪所需的已登录连接数
+    
+    // 负载均衡策略: round_robin（轮询）/ least_latency（最低延迟优先）/ least_load（行情消息负载最低优先）
+    //               / consistent_hash（按 max_subscriptions 加权的一致性哈希，重连后映射保持稳定）
+    std::string load_balance_strategy = "round_robin";
+    int exchange_utc_offset_minutes = 480;   // 交易所时间（CTP UpdateTime）相对UTC的偏移(分钟)，用于计算行情延迟，与主机时区无关
+    
+    // 按行情负载动态再平衡：维护任务发现连接间消息速率或回调线程占用明显失衡时，把最热连接上的合约先订后退迁往最空闲的连接
+    bool load_rebalance_enabled = false;
+    double load_rebalance_threshold = 1.5;         // 最热连接速率超过平均速率的倍数
+    double load_rebalance_max_utilization = 0.7;   // 回调线程占用率（行情回调耗时/墙钟时间）上限
+    double load_rebalance_min_rate = 100.0;        // 最热连接速率低于此值(条/秒)时不调整
+    int load_rebalance_max_moves = 20;             // 每个维护周期最多迁移的合约数
+    
+    // 冗余订阅规则（按顺序匹配，首个匹配生效）
+    std::vector<RedundancyRule> redundancy_rules;
+    
+    // 会话推送策略（限频、带宽、优先级）
+    std::vector<SessionPolicy> session_policies;
+    
+    // 行情断流检测：已登录但停止推送行情的连接/合约自动迁移
+    bool stale_feed_detection = false;
+    double stale_feed_multiplier = 10.0;   // 静默超过 平均到达间隔 × 倍数 判定为断流
+    int stale_feed_min_ms = 2000;          // 判定阈值下限(毫秒)
+    int stale_feed_max_ms = 120000;        // 判定阈值上限(毫秒)
+    
+    // 前置探测：定期测量 broker_data.json 中同经纪商候选前置的建连RTT，结合在用前置的行情延迟排名
+    bool front_probe_enabled = false;
+    std::string broker_data_file = "config/broker_data.json";
+    int front_probe_interval = 300;          // 探测间隔(秒)
+    int front_probe_timeout_ms = 1000;       // 单次建连超时(毫秒)
+    bool front_auto_switch = false;          // 在用前置明显慢于同经纪商最快的空闲前置时自动切换
+    double front_switch_min_gain_ms = 2.0;   // 触发切换所需的最小评分改善(毫秒)
+    
+    // 启动预订阅：客户端连接前按连接容量批量订阅合约，使行情缓存预热
+    std::string preload_source = "none";        // none / shm（qamddata 共享内存的 InsMap）/ file
+    std::string preload_file;                   // preload_source 为 file 时的合约列表（每行一个，可带交易所前缀，# 开头为注释）
+    std::vector<std::string> preload_patterns;  // 只预订阅匹配的合约（CTP格式通配符），为空表示全部
 };
 
 // 配置加载器
@@ -0,0 +1,403 @@
+#include "market_data_server.h"
+#include "quote_emitter.h"
+#include "field_diff.h"
+#include <rapidjson/writer.h>
+#include <rapidjson/internal/dtoa.h>
+#include <rapidjson/internal/itoa.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t kNumberReserve = 25;   // 与 rapidjson::Writer 的数值预留长度一致
+constexpr uint8_t kNoField = 0xFF;
+
+const char kRtnDataBegin[] = "{\"aid\":\"rtn_data\",\"data\":[{\"quotes\":{";
+const char kRtnDataEnd[] = "}},{\"account_id\":\"\",\"ins_list\":\"\",\"mdhis_more_data\":false}]}";
+const char kRtnDataJoin[] = "}},{\"quotes\":{";
+
+// 全量输出模板：每段先拷贝一段固定字节（分隔符、key、恒为null的字段），再写 field 的值
+struct Segment {
+    uint32_t literal_begin;
+    uint32_t literal_length;
+    uint8_t field;              // md_schema::kFields 下标，kNoField 表示结尾
+};
+
+struct Templates {
+    std::string literals;
+    std::vector<Segment> full;
+    // 增量输出：每个字段的 ,"key": 字节（首个字段跳过逗号）
+    std::array<uint32_t, md_schema::kFieldCount> key_begin{};
+    std::array<uint32_t, md_schema::kFieldCount> key_length{};
+};
+
+Templates build_templates()
+{
+    Templates t;
+    std::string pending = "{";
+    for (size_t i = 0; i < md_schema::kFieldCount; ++i) {
+        const md_schema::Field& field = md_schema::kFields[i];
+        const std::string key = std::string("\"") + field.key + "\":";
+
+        if (i > 0) {
+            pending += ",";
+        }
+        pending += key;
+        if (field.snapshot_null) {
+            pending += "null";
+        } else {
+            t.full.push_back(Segment{static_cast<uint32_t>(t.literals.size()), static_cast<uint32_t>(pending.size()),
+                                     static_cast<uint8_t>(i)});
+            t.literals += pending;
+            pending.clear();
+        }
+
+        t.key_begin[i] = static_cast<uint32_t>(t.literals.size());
+        t.key_length[i] = static_cast<uint32_t>(key.size() + 1);
+        t.literals += "," + key;
+    }
+    pending += "}";
+    t.full.push_back(Segment{static_cast<uint32_t>(t.literals.size()), static_cast<uint32_t>(pending.size()), kNoField});
+    t.literals += pending;
+    return t;
+}
+
+const Templates TEMPLATES = build_templates();
+
+inline void put_bytes(rapidjson::StringBuffer& out, const char* bytes, size_t length)
+{
+    memcpy(out.Push(length), bytes, length);
+}
+
+// 与 rapidjson::Writer::WriteString 相同的转义规则（UTF-8原样输出，控制字符、引号和反斜杠转义）
+void put_string(rapidjson::StringBuffer& out, const char* str, size_t length)
+{
+    static const char kHexDigits[] = "0123456789ABCDEF";
+
+    char* p = out.Push(2 + length * 6);
+    char* const begin = p;
+    *p++ = '"';
+    for (size_t i = 0; i < length; ++i) {
+        const unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            *p++ = static_cast<char>(c);
+            continue;
+        }
+        *p++ = '\\';
+        switch (c) {
+            case '"': *p++ = '"'; break;
+            case '\\': *p++ = '\\'; break;
+            case '\b': *p++ = 'b'; break;
+            case '\t': *p++ = 't'; break;
+            case '\n': *p++ = 'n'; break;
+            case '\f': *p++ = 'f'; break;
+            case '\r': *p++ = 'r'; break;
+            default:
+                *p++ = 'u'; *p++ = '0'; *p++ = '0';
+                *p++ = kHexDigits[c >> 4];
+                *p++ = kHexDigits[c & 0xF];
+                break;
+        }
+    }
+    *p++ = '"';
+    out.Pop(2 + length * 6 - static_cast<size_t>(p - begin));
+}
+
+inline void put_value(rapidjson::StringBuffer& out, const MarketDataStruct& data,
+                      const md_schema::Field& field, uint8_t price_decimals)
+{
+    using md_schema::FieldType;
+
+    if (field.type == FieldType::STRING) {
+        const char* str = &md_schema::value_at<char>(data, field.offset);
+        put_string(out, str, strlen(str));
+        return;
+    }
+
+    char* begin = out.Push(kNumberReserve);
+    char* end = begin;
+    switch (field.type) {
+        case FieldType::UINT64:
+            end = rapidjson::internal::u64toa(md_schema::value_at<uint64_t>(data, field.offset), begin);
+            break;
+        case FieldType::INT:
+            end = rapidjson::internal::i32toa(md_schema::value_at<int>(data, field.offset), begin);
+            break;
+        case FieldType::INT64:
+            end = rapidjson::internal::i64toa(md_schema::value_at<int64_t>(data, field.offset), begin);
+            break;
+        case FieldType::DOUBLE: {
+            const double value = md_schema::value_at<double>(data, field.offset);
+            if (!std::isfinite(value)) {
+                // rapidjson::Writer 对NaN/Inf不输出任何内容（生成非法JSON），这里写null
+                memcpy(begin, "null", 4);
+                end = begin + 4;
+            } else if (field.source == md_schema::Source::PRICE) {
+                end = QuoteEmitter::write_price(begin, value, price_decimals);
+            } else {
+                end = rapidjson::internal::dtoa(value, begin);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    out.Pop(kNumberReserve - static_cast<size_t>(end - begin));
+}
+
+template<typename Fn>
+double measure_ns_per_op(size_t iterations, Fn&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+}  // namespace
+
+uint8_t QuoteEmitter::decimals_for_tick(double price_tick)
+{
+    if (!(price_tick > 0.0) || !std::isfinite(price_tick)) {
+        return kDefaultPriceDecimals;
+    }
+    for (uint8_t decimals = 0; decimals < kDefaultPriceDecimals; ++decimals) {
+        const double scaled = price_tick * std::pow(10.0, decimals);
+        if (std::fabs(scaled - std::round(scaled)) < 1e-9 * std::max(1.0, scaled)) {
+            return decimals;
+        }
+    }
+    return kDefaultPriceDecimals;
+}
+
+// 定点格式化：value 恰好是 n/10^decimals 对应的double时，最短表示就是去掉末尾0的该小数（至少保留一位小数），
+// 与 rapidjson 的 Grisu 输出相同；不在该价格网格上（或超出15位有效数字、负零）时回退到 dtoa
+char* QuoteEmitter::write_price(char* buffer, double value, uint8_t price_decimals)
+{
+    static const double kScale[] = {1.0, 10.0, 100.0};
+    static const uint32_t kDivisor[] = {1, 10, 100};
+    constexpr double kMaxExact = 1e15;
+
+    if (price_decimals <= kDefaultPriceDecimals && !std::signbit(value)) {
+        const double scaled = value * kScale[price_decimals];
+        if (scaled < kMaxExact) {
+            const uint64_t n = static_cast<uint64_t>(scaled + 0.5);
+            if (static_cast<double>(n) / kScale[price_decimals] == value) {
+                const uint32_t divisor = kDivisor[price_decimals];
+                const uint32_t fraction = static_cast<uint32_t>(n % divisor);
+                char* p = rapidjson::internal::u64toa(n / divisor, buffer);
+                *p++ = '.';
+                if (fraction == 0) {
+                    *p++ = '0';
+                } else if (price_decimals == 1) {
+                    *p++ = static_cast<char>('0' + fraction);
+                } else {
+                    *p++ = static_cast<char>('0' + fraction / 10);
+                    if (fraction % 10 != 0) {
+                        *p++ = static_cast<char>('0' + fraction % 10);
+                    }
+                }
+                return p;
+            }
+        }
+    }
+    return rapidjson::internal::dtoa(value, buffer);
+}
+
+void QuoteEmitter::begin_rtn_data(rapidjson::StringBuffer& out)
+{
+    put_bytes(out, kRtnDataBegin, sizeof(kRtnDataBegin) - 1);
+}
+
+void QuoteEmitter::end_rtn_data(rapidjson::StringBuffer& out)
+{
+    put_bytes(out, kRtnDataEnd, sizeof(kRtnDataEnd) - 1);
+}
+
+size_t QuoteEmitter::rtn_data_begin_size()
+{
+    return sizeof(kRtnDataBegin) - 1;
+}
+
+size_t QuoteEmitter::rtn_data_end_size()
+{
+    return sizeof(kRtnDataEnd) - 1;
+}
+
+std::string_view QuoteEmitter::rtn_data_join()
+{
+    return std::string_view(kRtnDataJoin, sizeof(kRtnDataJoin) - 1);
+}
+
+std::string_view QuoteEmitter::rtn_data_end()
+{
+    return std::string_view(kRtnDataEnd, sizeof(kRtnDataEnd) - 1);
+}
+
+void QuoteEmitter::write_quote(rapidjson::StringBuffer& out, const std::string& key, bool first,
+                               const MarketDataStruct& data, uint64_t mask, uint8_t price_decimals)
+{
+    if (!first) {
+        out.Put(',');
+    }
+    put_string(out, key.data(), key.size());
+    out.Put(':');
+    if (mask == kAllFieldsMask) {
+        write_full(out, data, price_decimals);
+    } else {
+        write_changed(out, data, mask, price_decimals);
+    }
+}
+
+void QuoteEmitter::write_full(rapidjson::StringBuffer& out, const MarketDataStruct& data, uint8_t price_decimals)
+{
+    const char* literals = TEMPLATES.literals.data();
+    for (const Segment& segment : TEMPLATES.full) {
+        put_bytes(out, literals + segment.literal_begin, segment.literal_length);
+        if (segment.field != kNoField) {
+            put_value(out, data, md_schema::kFields[segment.field], price_decimals);
+        }
+    }
+}
+
+void QuoteEmitter::write_changed(rapidjson::StringBuffer& out, const MarketDataStruct& data, uint64_t mask,
+                                 uint8_t price_decimals)
+{
+    constexpr uint64_t kFieldBitsMask = (1ULL << FIELD_COUNT) - 1;
+    const char* literals = TEMPLATES.literals.data();
+
+    out.Put('{');
+    bool first = true;
+    for (uint64_t bits = mask & kFieldBitsMask; bits != 0; bits &= bits - 1) {
+        const uint8_t index = md_schema::kIndexByBit[__builtin_ctzll(bits)];
+        // key字节以逗号开头，首个字段跳过
+        const uint32_t skip = first ? 1 : 0;
+        put_bytes(out, literals + TEMPLATES.key_begin[index] + skip, TEMPLATES.key_length[index] - skip);
+        put_value(out, data, md_schema::kFields[index], price_decimals);
+        first = false;
+    }
+    out.Put('}');
+}
+
+bool QuoteEmitter::run_benchmark(size_t iterations, std::ostream& out)
+{
+    constexpr size_t kTickCount = 4096;
+    constexpr size_t kQuotesPerFrame = 8;
+    const std::vector<MarketDataStruct> ticks = FieldDiff::simulated_ticks(kTickCount + kQuotesPerFrame);
+    const std::string key = "SHFE.rb2501";
+    const uint8_t decimals = decimals_for_tick(1.0);
+
+    std::vector<uint64_t> masks(kTickCount + kQuotesPerFrame, kAllFieldsMask);
+    for (size_t i = 1; i < masks.size(); ++i) {
+        masks[i] = FieldDiff::compute(ticks[i - 1], ticks[i]);
+    }
+
+    // rapidjson::Writer 生成同样的帧作为对照
+    auto writer_frame = [&](rapidjson::StringBuffer& buffer, size_t start, bool full) {
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        writer.StartObject();
+        writer.Key("aid");
+        writer.String("rtn_data");
+        writer.Key("data");
+        writer.StartArray();
+        writer.StartObject();
+        writer.Key("quotes");
+        writer.StartObject();
+        for (size_t q = 0; q < kQuotesPerFrame; ++q) {
+            const size_t k = start + q;
+            writer.Key(key.c_str());
+            if (full) {
+                MarketDataServer::struct_to_writer(ticks[k], writer);
+            } else {
+                MarketDataServer::write_changed_fields(ticks[k], masks[k], writer);
+            }
+        }
+        writer.EndObject();
+        writer.EndObject();
+        writer.StartObject();
+        writer.Key("account_id"); writer.String("");
+        writer.Key("ins_list"); writer.String("");
+        writer.Key("mdhis_more_data"); writer.Bool(false);
+        writer.EndObject();
+        writer.EndArray();
+        writer.EndObject();
+    };
+    auto emitter_frame = [&](rapidjson::StringBuffer& buffer, size_t start, bool full) {
+        begin_rtn_data(buffer);
+        for (size_t q = 0; q < kQuotesPerFrame; ++q) {
+            const size_t k = start + q;
+            write_quote(buffer, key, q == 0, ticks[k], full ? kAllFieldsMask : masks[k], decimals);
+        }
+        end_rtn_data(buffer);
+    };
+
+    bool all_match = true;
+    char line[200];
+
+    // 逐帧对照
+    for (size_t i = 1; i < kTickCount && all_match; ++i) {
+        for (bool full : {true, false}) {
+            rapidjson::StringBuffer expected, actual;
+            writer_frame(expected, i, full);
+            emitter_frame(actual, i, full);
+            if (strcmp(expected.GetString(), actual.GetString()) != 0) {
+                out << "MISMATCH (" << (full ? "full" : "diff") << " frame " << i << "):\n  writer:  "
+                    << expected.GetString() << "\n  emitter: " << actual.GetString() << "\n";
+                all_match = false;
+                break;
+            }
+        }
+    }
+
+    // 价格网格扫描：各小数位数下的定点输出与 dtoa 一致
+    for (uint8_t d = 0; d <= kDefaultPriceDecimals && all_match; ++d) {
+        const double scale = std::pow(10.0, d);
+        for (uint64_t n = 0; n < 2000000; ++n) {
+            const double value = static_cast<double>(n) / scale;
+            char a[32], b[32];
+            *rapidjson::internal::dtoa(value, a) = '\0';
+            *write_price(b, value, d) = '\0';
+            if (strcmp(a, b) != 0) {
+                snprintf(line, sizeof(line), "MISMATCH price %s (decimals %u): %s\n", a, d, b);
+                out << line;
+                all_match = false;
+                break;
+            }
+        }
+    }
+
+    snprintf(line, sizeof(line), "Quote JSON benchmark: %zu frames x %zu quotes, price decimals %u\n",
+             iterations, kQuotesPerFrame, decimals);
+    out << line;
+
+    rapidjson::StringBuffer buffer;
+    buffer.Reserve(kQuotesPerFrame * 1024);
+    size_t bytes = 0;
+    for (bool full : {true, false}) {
+        double writer_ns = measure_ns_per_op(iterations, [&](size_t i) {
+            buffer.Clear();
+            writer_frame(buffer, i & (kTickCount - 1), full);
+            bytes += buffer.GetSize();
+        });
+        double emitter_ns = measure_ns_per_op(iterations, [&](size_t i) {
+            buffer.Clear();
+            emitter_frame(buffer, i & (kTickCount - 1), full);
+            bytes += buffer.GetSize();
+        });
+        snprintf(line, sizeof(line), "  %-5s frame: writer %8.1f ns, emitter %8.1f ns (%.2fx)\n",
+                 full ? "full" : "diff", writer_ns, emitter_ns, writer_ns / emitter_ns);
+        out << line;
+    }
+    volatile size_t sink = bytes;
+    (void)sink;
+
+    out << (all_match ? "Emitter output is byte-identical to rapidjson::Writer\n"
+                      : "Emitter output differs, see mismatches above\n");
+    return all_match;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <rapidjson/stringbuffer.h>
+#include "market_data_schema.h"
+
+// 专用的 rtn_data 行情JSON输出
+// 字段key、分隔符和全量时恒为null的盘口6-10档预先拼成字节串整段拷贝，不经过 rapidjson::Writer 的状态机；
+// 价格字段按合约最小变动价位的小数位数定点格式化，整数、成交额等其它数值沿用 rapidjson 的格式化函数。
+// 输出与 rapidjson::Writer 逐字节一致（mdservice客户端兼容）。
+class QuoteEmitter {
+public:
+    // 行情价格已四舍五入到两位小数，未知最小变动价位时按两位处理
+    static constexpr uint8_t kDefaultPriceDecimals = 2;
+
+    // 最小变动价位 -> 价格小数位数（0~2）
+    static uint8_t decimals_for_tick(double price_tick);
+
+    // {"aid":"rtn_data","data":[{"quotes":{
+    static void begin_rtn_data(rapidjson::StringBuffer& out);
+    // }},{"account_id":"","ins_list":"","mdhis_more_data":false}]}
+    static void end_rtn_data(rapidjson::StringBuffer& out);
+
+    // 相邻 rtn_data 帧合并为一条消息时使用：去掉后一帧的帧头、前一帧的帧尾，中间以 "}},{\"quotes\":{" 连接，
+    // data 数组依次包含各帧的 quotes，客户端按顺序应用，结果与逐帧接收相同
+    static size_t rtn_data_begin_size();
+    static size_t rtn_data_end_size();
+    static std::string_view rtn_data_join();
+    static std::string_view rtn_data_end();
+
+    // 写出 quotes 中的一个合约："<key>":{...}；mask 为 kAllFieldsMask 时写全量，否则只写掩码中的字段
+    static void write_quote(rapidjson::StringBuffer& out, const std::string& key, bool first,
+                            const MarketDataStruct& data, uint64_t mask, uint8_t price_decimals);
+
+    static void write_full(rapidjson::StringBuffer& out, const MarketDataStruct& data, uint8_t price_decimals);
+    static void write_changed(rapidjson::StringBuffer& out, const MarketDataStruct& data, uint64_t mask,
+                              uint8_t price_decimals);
+
+    // 写出价格，返回写入结束位置（buffer 至少25字节）
+    static char* write_price(char* buffer, double value, uint8_t price_decimals);
+
+    // 与 rapidjson::Writer 对比：校验输出逐字节一致，并输出全量/增量帧的序列化耗时
+    static bool run_benchmark(size_t iterations, std::ostream& out);
+};
@@ -0,0 +1,133 @@
+#include "session_throttle.h"
+#include <algorithm>
+#include <chrono>
+
+void SessionThrottle::configure(const SessionPolicy& policy, double max_update_rate)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_name_ = policy.name;
+
+    double rate = policy.max_update_rate;
+    if (max_update_rate > 0.0 && (rate <= 0.0 || max_update_rate < rate)) {
+        rate = max_update_rate;
+    }
+    // 会话每帧包含全部有变化的合约，限制帧间隔即限制了每个合约的推送频率，其间的变化按最新版本合并推送
+    min_interval_ms_ = rate > 0.0 ? static_cast<int64_t>(1000.0 / rate) : 0;
+
+    bytes_per_ms_ = policy.bandwidth_bytes_per_sec / 1000.0;
+    burst_bytes_ = policy.bandwidth_burst_bytes > 0 ? policy.bandwidth_burst_bytes
+                                                    : static_cast<double>(policy.bandwidth_bytes_per_sec);
+    tokens_ = burst_bytes_;
+    refill_ms_ = 0;
+    priority_ = policy.priority;
+}
+
+void SessionThrottle::refill(int64_t now_ms)
+{
+    if (refill_ms_ > 0 && now_ms > refill_ms_) {
+        tokens_ = std::min(burst_bytes_, tokens_ + (now_ms - refill_ms_) * bytes_per_ms_);
+    }
+    refill_ms_ = now_ms;
+}
+
+int64_t SessionThrottle::delay_ms(int64_t now_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t delay = 0;
+    if (min_interval_ms_ > 0 && last_frame_ms_ >= 0) {
+        delay = std::max<int64_t>(delay, last_frame_ms_ + min_interval_ms_ - now_ms);
+    }
+    if (bytes_per_ms_ > 0.0) {
+        refill(now_ms);
+        // 令牌允许透支一帧：大帧照常发出，之后等令牌补回再发下一帧
+        if (tokens_ < 0.0) {
+            delay = std::max<int64_t>(delay, static_cast<int64_t>(-tokens_ / bytes_per_ms_) + 1);
+        }
+    }
+    return delay;
+}
+
+void SessionThrottle::on_frame(int64_t now_ms, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_frame_ms_ = now_ms;
+    if (bytes_per_ms_ > 0.0) {
+        refill(now_ms);
+        tokens_ -= static_cast<double>(bytes);
+    }
+}
+
+int SessionThrottle::priority() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return priority_;
+}
+
+std::string SessionThrottle::policy_name() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_name_;
+}
+
+int64_t SessionThrottle::now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DeferredPeekWheel::DeferredPeekWheel()
+    : wheel_(kWheelSlots)
+{
+}
+
+bool DeferredPeekWheel::schedule(const std::string& session_id, int64_t now_ms, int64_t due_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!scheduled_.insert(session_id).second) {
+        return false;
+    }
+    const int64_t due_tick = (due_ms + kTickMs - 1) / kTickMs;
+    if (scheduled_.size() == 1) {
+        // 时间轮为空时定时器已停止，从当前时刻重新开始推进
+        current_tick_ = std::max(current_tick_, now_ms / kTickMs - 1);
+    }
+    const int64_t tick = std::max(due_tick, current_tick_ + 1);
+    wheel_[tick % kWheelSlots].push_back(Entry{tick, session_id});
+    return true;
+}
+
+void DeferredPeekWheel::remove(const std::string& session_id)
+{
+    // 时间轮中的条目惰性清理：到期时不在 scheduled_ 中的会话跳过
+    std::lock_guard<std::mutex> lock(mutex_);
+    scheduled_.erase(session_id);
+}
+
+void DeferredPeekWheel::collect_due(int64_t now_ms, std::vector<std::string>& due)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int64_t now_tick = now_ms / kTickMs;
+    // 每个槽最多看一遍；落后超过一整圈时直接跳到当前时刻
+    const int64_t first_tick = std::max(current_tick_ + 1, now_tick - static_cast<int64_t>(kWheelSlots) + 1);
+    for (int64_t tick = first_tick; tick <= now_tick; ++tick) {
+        auto& slot = wheel_[tick % kWheelSlots];
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].tick <= now_tick) {
+                if (scheduled_.erase(slot[i].session_id) > 0) {
+                    due.push_back(std::move(slot[i].session_id));
+                }
+                slot[i] = std::move(slot.back());
+                slot.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+    current_tick_ = std::max(current_tick_, now_tick);
+}
+
+bool DeferredPeekWheel::empty() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scheduled_.empty();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "multi_ctp_config.h"
+
+// 单个会话的推送节流：最小帧间隔（限制每个合约的推送频率）+ 字节令牌桶（限制带宽）
+// 只记录时间戳和令牌数，不持有定时器；被节流的 peek 交给 DeferredPeekWheel 统一排期
+class SessionThrottle {
+public:
+    // max_update_rate 为客户端请求的频率，只能比策略更严格（0 表示沿用策略）
+    void configure(const SessionPolicy& policy, double max_update_rate);
+
+    // 距离允许推送下一帧还需等待的毫秒数，0 表示可以立即推送
+    int64_t delay_ms(int64_t now_ms);
+    // 推送了一帧 rtn_data
+    void on_frame(int64_t now_ms, size_t bytes);
+
+    int priority() const;
+    std::string policy_name() const;
+
+    static int64_t now_ms();
+
+private:
+    void refill(int64_t now_ms);
+
+    mutable std::mutex mutex_;
+    std::string policy_name_;
+    int64_t min_interval_ms_ = 0;
+    double bytes_per_ms_ = 0.0;
+    double burst_bytes_ = 0.0;
+    double tokens_ = 0.0;
+    int64_t refill_ms_ = 0;
+    int64_t last_frame_ms_ = -1;
+    int priority_ = 1;
+};
+
+// 被节流的 peek 的时间轮：所有会话共用，由一个 asio 定时器按 kTickMs 推进，时间轮为空时定时器停止
+class DeferredPeekWheel {
+public:
+    static constexpr int kTickMs = 10;
+
+    DeferredPeekWheel();
+
+    // 在 due_ms 之后唤醒会话，已在时间轮中的会话不重复加入；返回 false 表示已在时间轮中
+    bool schedule(const std::string& session_id, int64_t now_ms, int64_t due_ms);
+    void remove(const std::string& session_id);
+    // 取出 now_ms 之前到期的会话
+    void collect_due(int64_t now_ms, std::vector<std::string>& due);
+    bool empty() const;
+
+private:
+    struct Entry {
+        int64_t tick;
+        std::string session_id;
+    };
+
+    static constexpr size_t kWheelSlots = 256;
+
+    std::vector<std::vector<Entry>> wheel_;
+    std::unordered_set<std::string> scheduled_;
+    int64_t current_tick_ = 0;
+    mutable std::mutex mutex_;
+};
@@ -1,333 +1,1563 @@
 #include "subscription_dispatcher.h"
 #include "ctp_connection_manager.h"
 #include "market_data_server.h"
+#include "fast_log.h"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// std::atomic<double> 在C++17中没有 fetch_add
+void atomic_add(std::atomic<double>& target, double delta)
+{
+    double current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+    }
+}
+
+LoadBalanceStrategy parse_load_balance_strategy(const std::string& name)
+{
+    if (name == "least_latency") {
+        return LoadBalanceStrategy::LEAST_LATENCY;
+    }
+    if (name == "least_load") {
+        return LoadBalanceStrategy::LEAST_LOAD;
+    }
+    if (name == "consistent_hash") {
+        return LoadBalanceStrategy::CONSISTENT_HASH;
+    }
+    return LoadBalanceStrategy::ROUND_ROBIN;
+}
+
+constexpr int64_t kMsPerDay = 24LL * 3600 * 1000;
+
+// 解析 CTP UpdateTime（"HH:MM:SS"）+ UpdateMillisec，返回当日毫秒数
+int64_t parse_update_time_ms(const char* update_time, int update_millisec)
+{
+    if (!update_time || strnlen(update_time, 9) < 8 || update_time[2] != ':' || update_time[5] != ':') {
+        return -1;
+    }
+    for (int i : {0, 1, 3, 4, 6, 7}) {
+        if (update_time[i] < '0' || update_time[i] > '9') {
+            return -1;
+        }
+    }
+    const int64_t hh = (update_time[0] - '0') * 10 + (update_time[1] - '0');
+    const int64_t mm = (update_time[3] - '0') * 10 + (update_time[4] - '0');
+    const int64_t ss = (update_time[6] - '0') * 10 + (update_time[7] - '0');
+    return ((hh * 60 + mm) * 60 + ss) * 1000 + update_millisec;
+}
+
+// 交易时段内单调递增的时间：以18:00为起点，夜盘21:00在前、日盘15:00在后
+int64_t trading_session_ms(int64_t ms_of_day)
+{
+    constexpr int64_t kSessionStartMs = 18LL * 3600 * 1000;
+    return (ms_of_day - kSessionStartMs + kMsPerDay) % kMsPerDay;
+}
+
+// 通配符匹配（支持 * 和 ?）
+bool wildcard_match(const char* pattern, const char* text)
+{
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*text) {
+        if (*pattern == '?' || *pattern == *text) {
+            ++pattern;
+            ++text;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        ++pattern;
+    }
+    return *pattern == '\0';
+}
+
+// 预订阅使用的保留session，客户端退订不会释放预订阅的合约
+const char* const kPreloadSessionId = "__preload__";
+
+// FNV-1a + splitmix64 终混：与进程、平台无关，重启后合约到连接的映射保持不变
+uint64_t stable_hash(const std::string& key, uint64_t seed = 14695981039346656037ULL)
+{
+    uint64_t h = seed;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h += 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+// 加权rendezvous评分：-w / ln(u)，u 为 (合约, 连接) 哈希映射到 (0,1) 的均匀值
+// 各连接得分最高的概率与权重成正比，移除一个连接只影响原本归属它的合约
+double rendezvous_score(uint64_t instrument_hash, const std::string& connection_id, double weight)
+{
+    const uint64_t h = stable_hash(connection_id, instrument_hash);
+    const double u = (static_cast<double>(h >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    return -weight / std::log(u);
+}
+
+} // namespace
 
 SubscriptionDispatcher::SubscriptionDispatcher(MarketDataServer* server)
     : server_(server)
     , connection_manager_(nullptr)
+    , strategy_(LoadBalanceStrategy::ROUND_ROBIN)
     , round_robin_counter_(0)
+    , exchange_utc_offset_ms_(0)
+    , last_load_refresh_(std::chrono::steady_clock::now())
+    , redundant_feed_count_(0)
+    , load_rebalance_enabled_(false)
+    , load_rebalance_threshold_(1.5)
+    , load_rebalance_max_utilization_(0.7)
+    , load_rebalance_min_rate_(100.0)
+    , load_rebalance_max_moves_(20)
     , maintenance_running_(false)
     , maintenance_interval_(60) // 60秒维护间隔
+    , unsubscribe_linger_(0)
     , max_retry_count_(3)
 {
 }
 
-SubscriptionDispatcher::~SubscriptionDispatcher()
+SubscriptionDispatcher::~SubscriptionDispatcher()
+{
+    shutdown();
+}
+
+SubscriptionDispatcher::SubscriptionShard& SubscriptionDispatcher::shard_for(const std::string& instrument_id)
+{
+    return subscription_shards_[stable_hash(instrument_id) % kSubscriptionShards];
+}
+
+const SubscriptionDispatcher::SubscriptionShard& SubscriptionDispatcher::shard_for(const std::string& instrument_id) const
+{
+    return subscription_shards_[stable_hash(instrument_id) % kSubscriptionShards];
+}
+
+bool SubscriptionDispatcher::initialize(CTPConnectionManager* connection_manager, const MultiCTPConfig& config)
+{
+    if (!connection_manager) {
+        server_->log_error("CTPConnectionManager is null");
+        return false;
+    }
+    
+    connection_manager_ = connection_manager;
+    
+    // 从配置中读取参数
+    maintenance_interval_ = std::chrono::seconds(config.maintenance_interval);
+    max_retry_count_ = config.max_retry_count;
+    unsubscribe_linger_ = std::chrono::seconds(config.unsubscribe_linger_seconds);
+    strategy_ = parse_load_balance_strategy(config.load_balance_strategy);
+    redundancy_rules_ = config.redundancy_rules;
+    preload_patterns_ = config.preload_patterns;
+    load_rebalance_enabled_ = config.load_rebalance_enabled;
+    load_rebalance_threshold_ = config.load_rebalance_threshold;
+    load_rebalance_max_utilization_ = config.load_rebalance_max_utilization;
+    load_rebalance_min_rate_ = config.load_rebalance_min_rate;
+    load_rebalance_max_moves_ = config.load_rebalance_max_moves;
+    
+    // CTP的UpdateTime为交易所时间（北京时间），按配置的固定偏移换算接收时间，不依赖主机时区（容器内通常为UTC）
+    exchange_utc_offset_ms_ = static_cast<int64_t>(config.exchange_utc_offset_minutes) * 60 * 1000;
+    
+    // 预先创建连接统计，行情回调线程只做只读查找
+    for (const auto& conn_config : config.connections) {
+        if (conn_config.enabled) {
+            get_or_create_connection_stats(conn_config.connection_id);
+        }
+    }
+    
+    // 行情断流检测
+    if (config.stale_feed_detection) {
+        FeedWatchdogConfig watchdog_config;
+        watchdog_config.silence_multiplier = config.stale_feed_multiplier;
+        watchdog_config.min_silence_ms = config.stale_feed_min_ms;
+        watchdog_config.max_silence_ms = config.stale_feed_max_ms;
+        feed_watchdog_ = std::make_unique<FeedWatchdog>(watchdog_config);
+        feed_watchdog_->start(
+            [this](const std::string& connection_id) { on_connection_stale(connection_id); },
+            [this](const std::string& connection_id, const std::vector<std::string>& instruments) {
+                on_instruments_stale(connection_id, instruments);
+            });
+    }
+    
+    // CTP订阅/退订命令在独立线程下发，订阅状态的锁内不调用CTP API
+    command_queue_.start(
+        [this](const CTPCommand& command) { return execute_command(command); },
+        [this](const CTPCommand& command, const std::vector<std::string>& accepted) {
+            on_command_result(command, accepted);
+        });
+    
+    // 启动维护定时器
+    start_maintenance_timer();
+    
+    server_->log_info("SubscriptionDispatcher initialized successfully with config:");
+    server_->log_info("  - Maintenance interval: " + std::to_string(config.maintenance_interval) + " seconds");
+    server_->log_info("  - Max retry count: " + std::to_string(max_retry_count_));
+    server_->log_info("  - Load balance strategy: " + config.load_balance_strategy);
+    for (const auto& rule : redundancy_rules_) {
+        server_->log_info("  - Redundancy: " + rule.pattern + " x" + std::to_string(rule.replicas));
+    }
+    if (load_rebalance_enabled_) {
+        server_->log_info("  - Load rebalance: threshold x" + std::to_string(load_rebalance_threshold_) +
+                          ", max utilization " + std::to_string(load_rebalance_max_utilization_) +
+                          ", max moves " + std::to_string(load_rebalance_max_moves_));
+    }
+    server_->log_info("  - Auto failover: " + std::string(config.auto_failover ? "enabled" : "disabled"));
+    server_->log_info("  - Stale feed detection: " + std::string(config.stale_feed_detection ? "enabled" : "disabled"));
+    
+    return true;
+}
+
+void SubscriptionDispatcher::shutdown()
+{
+    if (feed_watchdog_) {
+        feed_watchdog_->stop();
+    }
+    stop_maintenance_timer();
+    command_queue_.stop();  // 先下发完已入队的命令
+    
+    std::vector<std::unique_lock<std::shared_mutex>> shard_locks;
+    for (auto& shard : subscription_shards_) {
+        shard_locks.emplace_back(shard.mutex);
+    }
+    std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+    std::lock_guard<std::mutex> conn_lock(connections_mutex_);
+    
+    for (auto& shard : subscription_shards_) {
+        shard.subscriptions.clear();
+        shard.lingering.clear();
+    }
+    session_subscriptions_.clear();
+    connection_subscriptions_.clear();
+    
+    {
+        std::unique_lock<std::shared_mutex> feed_lock(redundant_feeds_mutex_);
+        redundant_feeds_.clear();
+        redundant_feed_count_.store(0, std::memory_order_relaxed);
+    }
+    
+    server_->log_info("SubscriptionDispatcher shutdown completed");
+}
+
+bool SubscriptionDispatcher::add_subscription(const std::string& session_id, const std::string& instrument_id)
+{
+    SubscriptionShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+    
+    // 检查是否已经存在全局订阅
+    auto global_it = shard.subscriptions.find(instrument_id);
+    if (global_it != shard.subscriptions.end()) {
+        // 添加session到现有订阅（驻留中的订阅直接复用，行情与缓存不中断）
+        if (global_it->second->lingering) {
+            global_it->second->lingering = false;
+            shard.lingering.erase(instrument_id);
+            FLOG_INFO("Revived lingering subscription: {}", instrument_id);
+        }
+        global_it->second->requesting_sessions.insert(session_id);
+        {
+            std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+            session_subscriptions_[session_id].insert(instrument_id);
+        }
+        
+        FLOG_INFO("Added session {} to existing subscription: {}", session_id, instrument_id);
+        return true;
+    }
+    
+    // 创建新的订阅
+    auto subscription_info = std::make_shared<SubscriptionInfo>(instrument_id);
+    subscription_info->requesting_sessions.insert(session_id);
+    subscription_info->replicas = get_redundancy_for(instrument_id);
+    shard.subscriptions[instrument_id] = subscription_info;
+    {
+        std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+        session_subscriptions_[session_id].insert(instrument_id);
+    }
+    
+    if (subscription_info->replicas > 1) {
+        register_redundant_feed(instrument_id);
+    }
+    
+    // 按负载均衡策略选择连接
+    std::shared_ptr<CTPConnection> best_connection = select_connection(instrument_id);
+    if (!best_connection) {
+        server_->log_error("No available connection for subscription: " + instrument_id);
+        subscription_info->status = SubscriptionStatus::FAILED;
+        // 加入重试队列
+        if (should_retry(*subscription_info)) {
+            std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
+            retry_set_.insert(instrument_id);
+        }
+        return false;
+    }
+    
+    subscription_info->assigned_connection_id = best_connection->get_connection_id();
+    subscription_info->status = SubscriptionStatus::SUBSCRIBING;
+    
+    // 入队后立即返回，CTP拒绝时由 on_command_result 提升热备或加入重试队列
+    command_queue_.push(CTPCommand::Type::SUBSCRIBE, subscription_info->assigned_connection_id, {instrument_id});
+    
+    // 冗余订阅：在其它连接上同时订阅热备
+    add_standby_subscriptions(*subscription_info);
+    
+    FLOG_INFO("Added new subscription: {} on connection {}", instrument_id, best_connection->get_connection_id());
+    return true;
+}
+
+bool SubscriptionDispatcher::remove_subscription(const std::string& session_id, const std::string& instrument_id)
+{
+    SubscriptionShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+    
+    ConnectionPlan unsubscribe_plan;
+    release_subscription(shard, session_id, instrument_id, unsubscribe_plan);
+    apply_unsubscription_plan(unsubscribe_plan);
+    return true;
+}
+
+void SubscriptionDispatcher::remove_all_subscriptions_for_session(const std::string& session_id)
+{
+    std::vector<std::string> instruments_to_remove;
+    {
+        std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+        auto sess_it = session_subscriptions_.find(session_id);
+        if (sess_it != session_subscriptions_.end()) {
+            instruments_to_remove.assign(sess_it->second.begin(), sess_it->second.end());
+        }
+    }
+    
+    // 逐个合约只锁其所在分片；同一连接的退订由命令队列合并为批量请求
+    for (const auto& instrument_id : instruments_to_remove) {
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        
+        ConnectionPlan unsubscribe_plan;
+        release_subscription(shard, session_id, instrument_id, unsubscribe_plan);
+        apply_unsubscription_plan(unsubscribe_plan);
+    }
+    
+    FLOG_INFO("Removed all subscriptions for session: {} ({} instruments)", session_id, instruments_to_remove.size());
+}
+
+size_t SubscriptionDispatcher::preload_subscriptions(const std::vector<std::string>& instrument_ids)
+{
+    size_t added = 0;
+    size_t filtered = 0;
+    for (const auto& instrument_id : instrument_ids) {
+        if (!preload_patterns_.empty() &&
+            std::none_of(preload_patterns_.begin(), preload_patterns_.end(),
+                [&instrument_id](const std::string& pattern) {
+                    return wildcard_match(pattern.c_str(), instrument_id.c_str());
+                })) {
+            ++filtered;
+            continue;
+        }
+        
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        {
+            std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+            session_subscriptions_[kPreloadSessionId].insert(instrument_id);
+        }
+        auto global_it = shard.subscriptions.find(instrument_id);
+        if (global_it != shard.subscriptions.end()) {
+            global_it->second->requesting_sessions.insert(kPreloadSessionId);
+            global_it->second->preloaded = true;
+            continue;
+        }
+        
+        // 只登记，由 process_pending_subscriptions 按连接容量分组批量下发
+        auto subscription_info = std::make_shared<SubscriptionInfo>(instrument_id);
+        subscription_info->requesting_sessions.insert(kPreloadSessionId);
+        subscription_info->replicas = get_redundancy_for(instrument_id);
+        subscription_info->preloaded = true;
+        shard.subscriptions[instrument_id] = subscription_info;
+        if (subscription_info->replicas > 1) {
+            register_redundant_feed(instrument_id);
+        }
+        {
+            std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
+            retry_set_.insert(instrument_id);
+        }
+        ++added;
+    }
+    
+    server_->log_info("Preloading " + std::to_string(added) + " instruments" +
+                      (filtered > 0 ? " (" + std::to_string(filtered) + " filtered out by preload_patterns)" : ""));
+    
+    // 已有连接登录时立即下发，其余在连接登录时（handle_connection_recovery）下发
+    process_pending_subscriptions();
+    return added;
+}
+
+void SubscriptionDispatcher::release_subscription(SubscriptionShard& shard, const std::string& session_id,
+                                                  const std::string& instrument_id, ConnectionPlan& unsubscribe_plan)
+{
+    // 从session订阅中移除
+    {
+        std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+        auto sess_it = session_subscriptions_.find(session_id);
+        if (sess_it != session_subscriptions_.end()) {
+            sess_it->second.erase(instrument_id);
+            if (sess_it->second.empty()) {
+                session_subscriptions_.erase(sess_it);
+            }
+        }
+    }
+    
+    // 检查全局订阅
+    auto global_it = shard.subscriptions.find(instrument_id);
+    if (global_it == shard.subscriptions.end()) {
+        return; // 订阅不存在
+    }
+    
+    // 从请求session列表中移除
+    SubscriptionInfo& info = *global_it->second;
+    info.requesting_sessions.erase(session_id);
+    
+    if (!info.requesting_sessions.empty()) {
+        FLOG_INFO("Kept subscription {} (still needed by {} sessions)", instrument_id,
+                  info.requesting_sessions.size());
+        return;
+    }
+    
+    // 没有session再需要此订阅：先驻留一段时间，客户端短时间内重连或刷新时无需重新订阅
+    if (unsubscribe_linger_.count() > 0) {
+        info.lingering = true;
+        info.linger_deadline = std::chrono::steady_clock::now() + unsubscribe_linger_;
+        shard.lingering.insert(instrument_id);
+        FLOG_INFO("Subscription {} lingering for {}s", instrument_id, unsubscribe_linger_.count());
+        return;
+    }
+    
+    drop_subscription(shard, instrument_id, unsubscribe_plan);
+}
+
+void SubscriptionDispatcher::drop_subscription(SubscriptionShard& shard, const std::string& instrument_id,
+                                               ConnectionPlan& unsubscribe_plan)
+{
+    auto global_it = shard.subscriptions.find(instrument_id);
+    if (global_it == shard.subscriptions.end()) {
+        return;
+    }
+    SubscriptionInfo& info = *global_it->second;
+    
+    // 在主连接、热备及迁移中的旧连接上全部退订
+    std::vector<std::string> connection_ids = info.standby_connection_ids;
+    if (!info.assigned_connection_id.empty()) {
+        connection_ids.push_back(info.assigned_connection_id);
+    }
+    if (!info.draining_connection_id.empty()) {
+        connection_ids.push_back(info.draining_connection_id);
+    }
+    
+    for (const auto& connection_id : connection_ids) {
+        unsubscribe_plan[connection_id].push_back(instrument_id);
+        if (feed_watchdog_) {
+            feed_watchdog_->remove_feed(connection_id, instrument_id);
+        }
+    }
+    unregister_redundant_feed(instrument_id);
+    
+    FLOG_INFO("Removed subscription: {} from connection {}", instrument_id, info.assigned_connection_id);
+    shard.lingering.erase(instrument_id);
+    shard.subscriptions.erase(global_it);
+}
+
+void SubscriptionDispatcher::expire_lingering_subscriptions()
+{
+    size_t expired = 0;
+    const auto now = std::chrono::steady_clock::now();
+    
+    for (auto& shard : subscription_shards_) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        if (shard.lingering.empty()) {
+            continue;
+        }
+        
+        std::vector<std::string> to_drop;
+        for (const auto& instrument_id : shard.lingering) {
+            auto it = shard.subscriptions.find(instrument_id);
+            if (it == shard.subscriptions.end() || !it->second->lingering) {
+                to_drop.push_back(instrument_id);  // 已被移除或复用，仅清理索引
+                continue;
+            }
+            if (now >= it->second->linger_deadline && it->second->requesting_sessions.empty()) {
+                to_drop.push_back(instrument_id);
+            }
+        }
+        
+        ConnectionPlan unsubscribe_plan;
+        for (const auto& instrument_id : to_drop) {
+            auto it = shard.subscriptions.find(instrument_id);
+            if (it != shard.subscriptions.end() && it->second->lingering) {
+                drop_subscription(shard, instrument_id, unsubscribe_plan);
+                ++expired;
+            }
+            shard.lingering.erase(instrument_id);
+        }
+        apply_unsubscription_plan(unsubscribe_plan);
+    }
+    
+    if (expired > 0) {
+        FLOG_INFO("Unsubscribed {} lingering subscriptions", expired);
+    }
+}
+
+std::vector<std::string> SubscriptionDispatcher::get_subscriptions_for_session(const std::string& session_id)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    
+    auto it = session_subscriptions_.find(session_id);
+    if (it != session_subscriptions_.end()) {
+        return std::vector<std::string>(it->second.begin(), it->second.end());
+    }
+    
+    return {};
+}
+
+std::vector<std::string> SubscriptionDispatcher::get_sessions_for_instrument(const std::string& instrument_id)
+{
+    const SubscriptionShard& shard = shard_for(instrument_id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    
+    auto it = shard.subscriptions.find(instrument_id);
+    if (it != shard.subscriptions.end()) {
+        return std::vector<std::string>(it->second->requesting_sessions.begin(), 
+                                       it->second->requesting_sessions.end());
+    }
+    
+    return {};
+}
+
+SubscriptionStatus SubscriptionDispatcher::get_subscription_status(const std::string& instrument_id)
+{
+    const SubscriptionShard& shard = shard_for(instrument_id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    
+    auto it = shard.subscriptions.find(instrument_id);
+    if (it != shard.subscriptions.end()) {
+        return it->second->status;
+    }
+    
+    return SubscriptionStatus::CANCELLED;
+}
+
+size_t SubscriptionDispatcher::get_total_subscriptions() const
+{
+    size_t total = 0;
+    for (const auto& shard : subscription_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.subscriptions.size();
+    }
+    return total;
+}
+
+std::vector<ConnectionLoadSnapshot> SubscriptionDispatcher::get_connection_load_snapshot() const
+{
+    std::vector<ConnectionLoadSnapshot> result;
+    std::shared_lock<std::shared_mutex> lock(connection_stats_mutex_);
+    
+    for (const auto& pair : connection_stats_) {
+        ConnectionLoadSnapshot snapshot;
+        snapshot.connection_id = pair.first;
+        const int64_t latency_us = pair.second->latency_ewma_us.load(std::memory_order_relaxed);
+        snapshot.latency_ms = latency_us >= 0 ? latency_us / 1000.0 : -1.0;
+        snapshot.tick_rate = pair.second->tick_rate.load(std::memory_order_relaxed);
+        snapshot.tick_count = pair.second->tick_count.load(std::memory_order_relaxed);
+        snapshot.redundant_wins = pair.second->redundant_wins.load(std::memory_order_relaxed);
+        snapshot.redundant_duplicates = pair.second->redundant_duplicates.load(std::memory_order_relaxed);
+        snapshot.duplicates_suppressed = pair.second->duplicates_suppressed.load(std::memory_order_relaxed);
+        snapshot.callback_utilization = pair.second->callback_utilization.load(std::memory_order_relaxed);
+        result.push_back(snapshot);
+    }
+    return result;
+}
+
+std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection(const std::string& instrument_id,
+                                                                         const std::set<std::string>& excluded)
+{
+    auto available_connections = connection_manager_->get_available_connections();
+    {
+        std::lock_guard<std::mutex> drain_lock(draining_connections_mutex_);
+        if (!excluded.empty() || !draining_connections_.empty()) {
+            available_connections.erase(
+                std::remove_if(available_connections.begin(), available_connections.end(),
+                    [this, &excluded](const std::shared_ptr<CTPConnection>& connection) {
+                        return excluded.count(connection->get_connection_id()) > 0 ||
+                               draining_connections_.count(connection->get_connection_id()) > 0;
+                    }),
+                available_connections.end());
+        }
+    }
+    if (available_connections.empty()) {
+        return nullptr;
+    }
+    
+    std::shared_ptr<CTPConnection> selected;
+    switch (strategy_) {
+        case LoadBalanceStrategy::LEAST_LATENCY:
+            selected = select_connection_least_latency(available_connections);
+            break;
+        case LoadBalanceStrategy::LEAST_LOAD:
+            selected = select_connection_least_load(available_connections, instrument_id);
+            break;
+        case LoadBalanceStrategy::CONSISTENT_HASH:
+            selected = select_connection_consistent_hash(available_connections, instrument_id);
+            break;
+        case LoadBalanceStrategy::ROUND_ROBIN:
+        default:
+            selected = select_connection_round_robin(available_connections);
+            break;
+    }
+    
+    // 记录预估负载，避免同一维护周期内的新订阅全部落到同一个连接
+    if (selected) {
+        ConnectionStats* stats = get_or_create_connection_stats(selected->get_connection_id());
+        atomic_add(stats->pending_load, expected_instrument_rate(instrument_id));
+    }
+    return selected;
+}
+
+std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection_round_robin(
+    const std::vector<std::shared_ptr<CTPConnection>>& candidates)
+{
+    size_t index = round_robin_counter_++ % candidates.size();
+    return candidates[index];
+}
+
+std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection_least_latency(
+    const std::vector<std::shared_ptr<CTPConnection>>& candidates)
+{
+    std::vector<int64_t> latencies(candidates.size(), -1);
+    int64_t latency_sum = 0;
+    size_t measured = 0;
+    
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        ConnectionStats* stats = find_connection_stats(candidates[i]->get_connection_id());
+        if (stats) {
+            latencies[i] = stats->latency_ewma_us.load(std::memory_order_relaxed);
+        }
+        if (latencies[i] >= 0) {
+            latency_sum += latencies[i];
+            ++measured;
+        }
+    }
+    
+    // 还没有任何延迟样本时退化为轮询
+    if (measured == 0) {
+        return select_connection_round_robin(candidates);
+    }
+    
+    // 尚无样本的连接按已知连接的平均延迟计，使新连接也有机会分到订阅
+    const int64_t default_latency = latency_sum / static_cast<int64_t>(measured);
+    size_t best = 0;
+    int64_t best_latency = INT64_MAX;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const int64_t latency = latencies[i] >= 0 ? latencies[i] : default_latency;
+        if (latency < best_latency) {
+            best_latency = latency;
+            best = i;
+        }
+    }
+    return candidates[best];
+}
+
+std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection_least_load(
+    const std::vector<std::shared_ptr<CTPConnection>>& candidates,
+    const std::string& instrument_id)
+{
+    size_t best = 0;
+    double best_load = 0.0;
+    size_t best_subscriptions = 0;
+    bool has_load = false;
+    
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        double load = 0.0;
+        ConnectionStats* stats = find_connection_stats(candidates[i]->get_connection_id());
+        if (stats) {
+            load = stats->tick_rate.load(std::memory_order_relaxed) +
+                   stats->pending_load.load(std::memory_order_relaxed);
+        }
+        has_load = has_load || load > 0.0;
+        
+        const size_t subscriptions = candidates[i]->get_subscription_count();
+        if (i == 0 || load < best_load || (load == best_load && subscriptions < best_subscriptions)) {
+            best = i;
+            best_load = load;
+            best_subscriptions = subscriptions;
+        }
+    }
+    
+    // 还没有任何负载数据时退化为轮询
+    if (!has_load) {
+        return select_connection_round_robin(candidates);
+    }
+    return candidates[best];
+}
+
+std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection_consistent_hash(
+    const std::vector<std::shared_ptr<CTPConnection>>& candidates,
+    const std::string& instrument_id) const
+{
+    // 只依赖合约与连接ID，不依赖计数器等全局状态；已满或不可用的连接由调用方排除，
+    // 合约自然落到其排名第二的连接
+    const uint64_t instrument_hash = stable_hash(instrument_id);
+    size_t best = 0;
+    double best_score = -1.0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const double weight = static_cast<double>(std::max(1, candidates[i]->get_max_subscriptions()));
+        const double score = rendezvous_score(instrument_hash, candidates[i]->get_connection_id(), weight);
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return candidates[best];
+}
+
+ConnectionStats* SubscriptionDispatcher::find_connection_stats(const std::string& connection_id) const
+{
+    std::shared_lock<std::shared_mutex> lock(connection_stats_mutex_);
+    auto it = connection_stats_.find(connection_id);
+    return it != connection_stats_.end() ? it->second.get() : nullptr;
+}
+
+ConnectionStats* SubscriptionDispatcher::get_or_create_connection_stats(const std::string& connection_id)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(connection_stats_mutex_);
+        auto it = connection_stats_.find(connection_id);
+        if (it != connection_stats_.end()) {
+            return it->second.get();
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(connection_stats_mutex_);
+    auto& stats = connection_stats_[connection_id];
+    if (!stats) {
+        stats = std::make_unique<ConnectionStats>();
+    }
+    return stats.get();
+}
+
+InstrumentLoad* SubscriptionDispatcher::get_or_create_instrument_load(const std::string& instrument_id)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(instrument_loads_mutex_);
+        auto it = instrument_loads_.find(instrument_id);
+        if (it != instrument_loads_.end()) {
+            return it->second.get();
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(instrument_loads_mutex_);
+    auto& load = instrument_loads_[instrument_id];
+    if (!load) {
+        load = std::make_unique<InstrumentLoad>();
+    }
+    return load.get();
+}
+
+double SubscriptionDispatcher::expected_instrument_rate(const std::string& instrument_id) const
+{
+    std::shared_lock<std::shared_mutex> lock(instrument_loads_mutex_);
+    auto it = instrument_loads_.find(instrument_id);
+    if (it != instrument_loads_.end()) {
+        const double rate = it->second->tick_rate.load(std::memory_order_relaxed);
+        if (rate >= 0.0) {
+            return rate;
+        }
+    }
+    
+    // 没有历史数据的合约按已统计合约的平均速率估算
+    double sum = 0.0;
+    size_t count = 0;
+    for (const auto& pair : instrument_loads_) {
+        const double rate = pair.second->tick_rate.load(std::memory_order_relaxed);
+        if (rate >= 0.0) {
+            sum += rate;
+            ++count;
+        }
+    }
+    return count > 0 ? sum / count : 1.0;
+}
+
+void SubscriptionDispatcher::record_tick_latency(ConnectionStats* stats, int64_t exchange_ms_of_day, uint64_t receive_time_ms)
+{
+    if (exchange_ms_of_day < 0) {
+        return;
+    }
+    
+    const int64_t receive_ms_of_day = (static_cast<int64_t>(receive_time_ms) + exchange_utc_offset_ms_) % kMsPerDay;
+    int64_t lag_ms = receive_ms_of_day - exchange_ms_of_day;
+    if (lag_ms > kMsPerDay / 2) {
+        lag_ms -= kMsPerDay;
+    } else if (lag_ms < -kMsPerDay / 2) {
+        lag_ms += kMsPerDay;
+    }
+    
+    // 订阅时回放的历史快照、本地时钟大幅偏差等异常样本不计入
+    if (lag_ms < -60000 || lag_ms > 60000) {
+        return;
+    }
+    
+    // 每个连接只有一个CTP回调线程写入，relaxed 读改写即可
+    const int64_t sample_us = lag_ms * 1000;
+    const int64_t previous = stats->latency_ewma_us.load(std::memory_order_relaxed);
+    const int64_t next = previous < 0 ? sample_us : previous + (sample_us - previous) / 16;
+    stats->latency_ewma_us.store(next, std::memory_order_relaxed);
+}
+
+void SubscriptionDispatcher::refresh_load_statistics(double elapsed_seconds)
+{
+    if (elapsed_seconds <= 0.0) {
+        return;
+    }
+    
+    {
+        std::shared_lock<std::shared_mutex> lock(connection_stats_mutex_);
+        for (auto& pair : connection_stats_) {
+            ConnectionStats& stats = *pair.second;
+            const uint64_t count = stats.tick_count.load(std::memory_order_relaxed);
+            stats.tick_rate.store((count - stats.last_tick_count) / elapsed_seconds, std::memory_order_relaxed);
+            stats.pending_load.store(0.0, std::memory_order_relaxed);
+            stats.last_tick_count = count;
+            
+            // 回调线程占用率：行情回调累计耗时的增量 / 统计周期
+            auto connection = connection_manager_ ? connection_manager_->get_connection(pair.first) : nullptr;
+            if (connection) {
+                const uint64_t busy_ns = connection->get_callback_busy_ns();
+                const uint64_t busy_delta = busy_ns >= stats.last_callback_busy_ns ? busy_ns - stats.last_callback_busy_ns : 0;
+                stats.callback_utilization.store(busy_delta / (elapsed_seconds * 1e9), std::memory_order_relaxed);
+                stats.last_callback_busy_ns = busy_ns;
+            }
+        }
+    }
+    
+    {
+        std::shared_lock<std::shared_mutex> lock(instrument_loads_mutex_);
+        for (auto& pair : instrument_loads_) {
+            InstrumentLoad& load = *pair.second;
+            const uint64_t count = load.tick_count.load(std::memory_order_relaxed);
+            load.tick_rate.store((count - load.last_tick_count) / elapsed_seconds, std::memory_order_relaxed);
+            load.last_tick_count = count;
+        }
+    }
+}
+
+bool SubscriptionDispatcher::arbitrate_tick(const std::string& connection_id,
+                                            const std::string& instrument_id,
+                                            const char* update_time,
+                                            int update_millisec,
+                                            int volume,
+                                            uint64_t receive_time_ms)
+{
+    const int64_t exchange_ms = parse_update_time_ms(update_time, update_millisec);
+    
+    if (feed_watchdog_) {
+        feed_watchdog_->on_tick(connection_id, instrument_id, static_cast<int64_t>(receive_time_ms));
+    }
+    
+    // 连接延迟统计（回调线程内只做原子更新，迟到的冗余行情同样计入）
+    ConnectionStats* stats = find_connection_stats(connection_id);
+    if (stats) {
+        stats->tick_count.fetch_add(1, std::memory_order_relaxed);
+        record_tick_latency(stats, exchange_ms, receive_time_ms);
+    }
+    
+    if (redundant_feed_count_.load(std::memory_order_relaxed) == 0 || exchange_ms < 0) {
+        return true;
+    }
+    
+    std::shared_lock<std::shared_mutex> lock(redundant_feeds_mutex_);
+    auto it = redundant_feeds_.find(instrument_id);
+    if (it == redundant_feeds_.end()) {
+        return true;
+    }
+    
+    // 行情键：交易时段内时间（高32位）+ 成交量（低32位），同一笔行情在各连接上键相同
+    constexpr uint64_t kSessionResetMs = 4ULL * 3600 * 1000;
+    const uint64_t key_ms = static_cast<uint64_t>(trading_session_ms(exchange_ms));
+    const uint64_t key = (key_ms << 32) | static_cast<uint32_t>(volume);
+    
+    std::atomic<uint64_t>& last_key = it->second->last_tick_key;
+    uint64_t last = last_key.load(std::memory_order_acquire);
+    while (true) {
+        // 键回退超过4小时视为进入新的交易时段
+        const bool newer = key > last || (last >> 32) > key_ms + kSessionResetMs;
+        if (!newer) {
+            if (stats) {
+                stats->redundant_duplicates.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        if (last_key.compare_exchange_weak(last, key, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            break;
+        }
+    }
+    
+    if (stats) {
+        stats->redundant_wins.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+int SubscriptionDispatcher::get_redundancy_for(const std::string& instrument_id) const
+{
+    for (const auto& rule : redundancy_rules_) {
+        if (wildcard_match(rule.pattern.c_str(), instrument_id.c_str())) {
+            return std::max(1, rule.replicas);
+        }
+    }
+    return 1;
+}
+
+void SubscriptionDispatcher::register_redundant_feed(const std::string& instrument_id)
+{
+    std::unique_lock<std::shared_mutex> lock(redundant_feeds_mutex_);
+    if (redundant_feeds_.find(instrument_id) == redundant_feeds_.end()) {
+        redundant_feeds_[instrument_id] = std::make_unique<RedundantFeed>();
+        redundant_feed_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SubscriptionDispatcher::unregister_redundant_feed(const std::string& instrument_id)
+{
+    std::unique_lock<std::shared_mutex> lock(redundant_feeds_mutex_);
+    if (redundant_feeds_.erase(instrument_id) > 0) {
+        redundant_feed_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void SubscriptionDispatcher::add_standby_subscriptions(SubscriptionInfo& info)
+{
+    if (info.replicas <= 1) {
+        return;
+    }
+    
+    std::set<std::string> excluded(info.standby_connection_ids.begin(), info.standby_connection_ids.end());
+    if (!info.assigned_connection_id.empty()) {
+        excluded.insert(info.assigned_connection_id);
+    }
+    
+    while (static_cast<int>(info.standby_connection_ids.size()) + 1 < info.replicas) {
+        std::shared_ptr<CTPConnection> connection = select_connection(info.instrument_id, excluded);
+        if (!connection) {
+            break;  // 可用连接不足，由维护任务稍后补齐
+        }
+        
+        // 先登记为热备再入队，CTP拒绝时由 on_command_result 撤下
+        const std::string connection_id = connection->get_connection_id();
+        excluded.insert(connection_id);
+        info.standby_connection_ids.push_back(connection_id);
+        command_queue_.push(CTPCommand::Type::SUBSCRIBE, connection_id, {info.instrument_id});
+        FLOG_INFO("Added standby subscription: {} on {}", info.instrument_id, connection_id);
+    }
+}
+
+bool SubscriptionDispatcher::promote_standby(SubscriptionInfo& info)
+{
+    for (auto it = info.standby_connection_ids.begin(); it != info.standby_connection_ids.end(); ++it) {
+        auto connection = connection_manager_->get_connection(*it);
+        if (!connection || connection->get_status() != CTPConnectionStatus::LOGGED_IN) {
+            continue;
+        }
+        
+        server_->log_info("Promoting standby " + *it + " to primary for " + info.instrument_id +
+                          " (was " + info.assigned_connection_id + ")");
+        info.assigned_connection_id = *it;
+        info.status = SubscriptionStatus::ACTIVE;
+        info.retry_count = 0;
+        info.last_update_time = std::chrono::system_clock::now();
+        info.standby_connection_ids.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void SubscriptionDispatcher::replenish_standby_subscriptions()
+{
+    if (redundancy_rules_.empty()) {
+        return;
+    }
+    
+    for (auto& shard : subscription_shards_) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        for (auto& pair : shard.subscriptions) {
+            SubscriptionInfo& info = *pair.second;
+            if (static_cast<int>(info.standby_connection_ids.size()) + 1 < info.replicas) {
+                add_standby_subscriptions(info);
+            }
+        }
+    }
+}
+
+void SubscriptionDispatcher::handle_connection_failure(const std::string& connection_id)
+{
+    std::map<std::string, size_t> migrated_to;   // 目标连接 -> 迁入的订阅数
+    size_t promoted = 0;
+    size_t unassigned = 0;
+    
+    server_->log_warning("Handling connection failure: " + connection_id);
+    
+    // 逐个分片处理，其它分片的订阅请求不受影响
+    for (auto& shard : subscription_shards_) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        
+        // 找出所有使用失败连接的订阅
+        std::vector<std::string> affected_instruments;
+        
+        for (const auto& pair : shard.subscriptions) {
+            SubscriptionInfo& info = *pair.second;
+            
+            // 失效连接上的热备直接移除
+            auto standby_it = std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(), connection_id);
+            if (standby_it != info.standby_connection_ids.end()) {
+                info.standby_connection_ids.erase(standby_it);
+            }
+            
+            // 迁移中的旧连接失效：无需再退订，直接结束重叠期
+            if (info.draining_connection_id == connection_id) {
+                info.draining_connection_id.clear();
+                if (info.replicas <= 1) {
+                    unregister_redundant_feed(info.instrument_id);
+                }
+                continue;
+            }
+            
+            if (info.assigned_connection_id != connection_id) {
+                continue;
+            }
+            
+            // 迁移目标失效：回到仍在推送的旧连接
+            if (!info.draining_connection_id.empty()) {
+                abort_migration(info);
+                continue;
+            }
+            
+            if (info.status == SubscriptionStatus::ACTIVE || info.status == SubscriptionStatus::SUBSCRIBING) {
+                // 有热备时直接提升为主连接，行情不中断
+                if (promote_standby(info)) {
+                    ++promoted;
+                    continue;
+                }
+                affected_instruments.push_back(pair.first);
+                info.status = SubscriptionStatus::FAILED;
+            }
+        }
+        
+        // 为受影响的订阅选择新连接，按目标连接分组
+        ConnectionPlan plan;
+        for (const auto& instrument_id : affected_instruments) {
+            SubscriptionInfo& info = *shard.subscriptions[instrument_id];
+            std::set<std::string> excluded(info.standby_connection_ids.begin(), info.standby_connection_ids.end());
+            excluded.insert(connection_id);
+            
+            std::shared_ptr<CTPConnection> new_connection = select_connection(instrument_id, excluded);
+            if (new_connection) {
+                info.assigned_connection_id = new_connection->get_connection_id();
+                info.status = SubscriptionStatus::SUBSCRIBING;
+                info.retry_count = 0;
+                plan[info.assigned_connection_id].push_back(instrument_id);
+            } else {
+                // 找不到可用连接，加入重试队列
+                ++unassigned;
+                if (should_retry(info)) {
+                    std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
+                    retry_set_.insert(instrument_id);
+                }
+            }
+        }
+        
+        // 入队后由命令队列按目标连接合并为批量订阅
+        apply_subscription_plan(plan);
+        for (const auto& pair : plan) {
+            migrated_to[pair.first] += pair.second.size();
+        }
+    }
+    
+    // 清理连接相关的订阅记录
+    {
+        std::lock_guard<std::mutex> conn_lock(connections_mutex_);
+        connection_subscriptions_.erase(connection_id);
+    }
+    if (feed_watchdog_) {
+        feed_watchdog_->remove_connection(connection_id);
+    }
+    
+    size_t migrated = 0;
+    for (const auto& pair : migrated_to) {
+        migrated += pair.second;
+        server_->log_info("Migrated " + std::to_string(pair.second) + " subscriptions from " +
+                          connection_id + " to " + pair.first);
+    }
+    server_->log_info("Connection failure handling completed for: " + connection_id +
+                      " (promoted " + std::to_string(promoted) + ", migrated " + std::to_string(migrated) +
+                      ", pending retry " + std::to_string(unassigned) + ")");
+}
+
+void SubscriptionDispatcher::on_connection_stale(const std::string& connection_id)
 {
-    shutdown();
+    server_->log_warning("Connection " + connection_id + " is logged in but has stopped delivering market data");
+    
+    // 标记为异常，健康检查会重启该连接；订阅立即迁移
+    auto connection = connection_manager_->get_connection(connection_id);
+    if (connection) {
+        connection->mark_stale();
+    }
+    handle_connection_failure(connection_id);
 }
 
-bool SubscriptionDispatcher::initialize(CTPConnectionManager* connection_manager, const MultiCTPConfig& config)
+void SubscriptionDispatcher::on_instruments_stale(const std::string& connection_id,
+                                                  const std::vector<std::string>& instruments)
 {
-    if (!connection_manager) {
-        server_->log_error("CTPConnectionManager is null");
-        return false;
-    }
-    
-    connection_manager_ = connection_manager;
-    
-    // 从配置中读取参数
-    maintenance_interval_ = std::chrono::seconds(config.maintenance_interval);
-    max_retry_count_ = config.max_retry_count;
+    std::vector<std::string> to_migrate;
+    size_t promoted = 0;
     
-    // 启动维护定时器
-    start_maintenance_timer();
+    for (const auto& instrument_id : instruments) {
+        feed_watchdog_->remove_feed(connection_id, instrument_id);
+        
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        auto it = shard.subscriptions.find(instrument_id);
+        if (it == shard.subscriptions.end()) {
+            continue;
+        }
+        SubscriptionInfo& info = *it->second;
+        
+        // 断流的热备直接撤下，由维护任务补齐
+        auto standby_it = std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(), connection_id);
+        if (standby_it != info.standby_connection_ids.end()) {
+            info.standby_connection_ids.erase(standby_it);
+            command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, connection_id, {instrument_id});
+            continue;
+        }
+        
+        if (info.assigned_connection_id != connection_id || info.status != SubscriptionStatus::ACTIVE) {
+            continue;
+        }
+        
+        if (promote_standby(info)) {
+            command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, connection_id, {instrument_id});
+            ++promoted;
+            continue;
+        }
+        to_migrate.push_back(instrument_id);
+    }
     
-    server_->log_info("SubscriptionDispatcher initialized successfully with config:");
-    server_->log_info("  - Maintenance interval: " + std::to_string(config.maintenance_interval) + " seconds");
-    server_->log_info("  - Max retry count: " + std::to_string(max_retry_count_));
-    server_->log_info("  - Auto failover: " + std::string(config.auto_failover ? "enabled" : "disabled"));
+    const size_t migrated = migrate_subscriptions(connection_id, to_migrate);
     
-    return true;
+    server_->log_warning("Stale feed on " + connection_id + ": " + std::to_string(instruments.size()) +
+                         " instruments silent, " + std::to_string(promoted) + " promoted, " +
+                         std::to_string(migrated) + " migrating");
 }
 
-void SubscriptionDispatcher::shutdown()
+void SubscriptionDispatcher::handle_connection_recovery(const std::string& connection_id)
 {
-    stop_maintenance_timer();
+    server_->log_info("Connection recovered: " + connection_id);
     
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
-    std::lock_guard<std::mutex> conn_lock(connections_mutex_);
+    // 处理待重试的订阅
+    process_pending_subscriptions();
     
-    global_subscriptions_.clear();
-    session_subscriptions_.clear();
-    connection_subscriptions_.clear();
+    // 一致性哈希：归属该连接的合约迁回（先订后退），使重连后的映射与故障前一致
+    rebalance_to_connection(connection_id);
     
-    server_->log_info("SubscriptionDispatcher shutdown completed");
+    // 补齐冗余订阅的热备
+    replenish_standby_subscriptions();
 }
 
-bool SubscriptionDispatcher::add_subscription(const std::string& session_id, const std::string& instrument_id)
+size_t SubscriptionDispatcher::rebalance_to_connection(const std::string& connection_id)
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
-    
-    // 检查是否已经存在全局订阅
-    auto global_it = global_subscriptions_.find(instrument_id);
-    if (global_it != global_subscriptions_.end()) {
-        // 添加session到现有订阅
-        global_it->second->requesting_sessions.insert(session_id);
-        session_subscriptions_[session_id].insert(instrument_id);
-        
-        server_->log_info("Added session " + session_id + " to existing subscription: " + instrument_id);
-        return true;
+    if (strategy_ != LoadBalanceStrategy::CONSISTENT_HASH) {
+        return 0;
     }
     
-    // 创建新的订阅
-    auto subscription_info = std::make_shared<SubscriptionInfo>(instrument_id);
-    subscription_info->requesting_sessions.insert(session_id);
-    global_subscriptions_[instrument_id] = subscription_info;
-    session_subscriptions_[session_id].insert(instrument_id);
+    auto available_connections = connection_manager_->get_available_connections();
+    auto target = std::find_if(available_connections.begin(), available_connections.end(),
+        [&connection_id](const std::shared_ptr<CTPConnection>& connection) {
+            return connection->get_connection_id() == connection_id;
+        });
+    if (target == available_connections.end()) {
+        return 0;
+    }
     
-    // 使用轮询策略选择连接
-    std::shared_ptr<CTPConnection> best_connection = select_connection_round_robin();
-    if (!best_connection) {
-        server_->log_error("No available connection for subscription: " + instrument_id);
-        subscription_info->status = SubscriptionStatus::FAILED;
-        // 加入重试队列
-        if (subscription_info->retry_count < max_retry_count_) {
-            std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
-            retry_set_.insert(instrument_id);
+    std::map<std::string, std::vector<std::string>> moves;  // from_connection_id -> instruments
+    std::vector<std::shared_ptr<CTPConnection>> candidates;
+    for (const auto& shard : subscription_shards_) {
+        std::shared_lock<std::shared_mutex> shard_lock(shard.mutex);
+        
+        for (const auto& pair : shard.subscriptions) {
+            const SubscriptionInfo& info = *pair.second;
+            if (info.status != SubscriptionStatus::ACTIVE || !info.draining_connection_id.empty() ||
+                info.assigned_connection_id == connection_id ||
+                std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(),
+                          connection_id) != info.standby_connection_ids.end()) {
+                continue;
+            }
+            
+            // 与 migrate_subscriptions 的选择口径一致：排除热备连接
+            candidates.clear();
+            for (const auto& connection : available_connections) {
+                if (std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(),
+                              connection->get_connection_id()) == info.standby_connection_ids.end()) {
+                    candidates.push_back(connection);
+                }
+            }
+            if (candidates.empty()) {
+                continue;
+            }
+            
+            auto home = select_connection_consistent_hash(candidates, info.instrument_id);
+            if (home->get_connection_id() == connection_id) {
+                moves[info.assigned_connection_id].push_back(info.instrument_id);
+            }
         }
-        return false;
     }
     
-    subscription_info->assigned_connection_id = best_connection->get_connection_id();
-    subscription_info->status = SubscriptionStatus::SUBSCRIBING;
-    
-    // 执行订阅
-    bool result = execute_subscription(instrument_id, best_connection->get_connection_id());
-    if (!result) {
-        subscription_info->status = SubscriptionStatus::FAILED;
+    size_t moved = 0;
+    for (const auto& move : moves) {
+        moved += migrate_subscriptions(move.first, move.second);
     }
-    
-    server_->log_info("Added new subscription: " + instrument_id + " on connection " + 
-                     best_connection->get_connection_id());
-    return result;
+    if (moved > 0) {
+        server_->log_info("Rebalanced " + std::to_string(moved) + " subscriptions back to " + connection_id);
+    }
+    return moved;
 }
 
-bool SubscriptionDispatcher::remove_subscription(const std::string& session_id, const std::string& instrument_id)
+size_t SubscriptionDispatcher::rebalance_by_load()
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
+    // 一致性哈希下合约归属由哈希决定，按负载迁移会与之相互抵消
+    if (!load_rebalance_enabled_ || !connection_manager_ || strategy_ == LoadBalanceStrategy::CONSISTENT_HASH) {
+        return 0;
+    }
     
-    // 从session订阅中移除
-    auto sess_it = session_subscriptions_.find(session_id);
-    if (sess_it != session_subscriptions_.end()) {
-        sess_it->second.erase(instrument_id);
-        if (sess_it->second.empty()) {
-            session_subscriptions_.erase(sess_it);
+    struct Load {
+        std::shared_ptr<CTPConnection> connection;
+        double rate;
+        double utilization;
+    };
+    std::vector<Load> loads;
+    double total_rate = 0.0;
+    for (const auto& connection : connection_manager_->get_available_connections()) {
+        ConnectionStats* stats = find_connection_stats(connection->get_connection_id());
+        Load load{connection, 0.0, 0.0};
+        if (stats) {
+            load.rate = stats->tick_rate.load(std::memory_order_relaxed);
+            load.utilization = stats->callback_utilization.load(std::memory_order_relaxed);
         }
+        total_rate += load.rate;
+        loads.push_back(load);
     }
-    
-    // 检查全局订阅
-    auto global_it = global_subscriptions_.find(instrument_id);
-    if (global_it == global_subscriptions_.end()) {
-        return true; // 订阅不存在
+    if (loads.size() < 2) {
+        return 0;
     }
     
-    // 从请求session列表中移除
-    global_it->second->requesting_sessions.erase(session_id);
+    // 回调线程接近饱和的连接优先，其次是速率明显高于平均的连接
+    const double mean_rate = total_rate / loads.size();
+    auto busiest = std::max_element(loads.begin(), loads.end(),
+        [](const Load& a, const Load& b) { return a.utilization < b.utilization; });
+    auto hottest = std::max_element(loads.begin(), loads.end(),
+        [](const Load& a, const Load& b) { return a.rate < b.rate; });
+    const bool saturated = busiest->utilization > load_rebalance_max_utilization_;
+    const Load& hot = saturated ? *busiest : *hottest;
+    if (hot.rate < load_rebalance_min_rate_ || (!saturated && hot.rate <= mean_rate * load_rebalance_threshold_)) {
+        return 0;
+    }
     
-    // 如果没有session再需要此订阅，则取消CTP订阅
-    if (global_it->second->requesting_sessions.empty()) {
-        std::string connection_id = global_it->second->assigned_connection_id;
-        
-        if (execute_unsubscription(instrument_id, connection_id)) {
-            server_->log_info("Removed subscription: " + instrument_id + " from connection " + connection_id);
+    const Load* cold = nullptr;
+    for (const auto& load : loads) {
+        if (load.connection == hot.connection ||
+            load.connection->get_subscription_count() >= static_cast<size_t>(load.connection->get_max_subscriptions())) {
+            continue;
         }
-        
-        global_subscriptions_.erase(global_it);
-    } else {
-        server_->log_info("Kept subscription " + instrument_id + " (still needed by " + 
-                         std::to_string(global_it->second->requesting_sessions.size()) + " sessions)");
+        const double key = saturated ? load.utilization : load.rate;
+        if (!cold || key < (saturated ? cold->utilization : cold->rate)) {
+            cold = &load;
+        }
+    }
+    if (!cold) {
+        return 0;
     }
     
-    return true;
-}
-
-void SubscriptionDispatcher::remove_all_subscriptions_for_session(const std::string& session_id)
-{
-    std::vector<std::string> instruments_to_remove;
+    // 迁移量（条/秒）：使两个连接的速率或占用率接近
+    const double budget = saturated
+        ? hot.rate * (hot.utilization - cold->utilization) / (2.0 * hot.utilization)
+        : (hot.rate - cold->rate) / 2.0;
+    if (budget <= 0.0) {
+        return 0;
+    }
     
-    {
-        std::lock_guard<std::mutex> sess_lock(sessions_mutex_);
-        auto sess_it = session_subscriptions_.find(session_id);
-        if (sess_it != session_subscriptions_.end()) {
-            instruments_to_remove.assign(sess_it->second.begin(), sess_it->second.end());
+    const std::string& hot_id = hot.connection->get_connection_id();
+    const std::string& cold_id = cold->connection->get_connection_id();
+    std::vector<std::string> candidates;
+    for (const auto& shard : subscription_shards_) {
+        std::shared_lock<std::shared_mutex> shard_lock(shard.mutex);
+        for (const auto& pair : shard.subscriptions) {
+            const SubscriptionInfo& info = *pair.second;
+            if (info.assigned_connection_id == hot_id && info.status == SubscriptionStatus::ACTIVE &&
+                info.draining_connection_id.empty() &&
+                std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(),
+                          cold_id) == info.standby_connection_ids.end()) {
+                candidates.push_back(pair.first);
+            }
         }
     }
     
-    for (const auto& instrument_id : instruments_to_remove) {
-        remove_subscription(session_id, instrument_id);
+    std::vector<std::pair<double, std::string>> rated;
+    {
+        std::shared_lock<std::shared_mutex> lock(instrument_loads_mutex_);
+        for (auto& instrument_id : candidates) {
+            auto it = instrument_loads_.find(instrument_id);
+            const double rate = it != instrument_loads_.end() ? it->second->tick_rate.load(std::memory_order_relaxed) : -1.0;
+            if (rate > 0.0) {
+                rated.emplace_back(rate, std::move(instrument_id));
+            }
+        }
     }
     
-    server_->log_info("Removed all subscriptions for session: " + session_id);
-}
-
-std::vector<std::string> SubscriptionDispatcher::get_subscriptions_for_session(const std::string& session_id)
-{
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    
-    auto it = session_subscriptions_.find(session_id);
-    if (it != session_subscriptions_.end()) {
-        return std::vector<std::string>(it->second.begin(), it->second.end());
+    // 从速率高的合约开始挑选，不超过迁移量，用较少的迁移达到平衡
+    std::sort(rated.begin(), rated.end(),
+        [](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) { return a.first > b.first; });
+    std::vector<std::string> moves;
+    double moved_rate = 0.0;
+    for (const auto& item : rated) {
+        if (static_cast<int>(moves.size()) >= load_rebalance_max_moves_) {
+            break;
+        }
+        if (moved_rate + item.first <= budget) {
+            moves.push_back(item.second);
+            moved_rate += item.first;
+        }
     }
-    
-    return {};
-}
-
-std::vector<std::string> SubscriptionDispatcher::get_sessions_for_instrument(const std::string& instrument_id)
-{
-    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
-    
-    auto it = global_subscriptions_.find(instrument_id);
-    if (it != global_subscriptions_.end()) {
-        return std::vector<std::string>(it->second->requesting_sessions.begin(), 
-                                       it->second->requesting_sessions.end());
+    if (moves.empty()) {
+        return 0;
     }
     
-    return {};
+    server_->log_info("Load imbalance: " + hot_id + " rate=" + std::to_string(hot.rate) + "/s busy=" +
+                      std::to_string(static_cast<int>(hot.utilization * 100)) + "%, " + cold_id +
+                      " rate=" + std::to_string(cold->rate) + "/s busy=" +
+                      std::to_string(static_cast<int>(cold->utilization * 100)) + "%, moving " +
+                      std::to_string(moves.size()) + " instruments (" + std::to_string(moved_rate) + "/s)");
+    return migrate_subscriptions(hot_id, moves, cold_id);
 }
 
-SubscriptionStatus SubscriptionDispatcher::get_subscription_status(const std::string& instrument_id)
+size_t SubscriptionDispatcher::drain_connection(const std::string& connection_id)
 {
-    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    {
+        std::lock_guard<std::mutex> drain_lock(draining_connections_mutex_);
+        draining_connections_.insert(connection_id);
+    }
     
-    auto it = global_subscriptions_.find(instrument_id);
-    if (it != global_subscriptions_.end()) {
-        return it->second->status;
+    std::vector<std::string> to_migrate;
+    size_t promoted = 0;
+    size_t standbys = 0;
+    for (auto& shard : subscription_shards_) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        for (auto& pair : shard.subscriptions) {
+            SubscriptionInfo& info = *pair.second;
+            
+            // 热备撤下，由维护任务在其它连接上补齐
+            auto standby_it = std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(), connection_id);
+            if (standby_it != info.standby_connection_ids.end()) {
+                info.standby_connection_ids.erase(standby_it);
+                command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, connection_id, {info.instrument_id});
+                ++standbys;
+                continue;
+            }
+            
+            if (info.assigned_connection_id != connection_id || info.status != SubscriptionStatus::ACTIVE ||
+                !info.draining_connection_id.empty()) {
+                continue;
+            }
+            // 热备已在订阅，直接提升后退订本连接
+            if (promote_standby(info)) {
+                command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, connection_id, {info.instrument_id});
+                ++promoted;
+                continue;
+            }
+            to_migrate.push_back(info.instrument_id);
+        }
     }
     
-    return SubscriptionStatus::CANCELLED;
+    const size_t migrating = migrate_subscriptions(connection_id, to_migrate);
+    server_->log_info("Draining connection " + connection_id + ": " + std::to_string(promoted) + " promoted, " +
+                      std::to_string(migrating) + " migrating, " + std::to_string(standbys) + " standbys released");
+    return migrating;
 }
 
-size_t SubscriptionDispatcher::get_total_subscriptions() const
+bool SubscriptionDispatcher::connection_drained(const std::string& connection_id) const
 {
-    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
-    return global_subscriptions_.size();
+    for (const auto& shard : subscription_shards_) {
+        std::shared_lock<std::shared_mutex> shard_lock(shard.mutex);
+        for (const auto& pair : shard.subscriptions) {
+            const SubscriptionInfo& info = *pair.second;
+            if (info.assigned_connection_id == connection_id || info.draining_connection_id == connection_id ||
+                std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(), connection_id) !=
+                    info.standby_connection_ids.end()) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
-std::shared_ptr<CTPConnection> SubscriptionDispatcher::select_connection_round_robin()
+void SubscriptionDispatcher::end_connection_drain(const std::string& connection_id)
 {
-    auto available_connections = connection_manager_->get_available_connections();
-    if (available_connections.empty()) {
-        return nullptr;
-    }
-    
-    size_t index = round_robin_counter_++ % available_connections.size();
-    return available_connections[index];
+    std::lock_guard<std::mutex> drain_lock(draining_connections_mutex_);
+    draining_connections_.erase(connection_id);
 }
 
-void SubscriptionDispatcher::handle_connection_failure(const std::string& connection_id)
+size_t SubscriptionDispatcher::migrate_subscriptions(const std::string& from_connection_id,
+                                                     const std::vector<std::string>& instrument_ids,
+                                                     const std::string& to_connection_id)
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    std::lock_guard<std::mutex> conn_lock(connections_mutex_);
-    
-    server_->log_warning("Handling connection failure: " + connection_id);
-    
-    // 找出所有使用失败连接的订阅
-    std::vector<std::string> affected_instruments;
+    std::map<std::string, size_t> migrating_to;   // 目标连接 -> 迁入的订阅数
     
-    for (const auto& pair : global_subscriptions_) {
-        if (pair.second->assigned_connection_id == connection_id && 
-            pair.second->status == SubscriptionStatus::ACTIVE) {
-            affected_instruments.push_back(pair.first);
-            pair.second->status = SubscriptionStatus::FAILED;
+    for (const auto& instrument_id : instrument_ids) {
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        auto it = shard.subscriptions.find(instrument_id);
+        if (it == shard.subscriptions.end()) {
+            continue;
         }
-    }
-    
-    // 将受影响的订阅迁移到其他连接
-    for (const auto& instrument_id : affected_instruments) {
-        std::shared_ptr<CTPConnection> new_connection = select_connection_round_robin();
-        if (new_connection && new_connection->get_connection_id() != connection_id) {
-            migrate_subscription(instrument_id, connection_id, new_connection->get_connection_id());
-        } else {
-            server_->log_error("No available connection to migrate subscription: " + instrument_id);
-            // 找不到可用连接，加入重试队列
-            auto it = global_subscriptions_.find(instrument_id);
-            if (it != global_subscriptions_.end() && it->second->retry_count < max_retry_count_) {
-                std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
-                retry_set_.insert(instrument_id);
+        SubscriptionInfo& info = *it->second;
+        if (info.assigned_connection_id != from_connection_id ||
+            info.status != SubscriptionStatus::ACTIVE ||
+            !info.draining_connection_id.empty()) {
+            continue;
+        }
+        
+        std::set<std::string> excluded(info.standby_connection_ids.begin(), info.standby_connection_ids.end());
+        excluded.insert(from_connection_id);
+        std::shared_ptr<CTPConnection> new_connection;
+        if (to_connection_id.empty()) {
+            new_connection = select_connection(instrument_id, excluded);
+        } else if (excluded.count(to_connection_id) == 0) {
+            new_connection = connection_manager_->get_connection(to_connection_id);
+            if (new_connection && new_connection->get_status() != CTPConnectionStatus::LOGGED_IN) {
+                new_connection.reset();
+            }
+            std::lock_guard<std::mutex> drain_lock(draining_connections_mutex_);
+            if (draining_connections_.count(to_connection_id) > 0) {
+                new_connection.reset();  // 目标连接正计划下线
             }
         }
+        if (!new_connection) {
+            server_->log_warning("No alternative connection to migrate " + instrument_id + " from " + from_connection_id);
+            continue;
+        }
+        
+        // 旧连接保持订阅直到新连接确认，重叠期间两路行情按先到先得去重
+        info.draining_connection_id = from_connection_id;
+        info.assigned_connection_id = new_connection->get_connection_id();
+        info.status = SubscriptionStatus::SUBSCRIBING;
+        register_redundant_feed(instrument_id);
+        command_queue_.push(CTPCommand::Type::SUBSCRIBE, info.assigned_connection_id, {instrument_id});
+        ++migrating_to[info.assigned_connection_id];
     }
     
-    // 清理连接相关的订阅记录
-    connection_subscriptions_.erase(connection_id);
-    
-    server_->log_info("Connection failure handling completed for: " + connection_id);
+    size_t migrating = 0;
+    for (const auto& pair : migrating_to) {
+        migrating += pair.second;
+        server_->log_info("Migrating " + std::to_string(pair.second) + " subscriptions from " +
+                          from_connection_id + " to " + pair.first + " (make-before-break)");
+    }
+    return migrating;
 }
 
-void SubscriptionDispatcher::handle_connection_recovery(const std::string& connection_id)
+void SubscriptionDispatcher::finish_migration(SubscriptionInfo& info)
 {
-    server_->log_info("Connection recovered: " + connection_id);
+    const std::string old_connection_id = info.draining_connection_id;
+    info.draining_connection_id.clear();
     
-    // 处理待重试的订阅
-    process_pending_subscriptions();
+    command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, old_connection_id, {info.instrument_id});
+    if (info.replicas <= 1) {
+        unregister_redundant_feed(info.instrument_id);
+    }
+    if (feed_watchdog_) {
+        feed_watchdog_->remove_feed(old_connection_id, info.instrument_id);
+    }
+    
+    FLOG_INFO("Migrated {} from {} to {}", info.instrument_id, old_connection_id, info.assigned_connection_id);
 }
 
-void SubscriptionDispatcher::migrate_subscription(const std::string& instrument_id, 
-                                                const std::string& from_connection_id, 
-                                                const std::string& to_connection_id)
+void SubscriptionDispatcher::abort_migration(SubscriptionInfo& info)
 {
-    server_->log_info("Migrating subscription " + instrument_id + " from " + 
-                     from_connection_id + " to " + to_connection_id);
-    
-    auto it = global_subscriptions_.find(instrument_id);
-    if (it == global_subscriptions_.end()) {
-        return;
-    }
-    
-    // 更新订阅信息
-    it->second->assigned_connection_id = to_connection_id;
-    it->second->status = SubscriptionStatus::SUBSCRIBING;
-    it->second->retry_count = 0;
+    server_->log_warning("Migration of " + info.instrument_id + " to " + info.assigned_connection_id +
+                         " failed, staying on " + info.draining_connection_id);
     
-    // 执行新订阅
-    if (execute_subscription(instrument_id, to_connection_id)) {
-        server_->log_info("Successfully migrated subscription: " + instrument_id);
-    } else {
-        server_->log_error("Failed to migrate subscription: " + instrument_id);
-        it->second->status = SubscriptionStatus::FAILED;
-        
-        // 转移失败，加入重试队列
-        if (it->second->retry_count < max_retry_count_) {
-            std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
-            retry_set_.insert(instrument_id);
-        }
+    info.assigned_connection_id = info.draining_connection_id;
+    info.draining_connection_id.clear();
+    info.status = SubscriptionStatus::ACTIVE;
+    info.last_update_time = std::chrono::system_clock::now();
+    if (info.replicas <= 1) {
+        unregister_redundant_feed(info.instrument_id);
     }
 }
 
 void SubscriptionDispatcher::on_subscription_success(const std::string& connection_id, const std::string& instrument_id)
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    std::lock_guard<std::mutex> conn_lock(connections_mutex_);
+    SubscriptionShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
     
-    auto it = global_subscriptions_.find(instrument_id);
-    if (it != global_subscriptions_.end()) {
-        it->second->status = SubscriptionStatus::ACTIVE;
-        it->second->last_update_time = std::chrono::system_clock::now();
+    auto it = shard.subscriptions.find(instrument_id);
+    if (it != shard.subscriptions.end()) {
+        if (it->second->assigned_connection_id == connection_id) {
+            it->second->status = SubscriptionStatus::ACTIVE;
+            it->second->last_update_time = std::chrono::system_clock::now();
+            
+            // 先订后退：新连接已确认，退订旧连接
+            if (!it->second->draining_connection_id.empty()) {
+                finish_migration(*it->second);
+            }
+        }
         
-        connection_subscriptions_[connection_id].insert(instrument_id);
+        {
+            std::lock_guard<std::mutex> conn_lock(connections_mutex_);
+            connection_subscriptions_[connection_id].insert(instrument_id);
+        }
         
-        server_->log_info("Subscription successful: " + instrument_id + " on " + connection_id);
+        FLOG_INFO("Subscription successful: {} on {}", instrument_id, connection_id);
     }
 }
 
 void SubscriptionDispatcher::on_subscription_failed(const std::string& connection_id, const std::string& instrument_id)
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
+    SubscriptionShard& shard = shard_for(instrument_id);
+    std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
     
-    auto it = global_subscriptions_.find(instrument_id);
-    if (it != global_subscriptions_.end()) {
-        it->second->status = SubscriptionStatus::FAILED;
-        it->second->retry_count++;
-        it->second->last_update_time = std::chrono::system_clock::now();
+    auto it = shard.subscriptions.find(instrument_id);
+    if (it != shard.subscriptions.end()) {
+        auto& standbys = it->second->standby_connection_ids;
+        auto standby_it = std::find(standbys.begin(), standbys.end(), connection_id);
+        if (standby_it != standbys.end()) {
+            // 热备订阅失败只移除该热备，由维护任务在其它连接上补齐
+            standbys.erase(standby_it);
+            server_->log_warning("Standby subscription failed: " + instrument_id + " on " + connection_id);
+            return;
+        }
+        if (it->second->assigned_connection_id == connection_id && !it->second->draining_connection_id.empty()) {
+            abort_migration(*it->second);
+            return;
+        }
+        if (it->second->assigned_connection_id == connection_id && promote_standby(*it->second)) {
+            return;
+        }
         
+        record_subscription_failure(*it->second);
         
         // 如果重试次数未超限，加入重试队列
-        if (it->second->retry_count < max_retry_count_) {
+        if (should_retry(*it->second)) {
             std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
             retry_set_.insert(instrument_id);
         }
@@ -349,7 +1579,18 @@ void SubscriptionDispatcher::on_unsubscription_success(const std::string& connec
         }
     }
     
-    server_->log_info("Unsubscription successful: " + instrument_id + " on " + connection_id);
+    FLOG_INFO("Unsubscription successful: {} on {}", instrument_id, connection_id);
+}
+
+void SubscriptionDispatcher::on_duplicate_tick(const std::string& connection_id, const std::string& instrument_id)
+{
+    // 重发快照同样占用回调线程，计入合约速率以保持负载统计准确
+    get_or_create_instrument_load(instrument_id)->tick_count.fetch_add(1, std::memory_order_relaxed);
+    
+    ConnectionStats* stats = find_connection_stats(connection_id);
+    if (stats) {
+        stats->duplicates_suppressed.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void SubscriptionDispatcher::on_market_data(const std::string& connection_id, 
@@ -357,6 +1598,9 @@ void SubscriptionDispatcher::on_market_data(const std::string& connection_id,
                                           const MarketDataStruct& market_data,
                                           const std::string& display_instrument)
 {
+    // 合约速率统计（连接级统计已在 arbitrate_tick 中完成）
+    get_or_create_instrument_load(instrument_id)->tick_count.fetch_add(1, std::memory_order_relaxed);
+    
     // 行情数据已经在ctp_connection_manager中使用结构体缓存
     // 通知线性合约管理器组件行情更新（使用结构体传递）
     if (server_) {
@@ -364,33 +1608,117 @@ void SubscriptionDispatcher::on_market_data(const std::string& connection_id,
     }
 }
 
-bool SubscriptionDispatcher::execute_subscription(const std::string& instrument_id, const std::string& connection_id)
+std::vector<std::string> SubscriptionDispatcher::execute_command(const CTPCommand& command)
 {
     if (!connection_manager_) {
-        return false;
+        return {};
     }
     
-    auto connection = connection_manager_->get_connection(connection_id);
-    if (!connection) {
-        server_->log_error("Connection not found: " + connection_id);
-        return false;
+    auto connection = connection_manager_->get_connection(command.connection_id);
+    if (command.type == CTPCommand::Type::UNSUBSCRIBE) {
+        if (!connection) {
+            return command.instrument_ids; // 连接不存在，认为取消订阅成功
+        }
+        return connection->unsubscribe_instruments(command.instrument_ids);
     }
     
-    return connection->subscribe_instrument(instrument_id);
+    if (!connection) {
+        server_->log_error("Connection not found: " + command.connection_id);
+        return {};
+    }
+    return connection->subscribe_instruments(command.instrument_ids);
 }
 
-bool SubscriptionDispatcher::execute_unsubscription(const std::string& instrument_id, const std::string& connection_id)
+void SubscriptionDispatcher::on_command_result(const CTPCommand& command, const std::vector<std::string>& accepted)
 {
-    if (!connection_manager_) {
-        return false;
+    if (command.type == CTPCommand::Type::UNSUBSCRIBE) {
+        if (accepted.size() != command.instrument_ids.size()) {
+            server_->log_warning("Unsubscribed " + std::to_string(accepted.size()) + " of " +
+                                 std::to_string(command.instrument_ids.size()) + " instruments on " +
+                                 command.connection_id);
+        }
+        return;
     }
     
-    auto connection = connection_manager_->get_connection(connection_id);
-    if (!connection) {
-        return true; // 连接不存在，认为取消订阅成功
+    const std::set<std::string> accepted_set(accepted.begin(), accepted.end());
+    for (const auto& instrument_id : command.instrument_ids) {
+        const bool ok = accepted_set.count(instrument_id) > 0;
+        
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        auto it = shard.subscriptions.find(instrument_id);
+        if (it == shard.subscriptions.end()) {
+            continue;  // 下发期间订阅已被移除
+        }
+        SubscriptionInfo& info = *it->second;
+        
+        if (info.assigned_connection_id != command.connection_id) {
+            // 热备被拒绝：撤下该热备，由维护任务在其它连接上补齐
+            auto standby_it = std::find(info.standby_connection_ids.begin(), info.standby_connection_ids.end(),
+                                        command.connection_id);
+            if (!ok && standby_it != info.standby_connection_ids.end()) {
+                info.standby_connection_ids.erase(standby_it);
+            }
+            continue;  // 或下发期间已重新分配
+        }
+        
+        if (ok) {
+            info.retry_count = 0;
+            continue;
+        }
+        
+        if (!info.draining_connection_id.empty()) {
+            abort_migration(info);
+            continue;
+        }
+        if (promote_standby(info)) {
+            continue;
+        }
+        
+        // 同步拒绝（合约不存在、流控 -2/-3 等）与 OnRspSubMarketData 的失败一样计入重试次数
+        record_subscription_failure(info);
+        if (should_retry(info)) {
+            std::lock_guard<std::mutex> retry_lock(retry_set_mutex_);
+            retry_set_.insert(instrument_id);
+        }
+    }
+    
+    if (accepted.size() != command.instrument_ids.size()) {
+        server_->log_warning("Subscribed " + std::to_string(accepted.size()) + " of " +
+                             std::to_string(command.instrument_ids.size()) + " instruments on " +
+                             command.connection_id);
+    }
+}
+
+void SubscriptionDispatcher::apply_subscription_plan(const ConnectionPlan& plan)
+{
+    for (const auto& pair : plan) {
+        command_queue_.push(CTPCommand::Type::SUBSCRIBE, pair.first, pair.second);
+    }
+}
+
+void SubscriptionDispatcher::apply_unsubscription_plan(const ConnectionPlan& plan)
+{
+    for (const auto& pair : plan) {
+        command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, pair.first, pair.second);
+    }
+}
+
+void SubscriptionDispatcher::record_subscription_failure(SubscriptionInfo& info)
+{
+    if (info.retry_count == 0) {
+        info.last_update_time = std::chrono::system_clock::now();
     }
+    info.status = SubscriptionStatus::FAILED;
+    ++info.retry_count;
     
-    return connection->unsubscribe_instrument(instrument_id);
+    // 预订阅不受重试上限限制，超限后按维护间隔指数退避（最长30分钟），避免被拒绝的合约每个周期都重发
+    if (info.preloaded && info.retry_count >= max_retry_count_) {
+        const int exponent = std::min(info.retry_count - max_retry_count_, 10);
+        const auto backoff = std::min<std::chrono::seconds>(maintenance_interval_ * (1 << exponent),
+                                                            std::chrono::minutes(30));
+        info.next_retry_time = std::chrono::steady_clock::now() + backoff;
+    }
 }
 
 void SubscriptionDispatcher::process_pending_subscriptions()
@@ -403,31 +1731,39 @@ void SubscriptionDispatcher::process_pending_subscriptions()
         retry_set_.clear(); // 清空重试队列
     }
     
+    std::map<std::string, size_t> planned_counts;  // 本批计划分配到各连接的订阅数
     std::set<std::string> failed_again;
+    std::set<std::string> full_connections;   // 计入本批计划后已达 max_subscriptions 的连接
+    const auto now = std::chrono::steady_clock::now();
     for (const auto& instrument_id : current_retry_set) {
-        std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-        auto it = global_subscriptions_.find(instrument_id);
-        if (it != global_subscriptions_.end() && it->second->status == SubscriptionStatus::FAILED) {
-            // 使用轮询策略选择新连接重试
-            std::shared_ptr<CTPConnection> new_connection = select_connection_round_robin();
+        SubscriptionShard& shard = shard_for(instrument_id);
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        auto it = shard.subscriptions.find(instrument_id);
+        if (it != shard.subscriptions.end() && it->second->status == SubscriptionStatus::FAILED &&
+            it->second->next_retry_time > now) {
+            failed_again.insert(instrument_id);  // 退避中
+            continue;
+        }
+        if (it != shard.subscriptions.end() &&
+            (it->second->status == SubscriptionStatus::FAILED || it->second->status == SubscriptionStatus::PENDING)) {
+            // 按负载均衡策略选择新连接重试
+            std::set<std::string> excluded(it->second->standby_connection_ids.begin(),
+                                           it->second->standby_connection_ids.end());
+            excluded.insert(full_connections.begin(), full_connections.end());
+            std::shared_ptr<CTPConnection> new_connection = select_connection(instrument_id, excluded);
             if (new_connection) {
                 it->second->assigned_connection_id = new_connection->get_connection_id();
                 it->second->status = SubscriptionStatus::SUBSCRIBING;
-                
-                if (!execute_subscription(instrument_id, new_connection->get_connection_id())) {
-                    it->second->status = SubscriptionStatus::FAILED;
-                    if (it->second->retry_count < max_retry_count_) {
-                        failed_again.insert(instrument_id);
-                    }
-                } else {
-                    // 重试成功，移除重试计数
-                    it->second->retry_count = 0;
+                // 同一连接的重试由命令队列合并为批量订阅，失败的订阅由 on_command_result 重新加入重试队列
+                command_queue_.push(CTPCommand::Type::SUBSCRIBE, it->second->assigned_connection_id, {instrument_id});
+                const size_t planned = ++planned_counts[it->second->assigned_connection_id];
+                if (new_connection->get_subscription_count() + planned >=
+                    static_cast<size_t>(new_connection->get_max_subscriptions())) {
+                    full_connections.insert(it->second->assigned_connection_id);
                 }
-            } else {
+            } else if (should_retry(*it->second)) {
                 // 找不到可用连接，加入重试队列
-                if (it->second->retry_count < max_retry_count_) {
-                    failed_again.insert(instrument_id);
-                }
+                failed_again.insert(instrument_id);
             }
         }
     }
@@ -472,36 +1808,80 @@ void SubscriptionDispatcher::maintenance_task()
             // 清理过期订阅
             cleanup_expired_subscriptions();
             
+            // 补齐冗余订阅的热备
+            replenish_standby_subscriptions();
+            
+            // 更新连接与合约的行情速率统计
+            const auto now = std::chrono::steady_clock::now();
+            refresh_load_statistics(std::chrono::duration<double>(now - last_load_refresh_).count());
+            last_load_refresh_ = now;
+            
+            for (const auto& snapshot : get_connection_load_snapshot()) {
+                server_->log_info("Connection load: " + snapshot.connection_id +
+                                  " latency=" + std::to_string(snapshot.latency_ms) + "ms" +
+                                  " rate=" + std::to_string(snapshot.tick_rate) + "/s" +
+                                  " ticks=" + std::to_string(snapshot.tick_count) +
+                                  " busy=" + std::to_string(static_cast<int>(snapshot.callback_utilization * 100)) + "%" +
+                                  (snapshot.redundant_wins + snapshot.redundant_duplicates > 0
+                                       ? " redundant_wins=" + std::to_string(snapshot.redundant_wins) +
+                                         " redundant_duplicates=" + std::to_string(snapshot.redundant_duplicates)
+                                       : std::string()) +
+                                  (snapshot.duplicates_suppressed > 0
+                                       ? " duplicates_suppressed=" + std::to_string(snapshot.duplicates_suppressed)
+                                       : std::string()));
+            }
+            // 行情速率或回调占用失衡时迁移部分合约
+            rebalance_by_load();
+            
+            server_->log_info("CTP command queue: requests=" + std::to_string(command_queue_.executed_requests()) +
+                              " merged=" + std::to_string(command_queue_.merged_commands()) +
+                              " pending=" + std::to_string(command_queue_.pending()));
+
         } catch (const std::exception& e) {
             server_->log_error("Maintenance task error: " + std::string(e.what()));
         }
         
-        // 等待下次维护
+        // 等待下次维护；驻留到期的订阅按秒回收，不必等到下个维护周期
         for (int i = 0; i < maintenance_interval_.count() && maintenance_running_; ++i) {
             std::this_thread::sleep_for(std::chrono::seconds(1));
+            try {
+                expire_lingering_subscriptions();
+            } catch (const std::exception& e) {
+                server_->log_error("Linger expiry error: " + std::string(e.what()));
+            }
         }
     }
 }
 
 void SubscriptionDispatcher::cleanup_expired_subscriptions()
 {
-    std::lock_guard<std::mutex> sub_lock(subscriptions_mutex_);
-    
     auto now = std::chrono::system_clock::now();
-    std::vector<std::string> to_remove;
     
-    for (const auto& pair : global_subscriptions_) {
-        // 清理长时间失败的订阅
-        if (pair.second->status == SubscriptionStatus::FAILED) {
-            auto time_since_failure = now - pair.second->last_update_time;
-            if (time_since_failure > std::chrono::minutes(10)) { // 10分钟
-                to_remove.push_back(pair.first);
+    for (auto& shard : subscription_shards_) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        
+        std::vector<std::string> to_remove;
+        for (const auto& pair : shard.subscriptions) {
+            // 清理长时间失败的订阅
+            if (pair.second->status == SubscriptionStatus::FAILED && !pair.second->preloaded) {
+                auto time_since_failure = now - pair.second->last_update_time;
+                if (time_since_failure > std::chrono::minutes(10)) { // 10分钟
+                    to_remove.push_back(pair.first);
+                }
             }
         }
-    }
-    
-    for (const auto& instrument_id : to_remove) {
-        global_subscriptions_.erase(instrument_id);
-        server_->log_info("Cleaned up expired subscription: " + instrument_id);
+        
+        for (const auto& instrument_id : to_remove) {
+            auto it = shard.subscriptions.find(instrument_id);
+            for (const auto& standby_id : it->second->standby_connection_ids) {
+                command_queue_.push(CTPCommand::Type::UNSUBSCRIBE, standby_id, {instrument_id});
+            }
+            if (it->second->replicas > 1) {
+                unregister_redundant_feed(instrument_id);
+            }
+            shard.lingering.erase(instrument_id);
+            shard.subscriptions.erase(it);
+            server_->log_info("Cleaned up expired subscription: " + instrument_id);
+        }
     }
 }
\ No newline at end of file
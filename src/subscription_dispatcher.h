@@ -1,13 +1,18 @@
 #pragma once
 
 #include "multi_ctp_config.h"
+#include "feed_watchdog.h"
+#include "ctp_command_queue.h"
 // 使用项目中的类型定义，其中包含了rapidjson的正确配置
 #include "../include/open-trade-common/types.h"
+#include <array>
 #include <memory>
 #include <map>
 #include <set>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 #include <vector>
 #include <atomic>
 #include <thread>
@@ -27,26 +32,85 @@ enum class SubscriptionStatus {
     CANCELLED = 4    // 已取消
 };
 
+// 负载均衡策略
+enum class LoadBalanceStrategy {
+    ROUND_ROBIN = 0,   // 轮询
+    LEAST_LATENCY = 1, // 交易所时间到本地接收延迟最低的连接优先
+    LEAST_LOAD = 2,    // 行情消息速率最低的连接优先
+    CONSISTENT_HASH = 3 // 按 max_subscriptions 加权的rendezvous哈希，连接增减时只有约1/N的合约移动
+};
+
+// 单个连接的行情统计（由该连接的CTP回调线程写入，维护线程计算速率）
+struct ConnectionStats {
+    std::atomic<uint64_t> tick_count{0};          // 累计收到的行情条数
+    std::atomic<int64_t> latency_ewma_us{-1};     // 交易所时间到本地接收的延迟EWMA（微秒，-1表示尚无样本）
+    std::atomic<double> tick_rate{0.0};           // 最近一个维护周期的行情速率（条/秒）
+    std::atomic<double> pending_load{0.0};        // 本周期内新分配但尚未计入tick_rate的预估速率
+    std::atomic<uint64_t> redundant_wins{0};      // 冗余订阅中本连接先到达的行情条数
+    std::atomic<uint64_t> redundant_duplicates{0}; // 冗余订阅中本连接迟到被丢弃的行情条数
+    std::atomic<uint64_t> duplicates_suppressed{0}; // 与缓存内容相同、入缓存前被丢弃的重发快照条数
+    std::atomic<double> callback_utilization{0.0}; // 最近一个维护周期内行情回调耗时占墙钟时间的比例
+    uint64_t last_tick_count = 0;                 // 仅维护线程访问
+    uint64_t last_callback_busy_ns = 0;           // 仅维护线程访问
+};
+
+// 冗余订阅合约的到达仲裁状态
+struct RedundantFeed {
+    std::atomic<uint64_t> last_tick_key{0};       // 已接受的最新行情键（交易时段内时间 + 成交量）
+};
+
+// 单个合约的行情速率统计
+struct InstrumentLoad {
+    std::atomic<uint64_t> tick_count{0};
+    std::atomic<double> tick_rate{-1.0};          // 条/秒，-1表示尚未统计
+    uint64_t last_tick_count = 0;                 // 仅维护线程访问
+};
+
+// 连接负载快照（用于状态输出）
+struct ConnectionLoadSnapshot {
+    std::string connection_id;
+    double latency_ms = -1.0;
+    double tick_rate = 0.0;
+    uint64_t tick_count = 0;
+    uint64_t redundant_wins = 0;
+    uint64_t redundant_duplicates = 0;
+    uint64_t duplicates_suppressed = 0;
+    double callback_utilization = 0.0;
+};
+
 // 订阅信息
 struct SubscriptionInfo {
     std::string instrument_id;
     std::string assigned_connection_id;
+    std::vector<std::string> standby_connection_ids;  // 热备连接（冗余订阅）
+    std::string draining_connection_id;               // 先订后退迁移中、新连接确认后再退订的旧连接
+    int replicas;                                     // 期望同时订阅的连接数（含主连接）
     SubscriptionStatus status;
     std::set<std::string> requesting_sessions;  // 请求该订阅的session列表
     std::chrono::system_clock::time_point created_time;
     std::chrono::system_clock::time_point last_update_time;
     int retry_count;
+    std::chrono::steady_clock::time_point next_retry_time;  // 超过重试上限的预订阅按退避间隔重试
+    bool preloaded;                             // 启动预订阅：不受客户端退订和过期清理影响，超过重试上限后退避重试
+    std::chrono::steady_clock::time_point linger_deadline;  // 无session引用后保持订阅至此时刻（lingering 时有效）
+    bool lingering;
     
     SubscriptionInfo(const std::string& inst_id) 
         : instrument_id(inst_id)
+        , replicas(1)
         , status(SubscriptionStatus::PENDING)
         , created_time(std::chrono::system_clock::now())
         , last_update_time(std::chrono::system_clock::now())
-        , retry_count(0) {}
+        , retry_count(0)
+        , preloaded(false)
+        , lingering(false) {}
 };
 
 
 // 全局订阅分发器
+// 订阅表按合约哈希分片，每个分片一把读写锁：不同合约的订阅/退订互不阻塞，
+// 查询只取分片读锁。CTP请求一律经 CTPCommandQueue 在锁外异步下发。
+// 锁顺序：分片锁 -> sessions_mutex_ -> connections_mutex_ -> retry_set_mutex_，同时只持有一个分片锁（shutdown 除外）
 class SubscriptionDispatcher
 {
 public:
@@ -62,45 +126,141 @@ public:
     bool remove_subscription(const std::string& session_id, const std::string& instrument_id);
     void remove_all_subscriptions_for_session(const std::string& session_id);
     
+    // 启动预订阅（缓存预热）：登记为常驻订阅，按连接容量分组批量下发，返回新增的合约数
+    size_t preload_subscriptions(const std::vector<std::string>& instrument_ids);
+    
     // 订阅状态查询
     std::vector<std::string> get_subscriptions_for_session(const std::string& session_id);
     std::vector<std::string> get_sessions_for_instrument(const std::string& instrument_id);
     SubscriptionStatus get_subscription_status(const std::string& instrument_id);
     size_t get_total_subscriptions() const;
+    std::vector<ConnectionLoadSnapshot> get_connection_load_snapshot() const;
+    LoadBalanceStrategy get_load_balance_strategy() const { return strategy_; }
     
     
     // 故障转移
     void handle_connection_failure(const std::string& connection_id);
     void handle_connection_recovery(const std::string& connection_id);
     
+    // 计划下线（如切换前置）：连接不再接收新订阅，其上的订阅先订后退迁出，热备撤下另行补齐，返回迁移中的订阅数
+    size_t drain_connection(const std::string& connection_id);
+    // 连接上已没有主订阅、热备或未完成的迁移
+    bool connection_drained(const std::string& connection_id) const;
+    void end_connection_drain(const std::string& connection_id);
+    
     // 订阅状态回调（由CTPConnection调用）
     void on_subscription_success(const std::string& connection_id, const std::string& instrument_id);
     void on_subscription_failed(const std::string& connection_id, const std::string& instrument_id);
     void on_unsubscription_success(const std::string& connection_id, const std::string& instrument_id);
     
+    // 冗余订阅到达仲裁（由CTPConnection在构建行情前调用）
+    // 返回 false 表示同一笔行情已由其它连接先送达，应直接丢弃
+    bool arbitrate_tick(const std::string& connection_id,
+                        const std::string& instrument_id,
+                        const char* update_time,
+                        int update_millisec,
+                        int volume,
+                        uint64_t receive_time_ms);
+    
     // 行情数据分发（由CTPConnection调用，使用结构体传递）
     void on_market_data(const std::string& connection_id, 
                        const std::string& instrument_id, 
                        const MarketDataStruct& market_data,
                        const std::string& display_instrument);
     
+    // 与缓存内容相同的重发快照（由CTPConnection在入缓存被丢弃后调用，只做计数）
+    void on_duplicate_tick(const std::string& connection_id, const std::string& instrument_id);
+    
     // 监控和维护
     void start_maintenance_timer();
     void stop_maintenance_timer();
     
 private:
-    // 负载均衡算法实现（轮询）
-    std::shared_ptr<CTPConnection> select_connection_round_robin();
+    // 订阅表分片
+    struct alignas(64) SubscriptionShard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<SubscriptionInfo>> subscriptions;  // instrument_id -> SubscriptionInfo
+        std::set<std::string> lingering;    // 驻留中的合约
+    };
+    static constexpr size_t kSubscriptionShards = 16;
+    SubscriptionShard& shard_for(const std::string& instrument_id);
+    const SubscriptionShard& shard_for(const std::string& instrument_id) const;
+    
+    // 负载均衡：按配置的策略选择连接（不访问订阅表，可在分片锁内调用）
+    std::shared_ptr<CTPConnection> select_connection(const std::string& instrument_id,
+                                                     const std::set<std::string>& excluded = {});
+    std::shared_ptr<CTPConnection> select_connection_round_robin(
+        const std::vector<std::shared_ptr<CTPConnection>>& candidates);
+    std::shared_ptr<CTPConnection> select_connection_least_latency(
+        const std::vector<std::shared_ptr<CTPConnection>>& candidates);
+    std::shared_ptr<CTPConnection> select_connection_least_load(
+        const std::vector<std::shared_ptr<CTPConnection>>& candidates,
+        const std::string& instrument_id);
+    std::shared_ptr<CTPConnection> select_connection_consistent_hash(
+        const std::vector<std::shared_ptr<CTPConnection>>& candidates,
+        const std::string& instrument_id) const;
+    
+    // 行情统计
+    ConnectionStats* find_connection_stats(const std::string& connection_id) const;
+    ConnectionStats* get_or_create_connection_stats(const std::string& connection_id);
+    InstrumentLoad* get_or_create_instrument_load(const std::string& instrument_id);
+    double expected_instrument_rate(const std::string& instrument_id) const;
+    void record_tick_latency(ConnectionStats* stats, int64_t exchange_ms_of_day, uint64_t receive_time_ms);
+    void refresh_load_statistics(double elapsed_seconds);
+    
+    // 冗余订阅
+    int get_redundancy_for(const std::string& instrument_id) const;
+    void register_redundant_feed(const std::string& instrument_id);
+    void unregister_redundant_feed(const std::string& instrument_id);
+    void add_standby_subscriptions(SubscriptionInfo& info);
+    bool promote_standby(SubscriptionInfo& info);
+    void replenish_standby_subscriptions();
+    
+    // 行情断流处理（由 FeedWatchdog 检测线程回调）
+    void on_connection_stale(const std::string& connection_id);
+    void on_instruments_stale(const std::string& connection_id, const std::vector<std::string>& instruments);
     
     // 订阅处理
-    bool execute_subscription(const std::string& instrument_id, const std::string& connection_id);
-    bool execute_unsubscription(const std::string& instrument_id, const std::string& connection_id);
     void process_pending_subscriptions();
+    bool should_retry(const SubscriptionInfo& info) const {
+        return info.preloaded || info.retry_count < max_retry_count_;
+    }
+    // 订阅被拒绝：累计重试次数，失败时间只在首次失败时记录（过期清理按此计时），预订阅超限后退避
+    void record_subscription_failure(SubscriptionInfo& info);
+    
+    // 批量订阅处理：connection_id -> instrument_ids，按连接分组入队，由命令队列线程下发
+    using ConnectionPlan = std::map<std::string, std::vector<std::string>>;
+    void apply_subscription_plan(const ConnectionPlan& plan);
+    void apply_unsubscription_plan(const ConnectionPlan& plan);
+    
+    // 命令队列线程：调用CTP API 并回写订阅状态
+    std::vector<std::string> execute_command(const CTPCommand& command);
+    void on_command_result(const CTPCommand& command, const std::vector<std::string>& accepted);
+    
+    // 释放session对合约的引用，需要退订的合约加入 unsubscribe_plan（调用方持有合约所在分片的写锁）
+    void release_subscription(SubscriptionShard& shard, const std::string& session_id,
+                              const std::string& instrument_id, ConnectionPlan& unsubscribe_plan);
+    
+    // 从所有连接退订并删除订阅（调用方持有合约所在分片的写锁）
+    void drop_subscription(SubscriptionShard& shard, const std::string& instrument_id,
+                           ConnectionPlan& unsubscribe_plan);
+    
+    // 退订延迟：驻留期满且仍无session引用的订阅由维护线程退订
+    void expire_lingering_subscriptions();
+    
+    // 故障转移与主动迁移
+    // 主动迁移为先订后退：新连接订阅确认后再退订旧连接，重叠期间按先到先得去重
+    // to_connection_id 为空时按负载均衡策略选择目标连接
+    size_t migrate_subscriptions(const std::string& from_connection_id, const std::vector<std::string>& instrument_ids,
+                                 const std::string& to_connection_id = std::string());
+    void finish_migration(SubscriptionInfo& info);
+    void abort_migration(SubscriptionInfo& info);
     
-    // 故障转移处理
-    void migrate_subscription(const std::string& instrument_id, 
-                            const std::string& from_connection_id, 
-                            const std::string& to_connection_id);
+    // 一致性哈希模式下，把哈希归属于新登录连接的合约迁回该连接
+    size_t rebalance_to_connection(const std::string& connection_id);
+    
+    // 按行情速率与回调占用率再平衡：失衡时把最热连接上的合约迁往最空闲的连接
+    size_t rebalance_by_load();
     
     // 维护任务
     void maintenance_task();
@@ -110,23 +270,58 @@ private:
     CTPConnectionManager* connection_manager_;
     
     // 订阅数据结构
-    std::map<std::string, std::shared_ptr<SubscriptionInfo>> global_subscriptions_;  // instrument_id -> SubscriptionInfo
+    std::array<SubscriptionShard, kSubscriptionShards> subscription_shards_;
     std::map<std::string, std::set<std::string>> session_subscriptions_;             // session_id -> instrument_ids
     std::map<std::string, std::set<std::string>> connection_subscriptions_;          // connection_id -> instrument_ids
     
-    // 负载均衡（仅轮询）
+    // CTP订阅/退订命令（锁外异步下发）
+    CTPCommandQueue command_queue_;
+    
+    // 负载均衡
+    LoadBalanceStrategy strategy_;
     std::atomic<size_t> round_robin_counter_;
     
-    // 线程安全
-    alignas(64) mutable std::mutex subscriptions_mutex_;
+    // 行情统计：connection_id -> ConnectionStats，instrument_id -> InstrumentLoad
+    std::map<std::string, std::unique_ptr<ConnectionStats>> connection_stats_;
+    std::unordered_map<std::string, std::unique_ptr<InstrumentLoad>> instrument_loads_;
+    mutable std::shared_mutex connection_stats_mutex_;
+    mutable std::shared_mutex instrument_loads_mutex_;
+    int64_t exchange_utc_offset_ms_;           // 交易所时区偏移，用于把接收时间换算到交易所时间
+    std::chrono::steady_clock::time_point last_load_refresh_;
+    
+    // 冗余订阅：规则与仲裁状态（instrument_id -> RedundantFeed）
+    std::vector<RedundancyRule> redundancy_rules_;
+    std::vector<std::string> preload_patterns_;
+    std::unordered_map<std::string, std::unique_ptr<RedundantFeed>> redundant_feeds_;
+    mutable std::shared_mutex redundant_feeds_mutex_;
+    std::atomic<size_t> redundant_feed_count_;  // 为0时行情回调跳过仲裁
+    
+    // 计划下线的连接，select_connection 不再选择
+    std::set<std::string> draining_connections_;
+    mutable std::mutex draining_connections_mutex_;
+    
+    // 行情断流检测（未启用时为空）
+    std::unique_ptr<FeedWatchdog> feed_watchdog_;
+    
+    // 线程安全（订阅表的锁在各分片内）
     alignas(64) mutable std::mutex sessions_mutex_;
     alignas(64) mutable std::mutex connections_mutex_;
     
+    // 按负载再平衡
+    bool load_rebalance_enabled_;
+    double load_rebalance_threshold_;
+    double load_rebalance_max_utilization_;
+    double load_rebalance_min_rate_;
+    int load_rebalance_max_moves_;
+    
     // 维护定时器
     std::unique_ptr<std::thread> maintenance_thread_;
     std::atomic<bool> maintenance_running_;
     std::chrono::seconds maintenance_interval_;
     
+    // 退订延迟（最后一个session退订后保持订阅的时长，0 表示立即退订）
+    std::chrono::seconds unsubscribe_linger_;
+    
     // 重试机制
     std::set<std::string> retry_set_;
     std::mutex retry_set_mutex_;